@@ -101,6 +101,46 @@ C_BEGIN_DECLS
     };                                                                  \
     void __mu_f_test_##suite_name##_##test_name(void)
 
+/**
+ * @brief Defines a benchmark
+ *
+ * This macro defines a benchmark, which is run like a unit
+ * test but whose body is called over and over to time it.
+ * The body should perform one operation; the loader warms it
+ * up, picks how many calls to time together so that each
+ * sample is long enough to measure, and reports the time per
+ * call with its mean, median, 99th percentile and confidence
+ * interval.  Failing an assertion in the body fails the
+ * benchmark as it would a test.  Fixture setup and teardown
+ * run once around all calls, not for each one.
+ *
+ * <b>Example:</b>
+ * @code
+ * MU_BENCHMARK(Hash, short_string)
+ * {
+ *     hash("moonunit");
+ * }
+ * @endcode
+ *
+ * @param suite_name the unquoted name of the test suite which
+ * this benchmark should be part of
+ * @param bench_name the unquoted name of this benchmark
+ * @hideinitializer
+ */
+#define MU_BENCHMARK(suite_name, bench_name)                            \
+    void __mu_f_bench_##suite_name##_##bench_name(void);                \
+    C_DECL MuEntryInfo __mu_e_bench_##suite_name##_##bench_name;        \
+    MuEntryInfo __mu_e_bench_##suite_name##_##bench_name =              \
+    {                                                                   \
+        FIELD(type, MU_ENTRY_BENCHMARK),                                \
+        FIELD(name, #bench_name),                                       \
+        FIELD(container, #suite_name),                                  \
+        FIELD(file, __FILE__),                                          \
+        FIELD(line, __LINE__),                                          \
+        FIELD(run, __mu_f_bench_##suite_name##_##bench_name)            \
+    };                                                                  \
+    void __mu_f_bench_##suite_name##_##bench_name(void)
+
 /**
  * @brief Define library setup routine
  * 
@@ -512,6 +552,66 @@ C_BEGIN_DECLS
                          #expr1, #expr2, 0,                     \
                          type, (expr1), (expr2)))               \
 
+/**
+ * @brief Confirm how running time grows with input size or fail
+ *
+ * This macro times a workload at each of several input sizes
+ * and fits the timings to O(1), O(log n), O(n), O(n log n) and
+ * O(n^2), choosing the simplest which fits about as well as
+ * the best.  If a complexity worse than the given bound fits
+ * clearly and significantly better than any within it, the
+ * test will immediately fail and be terminated.  If one only
+ * fits somewhat better, the fit is reported as inconclusive
+ * and the test goes on.  Either way, the fit is reported with
+ * the test result.
+ *
+ * The workload is called repeatedly with each size and the
+ * given data pointer, and should do work proportional to
+ * the complexity being checked.  Sizes should span at least
+ * two orders of magnitude to tell the fits apart, and there
+ * must be from 3 to #MU_COMPLEXITY_MAX_SIZES of them.  The
+ * workload is timed by the CPU time of the calling thread, so
+ * other processes do not skew the fit, but time spent blocked
+ * or in other threads is not counted.  Each size is timed for
+ * about a tenth of a second of CPU time, so tests with slow
+ * workloads, or on busy machines, may need to raise their time
+ * allowance with MU_TIMEOUT.
+ *
+ * The following are legal values of the bound argument:
+ * <ul>
+ * <li>MU_COMPLEXITY_CONSTANT</li>
+ * <li>MU_COMPLEXITY_LOGARITHMIC</li>
+ * <li>MU_COMPLEXITY_LINEAR</li>
+ * <li>MU_COMPLEXITY_LINEARITHMIC</li>
+ * <li>MU_COMPLEXITY_QUADRATIC</li>
+ * </ul>
+ *
+ * <b>Example:</b>
+ * @code
+ * static void
+ * sort_workload(unsigned long size, void* data)
+ * {
+ *     fill_random(data, size);
+ *     sort(data, size);
+ * }
+ *
+ * static const unsigned long sizes[] = { 100, 1000, 10000, 100000 };
+ *
+ * MU_ASSERT_COMPLEXITY(MU_COMPLEXITY_LINEARITHMIC, sort_workload, buffer, sizes, 4);
+ * @endcode
+ *
+ * @param bound the MuComplexity the workload must not exceed
+ * @param workload the function to time, taking a size and the data pointer
+ * @param data a pointer to pass to the workload
+ * @param sizes an array of input sizes
+ * @param count the number of sizes
+ * @hideinitializer
+ */
+#define MU_ASSERT_COMPLEXITY(bound, workload, data, sizes, count)          \
+    (mu_interface_assert_complexity(__FILE__, __LINE__, #workload,      \
+                                    (bound), (workload), (data),        \
+                                    (sizes), (count)))
+
 /**
  * @brief Fail due to unexpected code path
  *
@@ -683,6 +783,159 @@ C_BEGIN_DECLS
 #define MU_ITERATE(count)                       \
     (mu_interface_iterations((count)))
 
+/**
+ * @brief Run copies of current test at once
+ *
+ * Use of this macro requests that, once the current test
+ * has run by itself, fixtures are torn down and set up again
+ * and the test is run several times in a row, then as the
+ * given number of copies at once, each on its own thread and
+ * each running it as many times.  The copies wait for each other
+ * to start, so that they contend for whatever the code under
+ * test shares, which can bring out races and lock contention.
+ * The first copy to fail ends the test with its result.  The
+ * throughput of the copies, and how it compares with the test
+ * run alone, is reported with the test result.
+ *
+ * Fixtures are set up once for all of these runs, not for
+ * each of them, so the runs in a row and the copies all share
+ * one fixture.  A stressed test must therefore be re-entrant:
+ * it may not rely on finding the fixture as setup left it.
+ *
+ * Calls to this macro from the copies themselves are ignored.
+ *
+ * <b>Example:</b>
+ * @code
+ * // Hammer the cache from 8 threads at once
+ * MU_STRESS(8);
+ * @endcode
+ *
+ * @param count the number of copies to run at once
+ * @hideinitializer
+ */
+#define MU_STRESS(count)                        \
+    (mu_interface_stress((count)))
+
+/**
+ * @brief Mark current test as unsafe to share a process
+ *
+ * Use of this macro indicates that the current test leaves
+ * behind state, such as running threads, signal handlers or
+ * modified global variables, which could affect tests run
+ * after it in the same process.  Loaders which run several
+ * tests in one process will not run any further tests in the
+ * process the current test ran in.
+ *
+ * <b>Example:</b>
+ * @code
+ * // This test leaves a helper thread running
+ * MU_UNSAFE();
+ * @endcode
+ *
+ * @hideinitializer
+ */
+#define MU_UNSAFE()                             \
+    (mu_interface_unsafe())
+
+/**
+ * @brief Add to a counter metric
+ *
+ * Adds to a named total which is reported with the test
+ * result, such as the number of requests a test made.
+ * Counters start at zero for each test.
+ *
+ * <b>Example:</b>
+ * @code
+ * MU_METRIC_COUNTER("retries", 1);
+ * @endcode
+ *
+ * @param name the name of the counter
+ * @param delta the amount to add
+ * @hideinitializer
+ */
+#define MU_METRIC_COUNTER(name, delta)                                  \
+    (mu_interface_metric(MU_METRIC_TYPE_COUNTER, (name), (double) (delta)))
+
+/**
+ * @brief Set a gauge metric
+ *
+ * Sets a named level which is reported with the test result,
+ * such as the depth of a queue.  The last value set is
+ * reported, together with the smallest, largest and mean
+ * values.
+ *
+ * <b>Example:</b>
+ * @code
+ * MU_METRIC_GAUGE("queue_depth", queue_length(queue));
+ * @endcode
+ *
+ * @param name the name of the gauge
+ * @param value the current level
+ * @hideinitializer
+ */
+#define MU_METRIC_GAUGE(name, value)                                    \
+    (mu_interface_metric(MU_METRIC_TYPE_GAUGE, (name), (double) (value)))
+
+/**
+ * @brief Record a latency metric
+ *
+ * Records a duration under a name.  Durations are collected
+ * into a histogram with logarithmically sized buckets, accurate
+ * to about 3%, in the test process, and only the histogram and
+ * its percentiles are reported with the test result.
+ *
+ * <b>Example:</b>
+ * @code
+ * MU_METRIC_LATENCY("request", end_ns - start_ns);
+ * @endcode
+ *
+ * @param name the name of the latency
+ * @param ns the duration in nanoseconds
+ * @hideinitializer
+ */
+#define MU_METRIC_LATENCY(name, ns)                                     \
+    (mu_interface_metric(MU_METRIC_TYPE_LATENCY, (name), (double) (ns)))
+
+/**
+ * @brief Attach the contents of a file to the result
+ *
+ * Copies what remains to be read from a descriptor, from its
+ * current position to its end, and attaches it to the test
+ * result under a name.  The copy is taken immediately, so the
+ * descriptor may be closed or changed afterwards.  Loggers
+ * decide how to present attachments; the XML and JSON loggers
+ * can save them as files of their own.
+ *
+ * <b>Example:</b>
+ * @code
+ * MU_ATTACH("server.log", log_fd);
+ * @endcode
+ *
+ * @param name the name of the attachment
+ * @param fd the descriptor to read from
+ * @hideinitializer
+ */
+#define MU_ATTACH(name, fd)                                             \
+    (mu_interface_attach((name), (fd)))
+
+/**
+ * @brief Attach the contents of a buffer to the result
+ *
+ * Like MU_ATTACH, but attaches len bytes from memory.
+ *
+ * <b>Example:</b>
+ * @code
+ * MU_ATTACH_BUFFER("response", response, response_length);
+ * @endcode
+ *
+ * @param name the name of the attachment
+ * @param ptr the start of the buffer
+ * @param len the length of the buffer in bytes
+ * @hideinitializer
+ */
+#define MU_ATTACH_BUFFER(name, ptr, len)                                \
+    (mu_interface_attach_buffer((name), (ptr), (len)))
+
 /**
  * @brief Log non-fatal message
  *
@@ -848,9 +1101,17 @@ C_BEGIN_DECLS
 void mu_interface_expect(MuTestStatus status);
 void mu_interface_timeout(long ms);
 void mu_interface_iterations(unsigned int count);
+void mu_interface_stress(unsigned int count);
+void mu_interface_metric(MuMetricType type, const char* name, double value);
+void mu_interface_attach(const char* name, int fd);
+void mu_interface_attach_buffer(const char* name, const void* data, size_t length);
+void mu_interface_unsafe(void);
 void mu_interface_event(const char* file, unsigned int line, MuLogLevel level, const char* fmt, ...);
 void mu_interface_assert(const char* file, unsigned int line, const char* expr, int sense, int result);
 void mu_interface_assert_equal(const char* file, unsigned int line, const char* expr1, const char* expr2, int sense, MuType type, ...);
+void mu_interface_assert_complexity(const char* file, unsigned int line, const char* expr,
+                                    MuComplexity bound, MuSizedThunk workload, void* data,
+                                    const unsigned long* sizes, unsigned int count);
 void mu_interface_result(const char* file, unsigned int line, MuTestStatus result, const char* message, ...);
 MuTest* mu_interface_current_test(void);
 
@@ -866,7 +1127,8 @@ typedef enum MuEntryType
     MU_ENTRY_FIXTURE_TEARDOWN,
     MU_ENTRY_LIBRARY_CONSTRUCT,
     MU_ENTRY_LIBRARY_DESTRUCT,
-    MU_ENTRY_LIBRARY_INFO
+    MU_ENTRY_LIBRARY_INFO,
+    MU_ENTRY_BENCHMARK
 } MuEntryType;
 
 typedef struct MuEntryInfo
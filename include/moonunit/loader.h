@@ -69,6 +69,16 @@ typedef struct MuLoader
     void (*construct) (struct MuLoader*, struct MuLibrary* handle, MuError** err);
     /* Runs the destructor for a library, which does any needed *one-time* teardown */
     void (*destruct) (struct MuLoader*, struct MuLibrary* handle, MuError** err);
+    /* Begins dispatching a single test without waiting for it to finish (optional).
+       Returns false if the test could not be started in the background */
+    bool (*dispatch_start)(struct MuLoader*, struct MuTest*, MuLogCallback, void*, MuLogLevel);
+    /* Waits for any test begun with dispatch_start to finish and returns its result,
+       storing the callback data it was started with in the last parameter.
+       Returns NULL if no tests are running */
+    struct MuTestResult* (*dispatch_wait)(struct MuLoader*, void**);
+    /* Stops all tests begun with dispatch_start (optional).  Each is still
+       returned by dispatch_wait, as skipped unless it finished first */
+    void (*dispatch_cancel)(struct MuLoader*);
 } MuLoader;
 
 bool mu_loader_can_open(MuLoader* loader, const char* path);
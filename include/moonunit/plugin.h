@@ -39,7 +39,11 @@ typedef struct MuPlugin
     /** Plugin API version */
     enum
     {
-        MU_PLUGIN_API_1
+        MU_PLUGIN_API_1,
+        /** MuTestResult holds usage, counters, benchmark, comparison,
+            complexity, stress, metrics and attachments in place of
+            its first reserved field */
+        MU_PLUGIN_API_2
     } version;
     /** Plugin type */
     enum
@@ -38,7 +38,12 @@ typedef enum MuInterfaceMeta
     MU_META_EXPECT,
     MU_META_TIMEOUT,
     MU_META_ITERATIONS,
-    MU_META_LOG_LEVEL
+    MU_META_LOG_LEVEL,
+    MU_META_UNSAFE,
+    MU_META_COMPLEXITY,
+    MU_META_STRESS,
+    MU_META_METRIC,
+    MU_META_ATTACH
 } MuInterfaceMeta;
 
 typedef struct MuInterfaceToken
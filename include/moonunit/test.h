@@ -105,6 +105,244 @@ typedef struct MuBacktrace
     void* reserved2;
 } MuBacktrace;
 
+typedef struct MuTestUsage
+{
+    /** CPU time spent in user mode, in microseconds */
+    unsigned long user_usec;
+    /** CPU time spent in the kernel, in microseconds */
+    unsigned long system_usec;
+    /** Peak resident set size, in kilobytes */
+    unsigned long max_rss;
+    /** Page faults serviced without I/O */
+    unsigned long minor_faults;
+    /** Page faults which required I/O */
+    unsigned long major_faults;
+    /** Context switches while waiting for a resource */
+    unsigned long voluntary_switches;
+    /** Context switches forced by the scheduler */
+    unsigned long involuntary_switches;
+    /** Bytes read through system calls, or -1 if unknown */
+    long long read_bytes;
+    /** Bytes written through system calls, or -1 if unknown */
+    long long write_bytes;
+} MuTestUsage;
+
+typedef struct MuTestCounters
+{
+    /** CPU cycles, or -1 if no hardware counters were available */
+    long long cycles;
+    /** Instructions retired, or -1 if no hardware counters were available */
+    long long instructions;
+    /** Cache misses, or -1 if no hardware counters were available */
+    long long cache_misses;
+    /** Mispredicted branches, or -1 if no hardware counters were available */
+    long long branch_misses;
+    /** Time spent running on a CPU, in nanoseconds */
+    long long task_clock;
+    /** Page faults */
+    long long page_faults;
+    /** Context switches */
+    long long context_switches;
+    /** Moves from one CPU to another */
+    long long cpu_migrations;
+} MuTestCounters;
+
+#define MU_BENCHMARK_MAX_SAMPLES 100
+
+typedef struct MuTestBenchmark
+{
+    /** Calls of the benchmark body timed together in each sample */
+    unsigned long iterations;
+    /** Number of samples taken */
+    unsigned int samples;
+    /** Mean time per call, in nanoseconds */
+    double mean;
+    /** Median time per call, in nanoseconds */
+    double median;
+    /** 99th percentile time per call, in nanoseconds */
+    double p99;
+    /** Standard deviation of the time per call, in nanoseconds */
+    double stddev;
+    /** Lower bound of the 95% confidence interval of the mean */
+    double ci_low;
+    /** Upper bound of the 95% confidence interval of the mean */
+    double ci_high;
+    /** Whether the confidence interval narrowed to the precision asked for */
+    int converged;
+    /** CPU the benchmark ran on, or -1 if unknown */
+    int cpu;
+    /** Whether the frequency of that CPU is left to a governor to scale */
+    int frequency_scaling;
+    /** Load average over the last minute when sampling began, per CPU */
+    double load;
+    /** Times the benchmark was preempted while taking samples */
+    unsigned long preemptions;
+    /** Time per call in each sample, in the order taken */
+    double sample[MU_BENCHMARK_MAX_SAMPLES];
+} MuTestBenchmark;
+
+#define MU_COMPLEXITY_MAX_SIZES 32
+
+typedef enum MuComplexity
+{
+    /** O(1) */
+    MU_COMPLEXITY_CONSTANT,
+    /** O(log n) */
+    MU_COMPLEXITY_LOGARITHMIC,
+    /** O(n) */
+    MU_COMPLEXITY_LINEAR,
+    /** O(n log n) */
+    MU_COMPLEXITY_LINEARITHMIC,
+    /** O(n^2) */
+    MU_COMPLEXITY_QUADRATIC
+} MuComplexity;
+
+typedef struct MuTestComplexity
+{
+    /** Complexity the test declared as the bound */
+    MuComplexity bound;
+    /** Complexity which best fits the timings */
+    MuComplexity fit;
+    /** Fixed part of the fitted time per call, in nanoseconds */
+    double constant;
+    /** Factor of the fitted complexity's term in the time per call, in nanoseconds */
+    double coefficient;
+    /** Root mean square of the relative error of the fit */
+    double error;
+    /** Root mean square of the estimated relative standard error of the
+        median time at each size */
+    double noise;
+    /** Whether a complexity worse than the bound fits clearly and
+        significantly better than any within it */
+    int exceeded;
+    /** Whether a complexity worse than the bound fits better, but
+        not clearly enough to say the bound was exceeded */
+    int inconclusive;
+    /** Number of sizes timed */
+    unsigned int sizes;
+    /** Each size timed */
+    unsigned long size[MU_COMPLEXITY_MAX_SIZES];
+    /** Median time per call at each size, in nanoseconds */
+    double time[MU_COMPLEXITY_MAX_SIZES];
+} MuTestComplexity;
+
+typedef struct MuTestStress
+{
+    /** Copies of the test run at once */
+    unsigned int copies;
+    /** Copies which finished, fewer than all if one of them failed */
+    unsigned int completed;
+    /** Times the test was run in a row alone, and by each copy */
+    unsigned int rounds;
+    /** Time taken by each run of the test alone, in nanoseconds */
+    double single_nsec;
+    /** Time from starting all the copies to the last one finishing, in nanoseconds */
+    double stress_nsec;
+    /** Runs finished per second when run alone */
+    double single_throughput;
+    /** Runs finished per second by all the copies at once */
+    double throughput;
+    /** Throughput at once over throughput alone, ideally the number of copies */
+    double scaling;
+} MuTestStress;
+
+typedef enum MuMetricType
+{
+    /** A total which tests add to */
+    MU_METRIC_TYPE_COUNTER,
+    /** A level which tests set */
+    MU_METRIC_TYPE_GAUGE,
+    /** Durations which tests record, in nanoseconds */
+    MU_METRIC_TYPE_LATENCY
+} MuMetricType;
+
+typedef struct MuMetricBucket
+{
+    /** Highest latency counted in the bucket, in nanoseconds */
+    unsigned long long upper;
+    /** Number of latencies in the bucket */
+    unsigned long long count;
+} MuMetricBucket;
+
+typedef struct MuTestMetric
+{
+    /** Name given by the test */
+    const char* name;
+    /** Kind of metric */
+    MuMetricType type;
+    /** Times the metric was added to, set or recorded */
+    unsigned long long count;
+    /** Total of a counter, or last value of a gauge */
+    double value;
+    /** Smallest value of a gauge or latency */
+    double min;
+    /** Largest value of a gauge or latency */
+    double max;
+    /** Mean value of a gauge or latency */
+    double mean;
+    /** Median latency, in nanoseconds */
+    double p50;
+    /** 90th percentile latency, in nanoseconds */
+    double p90;
+    /** 99th percentile latency, in nanoseconds */
+    double p99;
+    /** 99.9th percentile latency, in nanoseconds */
+    double p999;
+    /** Histogram of latencies, lowest non-empty bucket first */
+    MuMetricBucket* buckets;
+    /** Number of buckets in the histogram */
+    unsigned int bucket_count;
+    /** Next metric, in the order the test first used them */
+    struct MuTestMetric* next;
+} MuTestMetric;
+
+typedef enum MuTestVerdict
+{
+    /** No significant change from the baseline */
+    MU_VERDICT_UNCHANGED,
+    /** Significantly slower than the baseline */
+    MU_VERDICT_REGRESSED,
+    /** Significantly faster than the baseline */
+    MU_VERDICT_IMPROVED
+} MuTestVerdict;
+
+typedef struct MuTestComparison
+{
+    /** Whether the test got slower, faster or neither */
+    MuTestVerdict verdict;
+    /** Whether the timings are per benchmark call rather than per test */
+    int benchmark;
+    /** Median timing recorded in the baseline, in nanoseconds */
+    double baseline_median;
+    /** Median timing in this run, in nanoseconds */
+    double median;
+    /** Change of the median from the baseline, in percent */
+    double change;
+    /** Two-sided p-value of the Mann-Whitney U test, or -1 if a single
+        timing was judged against the range of the baseline instead */
+    double p_value;
+    /** Number of timings recorded in the baseline */
+    unsigned int baseline_samples;
+    /** Number of timings taken in this run */
+    unsigned int samples;
+} MuTestComparison;
+
+/** Name of the attachment holding what a test wrote to its standard
+    output and error, when the loader captured it and kept it */
+#define MU_ATTACHMENT_OUTPUT "output"
+
+typedef struct MuTestAttachment
+{
+    /** Name given by the test */
+    const char* name;
+    /** Descriptor holding the contents, from its start */
+    int fd;
+    /** Size of the contents in bytes */
+    unsigned long long size;
+    /** Next attachment, in the order the test made them */
+    struct MuTestAttachment* next;
+} MuTestAttachment;
+
 typedef struct MuTestResult
 {
     /** Status of the test (pass/fail) */
@@ -121,8 +359,23 @@ typedef struct MuTestResult
     unsigned int line;
     /** Backtrace, if available */
     MuBacktrace* backtrace;
+    /** Resources used by the test process, if measured */
+    MuTestUsage* usage;
+    /** Performance counters for the test stage, if enabled */
+    MuTestCounters* counters;
+    /** Timings of a benchmark, if the test is one and it completed */
+    MuTestBenchmark* benchmark;
+    /** Comparison of the timings with a baseline, if one was given */
+    MuTestComparison* comparison;
+    /** Fit of the timings of the last complexity assertion, if the test made one */
+    MuTestComplexity* complexity;
+    /** Throughput of simultaneous copies of the test, if it was stressed */
+    MuTestStress* stress;
+    /** Metrics the test recorded, if any */
+    MuTestMetric* metrics;
+    /** Artifacts the test attached, if any */
+    MuTestAttachment* attachments;
     /* Reserved */
-    void* reserved1;
     void* reserved2;
 } MuTestResult;
 #endif
@@ -170,11 +423,17 @@ typedef struct MuTest
 } MuTest;
 
 typedef void (*MuThunk) (void);
+typedef void (*MuSizedThunk) (unsigned long size, void* data);
 
 const char* mu_test_status_to_string(MuTestStatus status);
 const char* mu_test_stage_to_string(MuTestStage stage);
+const char* mu_test_verdict_to_string(MuTestVerdict verdict);
+const char* mu_complexity_to_string(MuComplexity complexity);
+const char* mu_metric_type_to_string(MuMetricType type);
 const char* mu_test_name(MuTest* test);
 const char* mu_test_suite(MuTest* test);
+char* mu_attachment_save(const MuTestAttachment* attachment, MuTest* test, const char* dir);
+char* mu_attachment_read(const MuTestAttachment* attachment);
 
 #endif
 
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __UIPC_GENERATE_H__
+#define __UIPC_GENERATE_H__
+
+#include <uipc/marshal.h>
+#include <moonunit/private/util.h>
+
+#include <string.h>
+
+/*
+ * Generates a typeinfo, prefix##_info, for a structure together with
+ * marshal and unmarshal functions specialized for it, which
+ * uipc_marshal_payload and friends then use instead of walking the
+ * member table.  The walk is still used for in place unmarshalling
+ * and sending as iovecs, and for pointees without generated code.
+ *
+ * fields is a macro taking (X, T) which lists the members that are
+ * not copied as they are, as X(STRING, T, field, 0) or
+ * X(POINTER, T, field, &pointee_info), e.g.
+ *
+ *     #define EVENT_FIELDS(X, T)                                       \
+ *         X(STRING, T, file, 0)                                        \
+ *         X(STRING, T, message, 0)
+ *
+ *     UIPC_GENERATE(logevent, MuLogEvent, EVENT_FIELDS)
+ *
+ * Only strings and pointers can be listed, so types with other kinds
+ * of members keep a member table.  Pointee typeinfos must be
+ * declared beforehand.  The results are
+ * laid out exactly as by the member table, so either end of a
+ * connection may use either.
+ */
+#define UIPC_GENERATE(prefix, type, fields)                             \
+    static unsigned long prefix##_marshal(void*, unsigned long, const void*, unsigned long); \
+    static unsigned long prefix##_unmarshal(void**, const void*, unsigned long); \
+                                                                        \
+    static const uipc_marshaller prefix##_marshaller =                  \
+    {                                                                   \
+        .marshal = prefix##_marshal,                                    \
+        .unmarshal = prefix##_unmarshal                                 \
+    };                                                                  \
+                                                                        \
+    static uipc_typeinfo prefix##_info =                                \
+    {                                                                   \
+        .name = #type,                                                  \
+        .size = sizeof(type),                                           \
+        .marshaller = &prefix##_marshaller,                             \
+        .members =                                                      \
+        {                                                               \
+            fields(UIPC_GENERATE_MEMBER, type)                          \
+            UIPC_END                                                    \
+        }                                                               \
+    };                                                                  \
+                                                                        \
+    static unsigned long                                                \
+    prefix##_marshal(void* buffer, unsigned long size, const void* payload, unsigned long offset) \
+    {                                                                   \
+        const type* object = payload;                                   \
+        unsigned long pad = UIPC_ALIGN_PAD(offset);                     \
+        unsigned long written = pad + sizeof(type);                     \
+        type* base = NULL;                                              \
+                                                                        \
+        if (size >= written)                                            \
+        {                                                               \
+            base = (type*) ((char*) buffer + pad);                      \
+            memset(buffer, 0, pad);                                     \
+            memcpy(base, object, sizeof(type));                         \
+        }                                                               \
+                                                                        \
+        fields(UIPC_GENERATE_MARSHAL, type)                             \
+                                                                        \
+        return written;                                                 \
+    }                                                                   \
+                                                                        \
+    static unsigned long                                                \
+    prefix##_unmarshal(void** out, const void* payload, unsigned long offset) \
+    {                                                                   \
+        unsigned long read = UIPC_ALIGN_PAD(offset);                    \
+        type* object = xmalloc(sizeof(type));                           \
+                                                                        \
+        memcpy(object, (const char*) payload + read, sizeof(type));     \
+        read += sizeof(type);                                           \
+                                                                        \
+        fields(UIPC_GENERATE_UNMARSHAL, type)                           \
+                                                                        \
+        *out = object;                                                  \
+        return read;                                                    \
+    }                                                                   \
+
+#define UIPC_GENERATE_MEMBER(kind, type, field, info) UIPC_GENERATE_MEMBER_##kind(type, field, info)
+#define UIPC_GENERATE_MEMBER_STRING(type, field, info) UIPC_STRING(type, field),
+#define UIPC_GENERATE_MEMBER_POINTER(type, field, info) UIPC_POINTER(type, field, info),
+
+/* Present members are marked with all ones, as uipc_marshal_payload does */
+#define UIPC_GENERATE_MARSHAL(kind, type, field, info) UIPC_GENERATE_MARSHAL_##kind(field, info)
+#define UIPC_GENERATE_MARSHAL_STRING(field, info)                       \
+    if (object->field)                                                  \
+    {                                                                   \
+        unsigned long length = strlen(object->field) + 1;               \
+                                                                        \
+        if (size >= written + length)                                   \
+            memcpy((char*) buffer + written, object->field, length);    \
+        written += length;                                              \
+    }                                                                   \
+    if (base)                                                           \
+        memset(&base->field, object->field ? 0xFF : 0x0, sizeof(base->field));
+#define UIPC_GENERATE_MARSHAL_POINTER(field, info)                      \
+    if (object->field)                                                  \
+    {                                                                   \
+        written += uipc_marshal_object((char*) buffer + written,        \
+                                       size > written ? size - written : 0, \
+                                       object->field, info, offset + written); \
+    }                                                                   \
+    if (base)                                                           \
+        memset(&base->field, object->field ? 0xFF : 0x0, sizeof(base->field));
+
+#define UIPC_GENERATE_UNMARSHAL(kind, type, field, info) UIPC_GENERATE_UNMARSHAL_##kind(field, info)
+#define UIPC_GENERATE_UNMARSHAL_STRING(field, info)                     \
+    if (object->field)                                                  \
+    {                                                                   \
+        unsigned long length = strlen((const char*) payload + read) + 1; \
+        char* string = xmalloc(length);                                 \
+                                                                        \
+        memcpy(string, (const char*) payload + read, length);           \
+        object->field = string;                                         \
+        read += length;                                                 \
+    }
+#define UIPC_GENERATE_UNMARSHAL_POINTER(field, info)                    \
+    if (object->field)                                                  \
+    {                                                                   \
+        void* member;                                                   \
+                                                                        \
+        read += uipc_unmarshal_object(&member, (const char*) payload + read, \
+                                      info, offset + read);             \
+        object->field = member;                                         \
+    }
+
+#endif
@@ -44,7 +44,12 @@ typedef unsigned int uipc_message_type;
 
 uipc_handle* uipc_attach(int socket);
 uipc_status uipc_recv(uipc_handle* handle, uipc_message** message, uipc_time* abs);
+bool uipc_pending(uipc_handle* handle);
 uipc_status uipc_send(uipc_handle* handle, uipc_message* message, uipc_time* abs);
+uipc_status uipc_queue(uipc_handle* handle, uipc_message* message);
+uipc_status uipc_queue_latest(uipc_handle* handle, uipc_message* message);
+unsigned long uipc_queued(uipc_handle* handle);
+uipc_status uipc_flush(uipc_handle* handle, uipc_time* abs);
 uipc_status uipc_detach(uipc_handle* handle);
 uipc_status uipc_close(uipc_handle* handle);
 
@@ -52,7 +57,12 @@ uipc_message* uipc_msg_new(uipc_message_type type);
 void uipc_msg_free(uipc_message* message);
 uipc_message_type uipc_msg_get_type(uipc_message* message);
 void* uipc_msg_get_payload(uipc_message* message, uipc_typeinfo* info);
+void* uipc_msg_take_payload(uipc_message* message, uipc_typeinfo* info);
+void* uipc_msg_view_payload(uipc_message* message, uipc_typeinfo* info);
 void uipc_msg_set_payload(uipc_message* message, const void* payload, uipc_typeinfo* info);
+void uipc_msg_set_fd(uipc_message* message, int fd);
+int uipc_msg_take_fd(uipc_message* message);
 void uipc_msg_free_payload(void* payload, uipc_typeinfo* info);
+void uipc_msg_free_member(void* payload, void* member);
 
 #endif
@@ -28,22 +28,48 @@
 #ifndef __UIPC_MARSHAL_H__
 #define __UIPC_MARSHAL_H__
 
+#include <stdbool.h>
+#include <sys/uio.h>
+
 typedef enum
 {
     UIPC_KIND_NONE,
     UIPC_KIND_STRING,
-    UIPC_KIND_POINTER
+    UIPC_KIND_POINTER,
+    /* A pointer to a number of elements given by another member */
+    UIPC_KIND_ARRAY,
+    /* A pointer to a number of bytes given by another member */
+    UIPC_KIND_BLOB,
+    /* An integer sent in as few bytes as its value needs, in types
+       where every member is one; elsewhere it is sent as it is */
+    UIPC_KIND_VARINT
 } uipc_kind;
 
+struct __uipc_typeinfo;
+
+/* Code specialized for one type, as made by UIPC_GENERATE.  Each
+   takes the offset of the object from the start of the payload */
+typedef struct uipc_marshaller
+{
+    unsigned long (*marshal)(void* buffer, unsigned long size, const void* payload, unsigned long offset);
+    unsigned long (*unmarshal)(void** out, const void* payload, unsigned long offset);
+} uipc_marshaller;
+
 typedef struct __uipc_typeinfo
 {
     unsigned long size;
     const char* name;
+    /* Used instead of walking members where there is one */
+    const uipc_marshaller* marshaller;
     struct
     {
         unsigned long offset;
         uipc_kind kind;
         struct __uipc_typeinfo* pointee_type;
+        /* Member holding the length of an array or blob */
+        unsigned long length_offset;
+        /* Size of that member, or of a varint */
+        unsigned long width;
     } members[];
 } uipc_typeinfo;
 
@@ -61,10 +87,61 @@ typedef struct __uipc_typeinfo
         .kind = UIPC_KIND_STRING,               \
     }                                           \
 
+#define UIPC_ARRAY(type, field, length, info)                \
+    {                                                       \
+        .offset = UIPC_OFFSET(type, field),                 \
+        .kind = UIPC_KIND_ARRAY,                            \
+        .pointee_type = info,                               \
+        .length_offset = UIPC_OFFSET(type, length),         \
+        .width = sizeof(((type*)0)->length)                 \
+    }                                                       \
+
+#define UIPC_BLOB(type, field, length)                      \
+    {                                                       \
+        .offset = UIPC_OFFSET(type, field),                 \
+        .kind = UIPC_KIND_BLOB,                             \
+        .length_offset = UIPC_OFFSET(type, length),         \
+        .width = sizeof(((type*)0)->length)                 \
+    }                                                       \
+
+#define UIPC_VARINT(type, field)                            \
+    {                                                       \
+        .offset = UIPC_OFFSET(type, field),                 \
+        .kind = UIPC_KIND_VARINT,                           \
+        .width = sizeof(((type*)0)->field)                  \
+    }                                                       \
+
 #define UIPC_END { .kind = UIPC_KIND_NONE }
 
+/* A payload marshalled as pieces to be sent with writev */
+typedef struct uipc_vector
+{
+    /* Where everything not sent from where it lies is copied */
+    char* buffer;
+    unsigned long size;
+    /* Bytes of buffer needed, which may be more than size */
+    unsigned long used;
+    struct iovec* iov;
+    int count, max;
+    /* Whether the last piece is in buffer and can be extended */
+    bool buffering;
+    /* Length of the payload */
+    unsigned long length;
+} uipc_vector;
+
+/* Padding which puts an object offset bytes into a payload on a
+   boundary suitable for any structure */
+#define UIPC_ALIGN_PAD(offset) ((sizeof(long) - (offset) % sizeof(long)) % sizeof(long))
+
+unsigned long uipc_marshal_object(void* buffer, unsigned long size, const void* payload,
+                                  uipc_typeinfo* type, unsigned long offset);
+unsigned long uipc_unmarshal_object(void** out, const void* payload, uipc_typeinfo* type,
+                                    unsigned long offset);
+unsigned long uipc_marshal_payload_vector(uipc_vector* vector, const void* payload, uipc_typeinfo* type);
 unsigned long uipc_marshal_payload(void* buffer, unsigned long size, const void* payload, uipc_typeinfo* type);
 unsigned long uipc_unmarshal_payload(void** out, const void* payload, uipc_typeinfo* type);
+unsigned long uipc_unmarshal_payload_inplace(void** out, void* payload, uipc_typeinfo* type);
 void uipc_free_object(void* object, uipc_typeinfo* type);
+void uipc_free_object_outside(void* object, uipc_typeinfo* type, const void* start, const void* end);
 
 #endif
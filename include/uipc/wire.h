@@ -32,11 +32,15 @@
 #include <uipc/ipc.h>
 #include <uipc/time.h>
 
+#include <sys/uio.h>
+
 typedef struct uipc_packet_header
 {
 	enum
 	{
-		PACKET_MESSAGE, PACKET_ACK
+		PACKET_MESSAGE, PACKET_ACK,
+		/* A message with a file descriptor passed alongside it */
+		PACKET_MESSAGE_FD
 	} type;
 	unsigned long length;
 } uipc_packet_header;
@@ -65,7 +69,11 @@ typedef struct __uipc_async_context
 } uipc_async_context;
 
 uipc_status uipc_packet_send(int socket, uipc_async_context* context, uipc_packet* packet);
+uipc_status uipc_packet_sendv(int socket, uipc_async_context* context, struct iovec* iov, int count);
+uipc_status uipc_packet_sendv_fd(int socket, uipc_async_context* context, struct iovec* iov, int count, int fd);
 uipc_status uipc_packet_recv(int socket, uipc_async_context* context, uipc_packet** packet);
+uipc_status uipc_packet_read(int socket, void* buffer, size_t size, size_t* amount,
+                              int* fds, unsigned int* fd_count, unsigned int fd_max);
 uipc_status uipc_packet_available(int socket, uipc_time* abs);
 uipc_status uipc_packet_sendable(int socket, uipc_time* abs);
 
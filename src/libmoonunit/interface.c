@@ -62,6 +62,41 @@ mu_interface_iterations(unsigned int count)
     token->meta(token, MU_META_ITERATIONS, count);
 }
 
+void
+mu_interface_stress(unsigned int count)
+{
+    MuInterfaceToken* token = mu_interface_current_token();
+    token->meta(token, MU_META_STRESS, count);
+}
+
+void
+mu_interface_metric(MuMetricType type, const char* name, double value)
+{
+    MuInterfaceToken* token = mu_interface_current_token();
+    token->meta(token, MU_META_METRIC, type, name, value);
+}
+
+void
+mu_interface_attach(const char* name, int fd)
+{
+    MuInterfaceToken* token = mu_interface_current_token();
+    token->meta(token, MU_META_ATTACH, name, fd, (const void*) NULL, (size_t) 0);
+}
+
+void
+mu_interface_attach_buffer(const char* name, const void* data, size_t length)
+{
+    MuInterfaceToken* token = mu_interface_current_token();
+    token->meta(token, MU_META_ATTACH, name, -1, data, length);
+}
+
+void
+mu_interface_unsafe(void)
+{
+    MuInterfaceToken* token = mu_interface_current_token();
+    token->meta(token, MU_META_UNSAFE);
+}
+
 void
 mu_interface_event(const char* file, unsigned int line, MuLogLevel level, const char* fmt, ...)
 {
@@ -261,6 +296,52 @@ mu_interface_assert_equal(const char* file, unsigned int line,
     }
 }
 
+void
+mu_interface_assert_complexity(const char* file, unsigned int line, const char* expr,
+                               MuComplexity bound, MuSizedThunk workload, void* data,
+                               const unsigned long* sizes, unsigned int count)
+{
+    MuInterfaceToken* token = mu_interface_current_token();
+    MuTestComplexity complexity;
+    MuTestResult summary = {};
+
+    complexity.sizes = 0;
+
+    if (count >= 3 && count <= MU_COMPLEXITY_MAX_SIZES)
+    {
+        /* The loader does the timing, and keeps the fit to report */
+        token->meta(token, MU_META_COMPLEXITY, bound, workload, data, sizes, count, &complexity);
+
+        if (complexity.sizes && !complexity.exceeded)
+            return;
+    }
+
+    if (count < 3 || count > MU_COMPLEXITY_MAX_SIZES)
+    {
+        summary.reason = format("Complexity assertion on %s needs from 3 to %u sizes, not %u",
+                                expr, MU_COMPLEXITY_MAX_SIZES, count);
+    }
+    else if (!complexity.sizes)
+    {
+        summary.reason = format("Complexity of %s could not be measured", expr);
+    }
+    else
+    {
+        summary.reason = format("Time taken by %s grew as %s, worse than %s",
+                                expr, mu_complexity_to_string(complexity.fit),
+                                mu_complexity_to_string(bound));
+    }
+
+    summary.status = MU_STATUS_ASSERTION;
+    summary.line = line;
+    summary.file = file;
+    summary.backtrace = NULL;
+
+    token->result(token, &summary);
+
+    free((void*) summary.reason);
+}
+
 void   
 mu_interface_result(const char* file, unsigned int line, MuTestStatus result, const char* message, ...)
 {
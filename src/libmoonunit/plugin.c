@@ -47,7 +47,7 @@ static MuPlugin*
 load_plugin(const char* path)
 {
     void* handle = mu_dlopen(path, RTLD_LAZY);
-   
+    MuPlugin* plugin = NULL;
     MuPlugin* (*load)(void);
 
     if (!handle)
@@ -62,7 +62,14 @@ load_plugin(const char* path)
     if (!load)
         return NULL;
 
-    return load();
+    plugin = load();
+
+    /* Plugins built for another version disagree with us on the
+       layout of test results, so they cannot be used */
+    if (plugin && plugin->version != MU_PLUGIN_API_2)
+        return NULL;
+
+    return plugin;
 }
 
 static void
@@ -25,6 +25,10 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifdef HAVE_CONFIG_H
+#    include <config.h>
+#endif
+
 #include <moonunit/test.h>
 #include <moonunit/private/util.h>
 #include <moonunit/loader.h>
@@ -33,6 +37,13 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_SENDFILE_H
+#    include <sys/sendfile.h>
+#endif
 
 const char*
 mu_test_status_to_string(MuTestStatus result)
@@ -81,6 +92,58 @@ mu_test_stage_to_string(MuTestStage stage)
 	}
 }
 
+const char*
+mu_test_verdict_to_string(MuTestVerdict verdict)
+{
+    switch (verdict)
+    {
+    case MU_VERDICT_UNCHANGED:
+        return "unchanged";
+    case MU_VERDICT_REGRESSED:
+        return "regressed";
+    case MU_VERDICT_IMPROVED:
+        return "improved";
+    default:
+        return "unknown";
+    }
+}
+
+const char*
+mu_complexity_to_string(MuComplexity complexity)
+{
+    switch (complexity)
+    {
+    case MU_COMPLEXITY_CONSTANT:
+        return "O(1)";
+    case MU_COMPLEXITY_LOGARITHMIC:
+        return "O(log n)";
+    case MU_COMPLEXITY_LINEAR:
+        return "O(n)";
+    case MU_COMPLEXITY_LINEARITHMIC:
+        return "O(n log n)";
+    case MU_COMPLEXITY_QUADRATIC:
+        return "O(n^2)";
+    default:
+        return "unknown";
+    }
+}
+
+const char*
+mu_metric_type_to_string(MuMetricType type)
+{
+    switch (type)
+    {
+    case MU_METRIC_TYPE_COUNTER:
+        return "counter";
+    case MU_METRIC_TYPE_GAUGE:
+        return "gauge";
+    case MU_METRIC_TYPE_LATENCY:
+        return "latency";
+    default:
+        return "unknown";
+    }
+}
+
 const char*
 mu_test_name(MuTest* test)
 {
@@ -92,3 +155,108 @@ mu_test_suite(MuTest* test)
 {
     return test->loader->test_suite(test->loader, test);
 }
+
+/* Copies the contents of an attachment to out without moving the
+   offset of its descriptor, so it can be saved more than once */
+static int
+attachment_copy(const MuTestAttachment* attachment, int out)
+{
+    off_t offset = 0;
+    ssize_t amount;
+    char buffer[4096];
+
+#ifdef HAVE_SENDFILE
+    while ((unsigned long long) offset < attachment->size)
+    {
+        amount = sendfile(out, attachment->fd, &offset, attachment->size - offset);
+
+        if (amount < 0 && errno == EINTR)
+            continue;
+        else if (amount < 0 && offset == 0 && (errno == EINVAL || errno == ENOSYS))
+            break;
+        else if (amount <= 0)
+            return -1;
+    }
+
+    if ((unsigned long long) offset >= attachment->size)
+        return 0;
+#endif
+
+    while ((amount = pread(attachment->fd, buffer, sizeof(buffer), offset)) != 0)
+    {
+        if (amount < 0 && errno == EINTR)
+            continue;
+        else if (amount < 0 || write(out, buffer, amount) != amount)
+            return -1;
+
+        offset += amount;
+    }
+
+    return 0;
+}
+
+/* Returns the contents of an attachment as a string, which stops
+   short at any NUL byte in them, or NULL if they cannot be read */
+char*
+mu_attachment_read(const MuTestAttachment* attachment)
+{
+    char* contents = xmalloc(attachment->size + 1);
+    unsigned long long offset = 0;
+    ssize_t amount;
+
+    while (offset < attachment->size)
+    {
+        amount = pread(attachment->fd, contents + offset, attachment->size - offset, offset);
+
+        if (amount < 0 && errno == EINTR)
+            continue;
+        else if (amount < 0)
+        {
+            free(contents);
+            return NULL;
+        }
+        else if (amount == 0)
+            break;
+
+        offset += amount;
+    }
+
+    contents[offset] = '\0';
+
+    return contents;
+}
+
+/* Writes an attachment to a file of its own in dir, named after
+   the test and the attachment, and returns the path of the file */
+char*
+mu_attachment_save(const MuTestAttachment* attachment, MuTest* test, const char* dir)
+{
+    char* path = format("%s/%s.%s.", dir, mu_test_suite(test), mu_test_name(test));
+    char* name = format("%s%s", path, attachment->name);
+    char* c;
+    int out;
+
+    /* Names are the test's to choose, but must not leave dir */
+    for (c = name + strlen(path); *c; c++)
+    {
+        if (*c == '/')
+            *c = '_';
+    }
+
+    free(path);
+
+    if ((out = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        free(name);
+        return NULL;
+    }
+
+    if (attachment_copy(attachment, out) || close(out))
+    {
+        unlink(name);
+        free(name);
+        return NULL;
+    }
+
+    return name;
+}
@@ -32,188 +32,766 @@
 #include <string.h>
 #include <stdlib.h>
 
-#define REDUCE(lvalue, delta) (reduce(&lvalue, delta))
+/* Structures start on this boundary from the start of the payload,
+   so they can be used where they lie once unmarshalled in place */
+#define ALIGN_PAD(offset) UIPC_ALIGN_PAD(offset)
+/* What is left of size bytes after used of them */
+#define REMAINING(size, used) ((size) > (used) ? (size) - (used) : 0)
+#define MEMBER(object, type, i) ((char*) (object) + (type)->members[i].offset)
 
-static inline void
-reduce(unsigned long* size, unsigned long delta)
+/* Whether a type is sent as nothing but its varints */
+static bool
+type_is_packed(uipc_typeinfo* type)
 {
-    if (*size > delta)
-        (*size) -= delta;
-    else
-        *size = 0;
+    int i;
+
+    for (i = 0; type->members[i].kind != UIPC_KIND_NONE; i++)
+    {
+        if (type->members[i].kind != UIPC_KIND_VARINT)
+            return false;
+    }
+
+    return i > 0;
+}
+
+static unsigned long long
+read_width(const void* field, unsigned long width)
+{
+    switch (width)
+    {
+    case 1:
+        return *(const unsigned char*) field;
+    case 2:
+        return *(const unsigned short*) field;
+    case 4:
+        return *(const unsigned int*) field;
+    default:
+        return *(const unsigned long long*) field;
+    }
+}
+
+static void
+write_width(void* field, unsigned long width, unsigned long long value)
+{
+    switch (width)
+    {
+    case 1:
+        *(unsigned char*) field = value;
+        break;
+    case 2:
+        *(unsigned short*) field = value;
+        break;
+    case 4:
+        *(unsigned int*) field = value;
+        break;
+    default:
+        *(unsigned long long*) field = value;
+        break;
+    }
 }
 
+/* Returns the number of elements or bytes of an array or blob member */
 static unsigned long
-marshal_string(void* buffer, unsigned long size, const void* payload)
+member_length(const void* object, uipc_typeinfo* type, int i)
 {
-    if (payload)
+    return read_width((const char*) object + type->members[i].length_offset,
+                      type->members[i].width);
+}
+
+/* Returns whether a member has anything to send after the structure,
+   which is what the marker left in its place says */
+static bool
+member_present(const void* object, uipc_typeinfo* type, int i)
+{
+    if (!*(void* const*) MEMBER(object, type, i))
+        return false;
+
+    switch (type->members[i].kind)
     {
-        unsigned long length = strlen((const char*) payload);
-        
-        if (size >= length + 1)
-            memcpy(buffer, payload, length+1);
-        return (length + 1);
+    case UIPC_KIND_ARRAY:
+    case UIPC_KIND_BLOB:
+        return member_length(object, type, i) > 0;
+    default:
+        return true;
     }
-    else
+}
+
+/* Writes a varint, seven bits to a byte with the top bit
+   set on all but the last, if size allows, and returns its length */
+static unsigned long
+varint_write(void* buffer, unsigned long size, unsigned long long value)
+{
+    unsigned char bytes[10];
+    unsigned long length = 0;
+
+    do
     {
-        return 0;
+        bytes[length] = (value & 0x7F) | (value > 0x7F ? 0x80 : 0);
+        value >>= 7;
+        length++;
+    } while (value);
+
+    if (size >= length)
+        memcpy(buffer, bytes, length);
+
+    return length;
+}
+
+static unsigned long
+varint_read(const void* buffer, unsigned long long* value)
+{
+    const unsigned char* bytes = buffer;
+    unsigned long length = 0;
+    unsigned int shift = 0;
+
+    *value = 0;
+
+    do
+    {
+        *value |= (unsigned long long) (bytes[length] & 0x7F) << shift;
+        shift += 7;
+    } while (bytes[length++] & 0x80);
+
+    return length;
+}
+
+static unsigned long
+marshal_packed(void* buffer, unsigned long size, const void* payload, uipc_typeinfo* type)
+{
+    int i;
+    unsigned long written = 0;
+
+    for (i = 0; type->members[i].kind != UIPC_KIND_NONE; i++)
+    {
+        written += varint_write((char*) buffer + written, REMAINING(size, written),
+                                read_width(MEMBER(payload, type, i), type->members[i].width));
     }
+
+    return written;
 }
 
-unsigned long
-uipc_marshal_payload(void* buffer, unsigned long size, const void* payload, uipc_typeinfo* type)
+static unsigned long
+unmarshal_packed(void* object, const void* payload, uipc_typeinfo* type)
+{
+    int i;
+    unsigned long read = 0;
+    unsigned long long value;
+
+    for (i = 0; type->members[i].kind != UIPC_KIND_NONE; i++)
+    {
+        read += varint_read((const char*) payload + read, &value);
+        write_width(MEMBER(object, type, i), type->members[i].width, value);
+    }
+
+    return read;
+}
+
+static unsigned long marshal_members(void* buffer, unsigned long size, const void* payload,
+                                     char* base, uipc_typeinfo* type, unsigned long offset);
+
+static unsigned long
+marshal_bytes(void* buffer, unsigned long size, const void* bytes, unsigned long length)
+{
+    if (size >= length)
+        memcpy(buffer, bytes, length);
+
+    return length;
+}
+
+/* Arrays of packed elements are their varints one after another, and
+   others are the structures together followed by what each needs */
+static unsigned long
+marshal_array(void* buffer, unsigned long size, const void* array, unsigned long count,
+              uipc_typeinfo* type, unsigned long offset)
+{
+    unsigned long i;
+    unsigned long written = 0;
+    unsigned long pad;
+    char* base = NULL;
+
+    if (type_is_packed(type))
+    {
+        for (i = 0; i < count; i++)
+        {
+            written += marshal_packed((char*) buffer + written, REMAINING(size, written),
+                                      (const char*) array + i * type->size, type);
+        }
+
+        return written;
+    }
+
+    pad = ALIGN_PAD(offset);
+    written = pad + count * type->size;
+
+    if (size >= written)
+    {
+        base = (char*) buffer + pad;
+        memset(buffer, 0, pad);
+        memcpy(base, array, count * type->size);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        written += marshal_members((char*) buffer + written, REMAINING(size, written),
+                                   (const char*) array + i * type->size,
+                                   base ? base + i * type->size : NULL,
+                                   type, offset + written);
+    }
+
+    return written;
+}
+
+/* Marshals what an object refers to, which follows the structure itself,
+   and marks which members were present in the copy of it at base */
+static unsigned long
+marshal_members(void* buffer, unsigned long size, const void* payload,
+                char* base, uipc_typeinfo* type, unsigned long offset)
 {
 	int i;
-    unsigned long delta;
     unsigned long written = 0;
-    void* base = NULL;
+    bool present;
+    void* member;
+
+    for (i = 0; type->members[i].kind != UIPC_KIND_NONE; i++)
+    {
+        if (type->members[i].kind == UIPC_KIND_VARINT)
+            continue;
+
+        member = *(void**) MEMBER(payload, type, i);
+        present = member_present(payload, type, i);
+
+        if (base)
+            memset(MEMBER(base, type, i), present ? 0xFF : 0x0, sizeof(void*));
+
+        if (!present)
+            continue;
+
+        switch (type->members[i].kind)
+        {
+        case UIPC_KIND_STRING:
+            written += marshal_bytes((char*) buffer + written, REMAINING(size, written),
+                                     member, strlen((const char*) member) + 1);
+            break;
+        case UIPC_KIND_POINTER:
+            written += uipc_marshal_object((char*) buffer + written, REMAINING(size, written),
+                                           member, type->members[i].pointee_type,
+                                           offset + written);
+            break;
+        case UIPC_KIND_ARRAY:
+            written += marshal_array((char*) buffer + written, REMAINING(size, written),
+                                     member, member_length(payload, type, i),
+                                     type->members[i].pointee_type, offset + written);
+            break;
+        case UIPC_KIND_BLOB:
+            written += marshal_bytes((char*) buffer + written, REMAINING(size, written),
+                                     member, member_length(payload, type, i));
+            break;
+        default:
+            ;
+        }
+    }
+    
+    return written;
+}
+
+/* Marshals an object offset bytes into the payload, writing nothing
+   past size bytes, and returns how many bytes it takes regardless */
+unsigned long
+uipc_marshal_object(void* buffer, unsigned long size, const void* payload, uipc_typeinfo* type,
+                    unsigned long offset)
+{
+    unsigned long pad = ALIGN_PAD(offset);
+    unsigned long written = pad + type->size;
+    char* base = NULL;
 
     if (payload == NULL)
     {
         return 0;
     }
 
-    if (size >= type->size)
+    if (type->marshaller)
+    {
+        return type->marshaller->marshal(buffer, size, payload, offset);
+    }
+
+    if (type_is_packed(type))
+    {
+        return marshal_packed(buffer, size, payload, type);
+    }
+
+    if (size >= written)
+    {
+        base = (char*) buffer + pad;
+        memset(buffer, 0, pad);
+        memcpy(base, payload, type->size);
+    }
+
+    return written + marshal_members((char*) buffer + written, REMAINING(size, written),
+                                     payload, base, type, offset + written);
+}
+
+unsigned long
+uipc_marshal_payload(void* buffer, unsigned long size, const void* payload, uipc_typeinfo* type)
+{
+    return uipc_marshal_object(buffer, size, payload, type, 0);
+}
+
+/* Strings and blobs at least this long are sent from where they
+   are rather than copied, as long as there are iovecs to spare */
+#define VECTOR_INPLACE_MIN 256
+
+/* Adds length bytes to the payload in a vector and returns where
+   to put them, or NULL if the buffer is too small to hold them */
+static void*
+vector_reserve(uipc_vector* vector, unsigned long length)
+{
+    void* space = vector->buffer + vector->used;
+    bool fits = vector->used + length <= vector->size;
+
+    if (!vector->buffering)
+    {
+        if (fits)
+        {
+            vector->iov[vector->count].iov_base = space;
+            vector->iov[vector->count].iov_len = 0;
+        }
+        vector->count++;
+        vector->buffering = true;
+    }
+
+    if (fits)
+        vector->iov[vector->count - 1].iov_len += length;
+
+    vector->used += length;
+    vector->length += length;
+
+    return fits ? space : NULL;
+}
+
+static void
+vector_bytes(uipc_vector* vector, const void* bytes, unsigned long length)
+{
+    void* space;
+
+    /* Always leave an iovec for whatever is copied after this */
+    if (length >= VECTOR_INPLACE_MIN && vector->count + 2 <= vector->max)
+    {
+        if (vector->used <= vector->size)
+        {
+            vector->iov[vector->count].iov_base = (void*) bytes;
+            vector->iov[vector->count].iov_len = length;
+        }
+        vector->count++;
+        vector->buffering = false;
+        vector->length += length;
+    }
+    else if ((space = vector_reserve(vector, length)))
+    {
+        memcpy(space, bytes, length);
+    }
+}
+
+static void
+vector_packed(uipc_vector* vector, const void* payload, uipc_typeinfo* type)
+{
+    unsigned long length = marshal_packed(NULL, 0, payload, type);
+    void* space = vector_reserve(vector, length);
+
+    if (space)
+        marshal_packed(space, length, payload, type);
+}
+
+static void marshal_members_vector(uipc_vector* vector, const void* payload,
+                                   char* base, uipc_typeinfo* type);
+
+static void
+marshal_array_vector(uipc_vector* vector, const void* array, unsigned long count,
+                     uipc_typeinfo* type)
+{
+    unsigned long i;
+    unsigned long pad;
+    char* base;
+
+    if (type_is_packed(type))
+    {
+        for (i = 0; i < count; i++)
+            vector_packed(vector, (const char*) array + i * type->size, type);
+        return;
+    }
+
+    pad = ALIGN_PAD(vector->length);
+    base = vector_reserve(vector, pad + count * type->size);
+
+    if (base)
+    {
+        memset(base, 0, pad);
+        base += pad;
+        memcpy(base, array, count * type->size);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        marshal_members_vector(vector, (const char*) array + i * type->size,
+                               base ? base + i * type->size : NULL, type);
+    }
+}
+
+static void
+marshal_object_vector(uipc_vector* vector, const void* payload, uipc_typeinfo* type)
+{
+    unsigned long pad;
+    char* base;
+
+    if (type_is_packed(type))
+    {
+        vector_packed(vector, payload, type);
+        return;
+    }
+
+    pad = ALIGN_PAD(vector->length);
+    base = vector_reserve(vector, pad + type->size);
+
+    if (base)
     {
-        base = buffer;
-        memcpy(buffer, payload, type->size);
+        memset(base, 0, pad);
+        base += pad;
+        memcpy(base, payload, type->size);
     }
 
-    buffer += type->size;
-    written += type->size;
+    marshal_members_vector(vector, payload, base, type);
+}
 
-    REDUCE(size, type->size);
+static void
+marshal_members_vector(uipc_vector* vector, const void* payload, char* base, uipc_typeinfo* type)
+{
+    int i;
+    bool present;
+    void* member;
 
     for (i = 0; type->members[i].kind != UIPC_KIND_NONE; i++)
     {
+        if (type->members[i].kind == UIPC_KIND_VARINT)
+            continue;
+
+        member = *(void**) MEMBER(payload, type, i);
+        present = member_present(payload, type, i);
+
+        if (base)
+            memset(MEMBER(base, type, i), present ? 0xFF : 0x0, sizeof(void*));
+
+        if (!present)
+            continue;
+
         switch (type->members[i].kind)
         {
         case UIPC_KIND_STRING:
-            delta = marshal_string(buffer, size, *(void **)(payload + type->members[i].offset));
-            if (base)
-                memset(base + type->members[i].offset, delta ? 0xFF : 0x0, sizeof(char*));
-            buffer += delta;
-            written += delta;
-            REDUCE(size, delta);
+            vector_bytes(vector, member, strlen((const char*) member) + 1);
             break;
         case UIPC_KIND_POINTER:
-            delta = uipc_marshal_payload(buffer, size, 
-                                         *(void **)(payload + type->members[i].offset), 
-                                         type->members[i].pointee_type);
-            if (base)
-                memset(base + type->members[i].offset, delta ? 0xFF : 0x0, sizeof(void*));
-            buffer += delta;
-            written += delta;
-            REDUCE(size, delta);
+            marshal_object_vector(vector, member, type->members[i].pointee_type);
+            break;
+        case UIPC_KIND_ARRAY:
+            marshal_array_vector(vector, member, member_length(payload, type, i),
+                                 type->members[i].pointee_type);
+            break;
+        case UIPC_KIND_BLOB:
+            vector_bytes(vector, member, member_length(payload, type, i));
             break;
         default:
             ;
         }
     }
-    
-    return written;
 }
 
-static
+/* Marshals a payload onto the end of a vector in the same format as
+   uipc_marshal_payload, but with long strings left where they are and
+   padding on the end so whatever follows is aligned too.  If
+   vector->used comes out larger than vector->size, nothing in it can
+   be used and it must be done again with a buffer that large */
 unsigned long
-unmarshal_string(void** out, const void* payload)
+uipc_marshal_payload_vector(uipc_vector* vector, const void* payload, uipc_typeinfo* type)
 {
+    unsigned long start = vector->length;
+    unsigned long pad;
+    void* space;
+
     if (payload)
+        marshal_object_vector(vector, payload, type);
+
+    pad = ALIGN_PAD(vector->length);
+
+    if (pad && (space = vector_reserve(vector, pad)))
+        memset(space, 0, pad);
+
+    return vector->length - start;
+}
+
+static unsigned long unmarshal_members(void* object, const void* payload, uipc_typeinfo* type,
+                                       unsigned long offset, bool inplace);
+
+/* Reads an array into memory of its own, unless it can be used where it lies */
+static unsigned long
+unmarshal_array(void** out, const void* payload, unsigned long count, uipc_typeinfo* type,
+                unsigned long offset, bool inplace)
+{
+    unsigned long i;
+    unsigned long read = 0;
+    char* array;
+
+    if (type_is_packed(type))
     {
-        *out = strdup((const char*) payload);    
-        return strlen((const char*) payload) + 1;
+        array = xcalloc(count, type->size);
+
+        for (i = 0; i < count; i++)
+            read += unmarshal_packed(array + i * type->size, (const char*) payload + read, type);
     }
     else
     {
-        *out = NULL;
-        return 0;
+        read = ALIGN_PAD(offset);
+
+        if (inplace)
+        {
+            array = (char*) payload + read;
+        }
+        else
+        {
+            array = xmalloc(count * type->size);
+            memcpy(array, (const char*) payload + read, count * type->size);
+        }
+
+        read += count * type->size;
+
+        for (i = 0; i < count; i++)
+        {
+            read += unmarshal_members(array + i * type->size, (const char*) payload + read,
+                                      type, offset + read, inplace);
+        }
     }
-    
+
+    *out = array;
+
+    return read;
 }
 
-unsigned long
-uipc_unmarshal_payload(void** out, const void* payload, uipc_typeinfo* type)
+static unsigned long
+unmarshal_object(void** out, const void* payload, uipc_typeinfo* type, unsigned long offset,
+                 bool inplace)
 {
-    int i;
+    unsigned long read = ALIGN_PAD(offset);
     void* object;
-    unsigned long delta;
-    unsigned long read = 0;
-    void* member;
-    const void* base = payload;
 
-    object = xmalloc(type->size);
-    memcpy(object, payload, type->size);
+    if (type_is_packed(type))
+    {
+        object = xcalloc(1, type->size);
+        read = unmarshal_packed(object, payload, type);
+    }
+    else
+    {
+        if (inplace)
+        {
+            object = (char*) payload + read;
+        }
+        else
+        {
+            object = xmalloc(type->size);
+            memcpy(object, (const char*) payload + read, type->size);
+        }
+
+        read += type->size;
+        read += unmarshal_members(object, (const char*) payload + read, type, offset + read, inplace);
+    }
+
+    *out = object;
+
+    return read;
+}
 
-    payload += type->size;
-    read += type->size;
+/* Reads what follows an object, according to the markers in it, and
+   points its members at the result */
+static unsigned long
+unmarshal_members(void* object, const void* payload, uipc_typeinfo* type, unsigned long offset,
+                  bool inplace)
+{
+    int i;
+    unsigned long read = 0;
+    unsigned long length;
+    void** member;
+    const char* data;
 
     for (i = 0; type->members[i].kind != UIPC_KIND_NONE; i++)
     {
+        member = (void**) MEMBER(object, type, i);
+        data = (const char*) payload + read;
+
+        if (type->members[i].kind == UIPC_KIND_VARINT || !*member)
+            continue;
+
         switch (type->members[i].kind)
         {
         case UIPC_KIND_STRING:
-            /* Structures in payload may be unaligned, so access with memcpy */
-            memcpy(&member, base + type->members[i].offset, sizeof(member));
-            if (member)
-            {
-                delta = unmarshal_string(object + type->members[i].offset, payload);
-                payload += delta;
-                read += delta;
-            }
-            else
-            {
-                *(void**) (object + type->members[i].offset) = NULL;
-            }
+            length = strlen(data) + 1;
+            *member = inplace ? (void*) data : memcpy(xmalloc(length), data, length);
+            read += length;
             break;
         case UIPC_KIND_POINTER:
-            memcpy(&member, base + type->members[i].offset, sizeof(member));
-            if (member)
-            {
-                delta = uipc_unmarshal_payload(object + type->members[i].offset, payload, 
-                                               type->members[i].pointee_type);
-                payload += delta;
-                read += delta;
-            }
+            if (inplace)
+                read += unmarshal_object(member, data, type->members[i].pointee_type,
+                                         offset + read, true);
             else
-            {
-                *(void**) (object + type->members[i].offset) = NULL;
-            }
+                read += uipc_unmarshal_object(member, data, type->members[i].pointee_type,
+                                              offset + read);
+            break;
+        case UIPC_KIND_ARRAY:
+            read += unmarshal_array(member, data, member_length(object, type, i),
+                                    type->members[i].pointee_type, offset + read, inplace);
+            break;
+        case UIPC_KIND_BLOB:
+            length = member_length(object, type, i);
+            *member = inplace ? (void*) data : memcpy(xmalloc(length), data, length);
+            read += length;
             break;
         default:
             ;
         }
     }
     
-    *out = object;
-
     return read;
 }
 
-void
-uipc_free_object(void* object, uipc_typeinfo* type)
+unsigned long
+uipc_unmarshal_object(void** out, const void* payload, uipc_typeinfo* type, unsigned long offset)
+{
+    if (type->marshaller)
+    {
+        return type->marshaller->unmarshal(out, payload, offset);
+    }
+
+    return unmarshal_object(out, payload, type, offset, false);
+}
+
+unsigned long
+uipc_unmarshal_payload(void** out, const void* payload, uipc_typeinfo* type)
+{
+    return uipc_unmarshal_object(out, payload, type, 0);
+}
+
+/* Turns a payload into the object it holds without copying anything,
+   by pointing the pointers in it at what follows them in the payload.
+   The payload must start on a boundary suitable for any structure.
+   Varints have to be decoded into memory of their own, which is
+   freed along with the rest by uipc_free_object_outside */
+unsigned long
+uipc_unmarshal_payload_inplace(void** out, void* payload, uipc_typeinfo* type)
+{
+    return unmarshal_object(out, payload, type, 0, true);
+}
+
+static void
+free_members(void* object, uipc_typeinfo* type)
 {
     int i;
+    unsigned long j, count;
     void* member;
 
-    if (!object)
-        return;
-
     for (i = 0; type->members[i].kind != UIPC_KIND_NONE; i++)
     {
+        if (type->members[i].kind == UIPC_KIND_VARINT)
+            continue;
+
+        member = *(void**) MEMBER(object, type, i);
+
         switch (type->members[i].kind)
         {
         case UIPC_KIND_STRING:
-            member = *(void**) (object + type->members[i].offset);
+        case UIPC_KIND_BLOB:
             free(member);
             break;
         case UIPC_KIND_POINTER:
-            member = *(void**) (object + type->members[i].offset);
             uipc_free_object(member, type->members[i].pointee_type);
             break;
+        case UIPC_KIND_ARRAY:
+            if (member)
+            {
+                count = member_length(object, type, i);
+                for (j = 0; j < count; j++)
+                    free_members((char*) member + j * type->members[i].pointee_type->size,
+                                 type->members[i].pointee_type);
+                free(member);
+            }
+            break;
         default:
             ;
         }
     }
+}
+
+void
+uipc_free_object(void* object, uipc_typeinfo* type)
+{
+    if (!object)
+        return;
 
+    free_members(object, type);
     free(object);
 }
+
+/* Frees whatever the members of an object unmarshalled in place between
+   start and end have been pointed at since, leaving the rest alone */
+void
+uipc_free_object_outside(void* object, uipc_typeinfo* type, const void* start, const void* end)
+{
+    int i;
+    unsigned long j, count;
+    void* member;
+    uipc_typeinfo* pointee;
+
+    for (i = 0; type->members[i].kind != UIPC_KIND_NONE; i++)
+    {
+        if (type->members[i].kind == UIPC_KIND_VARINT)
+            continue;
+
+        member = *(void**) MEMBER(object, type, i);
+        pointee = type->members[i].pointee_type;
+
+        if (!member)
+            continue;
+
+        if ((const char*) member >= (const char*) start && (const char*) member < (const char*) end)
+        {
+            switch (type->members[i].kind)
+            {
+            case UIPC_KIND_POINTER:
+                uipc_free_object_outside(member, pointee, start, end);
+                break;
+            case UIPC_KIND_ARRAY:
+                count = member_length(object, type, i);
+                for (j = 0; j < count; j++)
+                    uipc_free_object_outside((char*) member + j * pointee->size, pointee, start, end);
+                break;
+            default:
+                ;
+            }
+        }
+        else
+        {
+            switch (type->members[i].kind)
+            {
+            case UIPC_KIND_STRING:
+            case UIPC_KIND_BLOB:
+                free(member);
+                break;
+            case UIPC_KIND_POINTER:
+                uipc_free_object(member, pointee);
+                break;
+            case UIPC_KIND_ARRAY:
+                count = member_length(object, type, i);
+                for (j = 0; j < count; j++)
+                    free_members((char*) member + j * pointee->size, pointee);
+                free(member);
+                break;
+            default:
+                ;
+            }
+        }
+    }
+}
@@ -38,6 +38,15 @@
 #include <stdbool.h>
 
 #define PAYLOAD_BUFFER_SIZE (1024)
+/* Most iovecs a message is sent with */
+#define SEND_IOV (64)
+/* Initial size of the buffer packets are received into */
+#define RECV_BUFFER_SIZE (64 * 1024)
+/* Most descriptors received ahead of the messages they go with */
+#define RECV_FDS (8)
+#define PACKET_HEADERS_SIZE (sizeof(uipc_packet_header) + sizeof(uipc_packet_message))
+/* Queued packets start on this boundary so their headers can be filled in place */
+#define PACKET_ALIGN(n) (((n) + sizeof(long) - 1) & ~(sizeof(long) - 1))
 
 struct __uipc_message
 {
@@ -45,49 +54,151 @@ struct __uipc_message
     void* payload;
     uipc_typeinfo* payload_type;
     uipc_packet* packet;
+    /* Whether packet lies in the receive buffer of the handle */
+    bool borrowed;
+    /* Descriptor to pass along when sending, which stays the caller's */
+    int send_fd;
+    /* Descriptor passed along when received, closed with the message
+       unless taken */
+    int recv_fd;
 };
 
+/* Marks a payload unmarshalled where it lies in its packet.  This
+   overlays the message header just before the payload, which is not
+   needed after that, so the packet is found from the payload alone */
+typedef struct arena
+{
+    unsigned long magic;
+    /* The packet, which the payload lies at the end of the headers of */
+    uipc_packet* packet;
+} arena;
+
+#define ARENA_MAGIC 0x75697063UL
+
 struct __uipc_handle
 {
     bool readable, writeable;
 	int socket;
+    /* Packets waiting to go out ahead of the next one sent */
+    char* queue;
+    unsigned long queued;
+    unsigned long queue_size;
+    /* Offset of the last packet in the queue */
+    unsigned long queue_last;
+    /* Buffer the headers and short strings of a message being sent
+       are put in, and the pieces it is sent as, which start at
+       send_iov[1] so the queue can go in front */
+    char* send_buffer;
+    unsigned long send_size;
+    struct iovec send_iov[SEND_IOV];
+    /* Bytes received, of which those from recv_start to recv_end
+       have not been handed out yet */
+    char* recv_buffer;
+    unsigned long recv_size;
+    unsigned long recv_start, recv_end;
+    /* Descriptors received, in the order they were sent, which are
+       handed to messages as their packets are reached */
+    int recv_fds[RECV_FDS];
+    unsigned int recv_fd_count;
 };
 
+/* Marshals a message into the send buffer of a handle and returns how
+   many iovecs, from send_iov[1] on, it is to be sent as.  Strings long
+   enough to be worth it are not copied, and the buffer is kept from one
+   message to the next, so usually this is the only pass over the payload */
 static
-uipc_packet*
-packet_from_message(uipc_message* message)
+int
+vector_from_message(uipc_handle* handle, uipc_message* message)
 {
-    uipc_packet* packet = xmalloc(sizeof (uipc_packet_header) + 
-                                 sizeof (uipc_packet_message) +
-                                 PAYLOAD_BUFFER_SIZE);
+    uipc_vector vector;
+    uipc_packet* packet;
     unsigned long payload_length;
 
-    if (!packet)
-        return NULL;
+    if (!handle->send_buffer)
+    {
+        handle->send_size = PACKET_HEADERS_SIZE + PAYLOAD_BUFFER_SIZE;
+        handle->send_buffer = xmalloc(handle->send_size);
+    }
 
-    packet->header.type = PACKET_MESSAGE;
+    for (;;)
+    {
+        vector.buffer = handle->send_buffer;
+        vector.size = handle->send_size;
+        vector.used = PACKET_HEADERS_SIZE;
+        vector.iov = handle->send_iov + 1;
+        vector.iov[0].iov_base = handle->send_buffer;
+        vector.iov[0].iov_len = PACKET_HEADERS_SIZE;
+        vector.count = 1;
+        vector.max = SEND_IOV - 1;
+        vector.buffering = true;
+        vector.length = 0;
+
+        payload_length = uipc_marshal_payload_vector(&vector, message->payload, message->payload_type);
+
+        if (vector.used <= vector.size)
+            break;
+
+        free(handle->send_buffer);
+        handle->send_size = vector.used;
+        handle->send_buffer = xmalloc(handle->send_size);
+    }
+
+    packet = (uipc_packet*) handle->send_buffer;
+    packet->header.type = message->send_fd >= 0 ? PACKET_MESSAGE_FD : PACKET_MESSAGE;
+    packet->header.length = sizeof(uipc_packet_message) + payload_length;
     packet->u.message.type = message->type;
+    packet->u.message.length = payload_length;
+
+    return vector.count;
+}
+
+/* Makes room for size more bytes at the end of the queue of a handle */
+static
+void
+queue_reserve(uipc_handle* handle, unsigned long size)
+{
+    if (handle->queued + size > handle->queue_size)
+    {
+        handle->queue_size = (handle->queued + size) * 2;
+        handle->queue = xrealloc(handle->queue, handle->queue_size);
+    }
+}
+
+/* Marshals a message straight onto the end of the queue of a handle */
+static
+void
+queue_message(uipc_handle* handle, uipc_message* message)
+{
+    unsigned long offset = handle->queued;
+    unsigned long payload_length, padded_length;
+    uipc_packet* packet;
 
-    payload_length = uipc_marshal_payload(packet->u.message.payload, PAYLOAD_BUFFER_SIZE,
+    queue_reserve(handle, PACKET_HEADERS_SIZE + PAYLOAD_BUFFER_SIZE);
+
+    packet = (uipc_packet*) (handle->queue + offset);
+    payload_length = uipc_marshal_payload(packet->u.message.payload,
+                                          handle->queue_size - offset - PACKET_HEADERS_SIZE,
                                           message->payload, message->payload_type);
-    
-    if (payload_length > PAYLOAD_BUFFER_SIZE)
+    padded_length = PACKET_ALIGN(payload_length);
+
+    if (PACKET_HEADERS_SIZE + padded_length > handle->queue_size - offset)
     {
-        packet = xrealloc(packet, 
-                         sizeof(uipc_packet_header) +
-                         sizeof(uipc_packet_message) +
-                         payload_length);
-        payload_length = uipc_marshal_payload(packet->u.message.payload, payload_length,
-                                              message->payload, message->payload_type);
+        queue_reserve(handle, PACKET_HEADERS_SIZE + padded_length);
+        packet = (uipc_packet*) (handle->queue + offset);
+        uipc_marshal_payload(packet->u.message.payload, payload_length,
+                             message->payload, message->payload_type);
     }
 
-    packet->u.message.length = payload_length;
-    packet->header.length = 
-        sizeof(uipc_packet_header) +
-        sizeof(uipc_packet_message) +
-        payload_length;
+    /* The receiver ignores the padding, but it should not be garbage */
+    memset(packet->u.message.payload + payload_length, 0, padded_length - payload_length);
+
+    packet->header.type = PACKET_MESSAGE;
+    packet->header.length = sizeof(uipc_packet_message) + padded_length;
+    packet->u.message.type = message->type;
+    packet->u.message.length = padded_length;
 
-    return packet;
+    handle->queue_last = offset;
+    handle->queued = offset + PACKET_HEADERS_SIZE + padded_length;
 }
 
 static uipc_message* 
@@ -100,8 +211,11 @@ message_from_packet(uipc_packet* packet)
 
     message->type = packet->u.message.type;
     message->packet = packet;
+    message->borrowed = true;
     message->payload = NULL;
     message->payload_type = NULL;
+    message->send_fd = -1;
+    message->recv_fd = -1;
 
     return message;
 }
@@ -116,121 +230,199 @@ uipc_attach(int socket)
 	
     handle->socket = socket;
     handle->readable = handle->writeable = true;
+    handle->queue = NULL;
+    handle->queued = 0;
+    handle->queue_size = 0;
+    handle->queue_last = 0;
+    handle->send_buffer = NULL;
+    handle->send_size = 0;
+    handle->recv_buffer = NULL;
+    handle->recv_size = 0;
+    handle->recv_start = handle->recv_end = 0;
+    handle->recv_fd_count = 0;
 
     return handle;
 }
 
+/* Returns the packet at the front of the receive buffer
+   of a handle if all of it has arrived, otherwise NULL */
+static
+uipc_packet*
+recv_complete(uipc_handle* handle)
+{
+    unsigned long available = handle->recv_end - handle->recv_start;
+    uipc_packet_header header;
+
+    if (available < sizeof(header))
+        return NULL;
+
+    memcpy(&header, handle->recv_buffer + handle->recv_start, sizeof(header));
+
+    if (available < sizeof(header) + header.length)
+        return NULL;
+
+    return (uipc_packet*) (handle->recv_buffer + handle->recv_start);
+}
+
+/* Reads as much as has arrived into the receive buffer of a handle,
+   making sure first there is room for all of the packet at the front */
 static
 uipc_status
-uipc_recv_async(uipc_handle* handle, uipc_async_context* context, uipc_message** message)
+recv_fill(uipc_handle* handle)
 {
-    uipc_packet* packet = NULL;
+    unsigned long available = handle->recv_end - handle->recv_start;
+    unsigned long needed = RECV_BUFFER_SIZE;
+    uipc_packet_header header;
     uipc_status result;
+    size_t amount = 0;
 
-    if (!handle->readable)
-        return UIPC_EOF;
-
-    result = uipc_packet_recv(handle->socket, context, &packet);
-        
-    if (result == UIPC_EOF)
+    if (available >= sizeof(header))
     {
-        handle->readable = false;
-        return UIPC_EOF;
-    }
-    else if (result != UIPC_SUCCESS)
-    {
-        return result;
+        memcpy(&header, handle->recv_buffer + handle->recv_start, sizeof(header));
+
+        if (sizeof(header) + header.length > needed)
+            needed = sizeof(header) + header.length;
     }
-    else
+
+    if (handle->recv_start + needed > handle->recv_size)
     {
-        switch (packet->header.type)
-        {
-        case PACKET_MESSAGE:
+        /* Packets handed out already are finished with by now */
+        memmove(handle->recv_buffer, handle->recv_buffer + handle->recv_start, available);
+        handle->recv_start = 0;
+        handle->recv_end = available;
+
+        if (needed > handle->recv_size)
         {
-            *message = message_from_packet(packet);
-            
-            if (!*message)
-            {
-                free(packet);
-                handle->readable = false;
-                return UIPC_NOMEM;
-            }
-            return UIPC_SUCCESS;
+            handle->recv_size = needed;
+            handle->recv_buffer = xrealloc(handle->recv_buffer, handle->recv_size);
         }
-        default:
-            return UIPC_ERROR;
-        }
-    }    
+    }
+
+    result = uipc_packet_read(handle->socket, handle->recv_buffer + handle->recv_end,
+                              handle->recv_size - handle->recv_end, &amount,
+                              handle->recv_fds, &handle->recv_fd_count, RECV_FDS);
+
+    if (result == UIPC_SUCCESS)
+        handle->recv_end += amount;
+
+    return result;
 }
 
+/* Receives the next message.  Its packet stays in the receive buffer
+   of the handle, so it must be freed before the next uipc_recv */
 uipc_status
 uipc_recv(uipc_handle* handle, uipc_message** message, uipc_time* abs)
 {
     uipc_status result = UIPC_SUCCESS;
-    uipc_async_context context = {0};
+    uipc_packet* packet = NULL;
     
-    do
+    if (handle->recv_start == handle->recv_end)
+        handle->recv_start = handle->recv_end = 0;
+
+    while (!(packet = recv_complete(handle)))
     {
+        if (!handle->readable)
+            return UIPC_EOF;
+
         do
         {
             result = uipc_packet_available(handle->socket, abs);
         } while (result == UIPC_RETRY);
 
         if (result != UIPC_SUCCESS)
+            return result;
+
+        result = recv_fill(handle);
+
+        if (result == UIPC_EOF)
+        {
+            handle->readable = false;
+            /* Going away part way through a packet is an error */
+            return handle->recv_start == handle->recv_end ? UIPC_EOF : UIPC_ERROR;
+        }
+        else if (result != UIPC_SUCCESS && result != UIPC_RETRY)
         {
-            if (context.packet)
-                free(context.packet);
             return result;
         }
+    }
 
-        result = uipc_recv_async(handle, &context, message);
-    } while (result == UIPC_RETRY);
+    handle->recv_start += sizeof(uipc_packet_header) + packet->header.length;
+
+    switch (packet->header.type)
+    {
+    case PACKET_MESSAGE:
+        *message = message_from_packet(packet);
+        return *message ? UIPC_SUCCESS : UIPC_NOMEM;
+    case PACKET_MESSAGE_FD:
+        *message = message_from_packet(packet);
+
+        if (!*message)
+            return UIPC_NOMEM;
+
+        /* The descriptor came with the first byte of the send
+           the packet was part of, so it has been received */
+        if (handle->recv_fd_count)
+        {
+            (*message)->recv_fd = handle->recv_fds[0];
+            memmove(handle->recv_fds, handle->recv_fds + 1,
+                    --handle->recv_fd_count * sizeof(int));
+        }
 
-    if (context.packet)
-        free(context.packet);
+        return UIPC_SUCCESS;
+    default:
+        return UIPC_ERROR;
+    }
+}
 
-    return result;
+/* Returns whether a whole message has been received already and
+   uipc_recv will return it without reading from the socket */
+bool
+uipc_pending(uipc_handle* handle)
+{
+    return recv_complete(handle) != NULL;
 }
 
+/* Sends anything queued followed by count iovecs, which must
+   be somewhere in send_iov after the first of them, passing
+   along fd unless it is -1 */
 static
 uipc_status
-uipc_send_async(uipc_handle* handle, uipc_async_context* context, uipc_message* message)
+uipc_send_async(uipc_handle* handle, uipc_async_context* context, struct iovec* iov, int count, int fd)
 {
     uipc_status result = UIPC_SUCCESS;
-    uipc_packet* packet = NULL;
 
     if (!handle->writeable)
     {
-        result = UIPC_EOF;
-        goto cleanup;
+        return UIPC_EOF;
     }
 
-    packet = packet_from_message(message);
+    if (handle->queued)
+    {
+        iov--;
+        iov[0].iov_base = handle->queue;
+        iov[0].iov_len = handle->queued;
+        count++;
+    }
 
-    result = uipc_packet_send(handle->socket, context, packet);
+    result = uipc_packet_sendv_fd(handle->socket, context, iov, count, fd);
         
     if (result == UIPC_EOF)
     {
         handle->writeable = false;
-        goto cleanup;
-    }
-    else if (result != UIPC_SUCCESS)
-    {
-        goto cleanup;
     }
 
-cleanup:
-    if (packet)
-        free(packet);
-
     return result;
 }
 
+static
 uipc_status
-uipc_send(uipc_handle* handle, uipc_message* message, uipc_time* abs)
+uipc_send_vector(uipc_handle* handle, int count, int fd, uipc_time* abs)
 {
     uipc_status result = UIPC_SUCCESS;
     uipc_async_context context = {0};
+
+    if (!handle->queued && !count)
+        return UIPC_SUCCESS;
     
     do
     {
@@ -240,14 +432,83 @@ uipc_send(uipc_handle* handle, uipc_message* message, uipc_time* abs)
         } while (result == UIPC_RETRY);
 
         if (result != UIPC_SUCCESS)
-            return result;
+            break;
 
-        result = uipc_send_async(handle, &context, message);
+        result = uipc_send_async(handle, &context, handle->send_iov + 1, count, fd);
     } while (result == UIPC_RETRY);
 
+    /* Whatever was queued is gone one way or the other, unless
+       we gave up waiting before any of it could be sent */
+    if (result != UIPC_TIMEOUT || context.transferred)
+        handle->queued = 0;
+
     return result;
 }
 
+uipc_status
+uipc_send(uipc_handle* handle, uipc_message* message, uipc_time* abs)
+{
+    return uipc_send_vector(handle, vector_from_message(handle, message), message->send_fd, abs);
+}
+
+/* Queues a message to go out with the next one sent or flushed.
+   Messages passing along a descriptor must be sent instead */
+uipc_status
+uipc_queue(uipc_handle* handle, uipc_message* message)
+{
+    if (!handle->writeable)
+        return UIPC_EOF;
+
+    if (message->send_fd >= 0)
+        return UIPC_ERROR;
+
+    queue_message(handle, message);
+
+    return UIPC_SUCCESS;
+}
+
+/* Like uipc_queue, but if the last message queued is of the same
+   type, replaces it, for messages where only the latest matters */
+uipc_status
+uipc_queue_latest(uipc_handle* handle, uipc_message* message)
+{
+    uipc_packet* last = (uipc_packet*) (handle->queue + handle->queue_last);
+
+    if (handle->queued && last->u.message.type == message->type)
+    {
+        handle->queued = handle->queue_last;
+    }
+
+    return uipc_queue(handle, message);
+}
+
+/* Returns the number of bytes waiting in the queue */
+unsigned long
+uipc_queued(uipc_handle* handle)
+{
+    return handle->queued;
+}
+
+/* Sends everything queued */
+uipc_status
+uipc_flush(uipc_handle* handle, uipc_time* abs)
+{
+    return uipc_send_vector(handle, 0, -1, abs);
+}
+
+/* Closes descriptors received for messages which never came */
+static
+void
+handle_close_fds(uipc_handle* handle)
+{
+    unsigned int i;
+
+    for (i = 0; i < handle->recv_fd_count; i++)
+    {
+        close(handle->recv_fds[i]);
+    }
+}
+
 uipc_status
 uipc_detach(uipc_handle* handle)
 {
@@ -256,6 +517,10 @@ uipc_detach(uipc_handle* handle)
     if (!handle)
         return UIPC_ERROR;
     
+    free(handle->queue);
+    free(handle->send_buffer);
+    free(handle->recv_buffer);
+    handle_close_fds(handle);
     free(handle);
     
     return result;
@@ -270,6 +535,10 @@ uipc_close(uipc_handle* handle)
         return UIPC_ERROR;
     
     close(handle->socket);
+    free(handle->queue);
+    free(handle->send_buffer);
+    free(handle->recv_buffer);
+    handle_close_fds(handle);
     free(handle);
     
     return result;
@@ -286,6 +555,9 @@ uipc_msg_new(uipc_message_type type)
     message->type = type;
     message->payload = NULL;
     message->packet = NULL;
+    message->borrowed = false;
+    message->send_fd = -1;
+    message->recv_fd = -1;
 
 	return message;
 }
@@ -293,11 +565,33 @@ uipc_msg_new(uipc_message_type type)
 void
 uipc_msg_free(uipc_message* message)
 {
-    if (message->packet)
+    if (message->packet && !message->borrowed)
         free((void*) message->packet);
+    if (message->recv_fd >= 0)
+        close(message->recv_fd);
     free(message);
 }
 
+/* Passes a descriptor along with a message when it is sent.  It
+   is duplicated in the receiving process and stays open here */
+void
+uipc_msg_set_fd(uipc_message* message, int fd)
+{
+    message->send_fd = fd;
+}
+
+/* Takes the descriptor passed along with a received message, which
+   is then the caller's to close, or returns -1 if there was none */
+int
+uipc_msg_take_fd(uipc_message* message)
+{
+    int fd = message->recv_fd;
+
+    message->recv_fd = -1;
+
+    return fd;
+}
+
 uipc_message_type
 uipc_msg_get_type(uipc_message* message)
 {
@@ -319,10 +613,106 @@ uipc_msg_get_payload(uipc_message* message, uipc_typeinfo* info)
     }
 }
 
+/* Unmarshals the payload into the packet it arrived in rather than
+   copying it out, so the payload and everything it points to is a
+   single block.  The packet, or a copy if it is still in the receive
+   buffer, passes to the payload, which must be freed with
+   uipc_msg_free_payload as usual */
+void*
+uipc_msg_take_payload(uipc_message* message, uipc_typeinfo* info)
+{
+    uipc_packet* packet = message->packet;
+    arena* block;
+    void* object;
+
+    if (!packet)
+        return NULL;
+
+    if (message->borrowed)
+    {
+        unsigned long size = sizeof(uipc_packet_header) + packet->header.length;
+
+        packet = xmalloc(size);
+        memcpy(packet, message->packet, size);
+    }
+
+    uipc_unmarshal_payload_inplace(&object, packet->u.message.payload, info);
+
+    block = (arena*) packet->u.message.payload - 1;
+    block->magic = ARENA_MAGIC;
+    block->packet = packet;
+
+    message->packet = NULL;
+
+    return object;
+}
+
+/* Unmarshals the payload where it lies in the packet, for use only
+   while the message is.  It must not be freed */
+void*
+uipc_msg_view_payload(uipc_message* message, uipc_typeinfo* info)
+{
+    void* object;
+
+    if (!message->packet)
+        return NULL;
+
+    uipc_unmarshal_payload_inplace(&object, message->packet->u.message.payload, info);
+
+    return object;
+}
+
+/* Returns the packet a payload was taken from by uipc_msg_take_payload,
+   or NULL if it was not.  Any other payload is a block from malloc, and
+   the words before one are the allocator's, which never point back at
+   the headers of a packet ending just before the block */
+static
+uipc_packet*
+packet_for_payload(const void* payload)
+{
+    const arena* block = (const arena*) payload - 1;
+
+    if (block->magic == ARENA_MAGIC &&
+        (const char*) block->packet + PACKET_HEADERS_SIZE == (const char*) payload)
+        return block->packet;
+
+    return NULL;
+}
+
+/* Returns the end of a packet */
+static
+char*
+packet_end(uipc_packet* packet)
+{
+    return (char*) packet + sizeof(uipc_packet_header) + packet->header.length;
+}
+
 void
 uipc_msg_free_payload(void* payload, uipc_typeinfo* info)
 {
-    uipc_free_object(payload, info);
+    uipc_packet* packet = payload ? packet_for_payload(payload) : NULL;
+
+    if (packet)
+    {
+        /* Anything pointed elsewhere since was allocated separately */
+        uipc_free_object_outside(payload, info, packet, packet_end(packet));
+        free(packet);
+    }
+    else
+    {
+        uipc_free_object(payload, info);
+    }
+}
+
+/* Frees a string or object a payload pointed to before it is replaced,
+   unless it is part of the packet the payload was taken from */
+void
+uipc_msg_free_member(void* payload, void* member)
+{
+    uipc_packet* packet = packet_for_payload(payload);
+
+    if (!packet || (char*) member < (char*) packet || (char*) member >= packet_end(packet))
+        free(member);
 }
 
 void
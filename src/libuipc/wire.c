@@ -36,12 +36,6 @@
 #include <stdlib.h>
 #include <poll.h>
 #include <unistd.h>
-#ifdef HAVE_SYS_SELECT_H
-#    include <sys/select.h>
-#endif
-#ifdef HAVE_SELECT_H
-#    include <select.h>
-#endif
 #include <sys/time.h>
 #include <time.h>
 #include <sys/types.h>
@@ -54,15 +48,69 @@
 uipc_status
 uipc_packet_send(int socket, uipc_async_context* context, uipc_packet* packet)
 {
-    char* buffer = (char*) packet;
-    ssize_t total = sizeof(uipc_packet_header) + packet->header.length;
-    ssize_t remaining = total - context->transferred;
+    struct iovec iov;
 
-    while (remaining)
+    iov.iov_base = packet;
+    iov.iov_len = sizeof(uipc_packet_header) + packet->header.length;
+
+    return uipc_packet_sendv(socket, context, &iov, 1);
+}
+
+uipc_status
+uipc_packet_sendv(int socket, uipc_async_context* context, struct iovec* iov, int count)
+{
+    return uipc_packet_sendv_fd(socket, context, iov, count, -1);
+}
+
+/* Sends the buffers one after another with as few system calls as
+   possible, picking up after what context says was sent already.
+   Unless fd is -1 it is passed along with the first byte sent */
+uipc_status
+uipc_packet_sendv_fd(int socket, uipc_async_context* context, struct iovec* iov, int count, int fd)
+{
+    struct iovec remaining[count];
+    struct msghdr hdr;
+    struct cmsghdr* cmsg;
+    union
+    {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    size_t skip = context->transferred;
+    int i, first;
+
+    for (i = 0; i < count && skip >= iov[i].iov_len; i++)
+    {
+        skip -= iov[i].iov_len;
+    }
+
+    for (first = i; i < count; i++)
+    {
+        remaining[i - first].iov_base = (char*) iov[i].iov_base + skip;
+        remaining[i - first].iov_len = iov[i].iov_len - skip;
+        skip = 0;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = remaining;
+    hdr.msg_iovlen = count - first;
+
+    if (fd >= 0 && context->transferred == 0)
+    {
+        hdr.msg_control = control.buffer;
+        hdr.msg_controllen = CMSG_SPACE(sizeof(int));
+        cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    while (hdr.msg_iovlen)
     {
 	ssize_t sent;
 #ifdef MSG_NOSIGNAL
-	sent = send(socket, buffer + (total - remaining), remaining, MSG_NOSIGNAL);
+	sent = sendmsg(socket, &hdr, MSG_NOSIGNAL);
 #else
     /* Block SIGPIPE for the send */
     struct sigaction blocked, original;
@@ -71,7 +119,7 @@ uipc_packet_send(int socket, uipc_async_context* context, uipc_packet* packet)
     sigemptyset(&blocked.sa_mask);
 
     sigaction(SIGPIPE, &blocked, &original);
-    sent = send(socket, buffer + (total - remaining), remaining, 0);
+    sent = sendmsg(socket, &hdr, 0);
     sigaction(SIGPIPE, &original, &blocked);
 #endif
         
@@ -97,8 +145,25 @@ uipc_packet_send(int socket, uipc_async_context* context, uipc_packet* packet)
         }
         else
         {
-            remaining -= sent;
             context->transferred += sent;
+
+            /* The descriptor went with the first of it */
+            hdr.msg_control = NULL;
+            hdr.msg_controllen = 0;
+
+            /* Move past whatever went out in full */
+            while (hdr.msg_iovlen && (size_t) sent >= hdr.msg_iov->iov_len)
+            {
+                sent -= hdr.msg_iov->iov_len;
+                hdr.msg_iov++;
+                hdr.msg_iovlen--;
+            }
+
+            if (hdr.msg_iovlen)
+            {
+                hdr.msg_iov->iov_base = (char*) hdr.msg_iov->iov_base + sent;
+                hdr.msg_iov->iov_len -= sent;
+            }
         }
     }
 
@@ -186,77 +251,106 @@ uipc_packet_recv(int socket, uipc_async_context* context, uipc_packet** packet)
     return UIPC_SUCCESS;
 }
 
+/* Reads whatever has arrived, up to size bytes, however many packets
+   or pieces of packets that is.  Descriptors passed along with it are
+   added to the fd_count already in fds, and closed if there are fd_max */
 uipc_status
-uipc_packet_available(int socket, uipc_time* abs)
+uipc_packet_read(int socket, void* buffer, size_t size, size_t* amount,
+                 int* fds, unsigned int* fd_count, unsigned int fd_max)
 {
-	fd_set readset;
-    struct timeval timeout;
-    int ret = -1;
-
-    if (abs)
+    struct msghdr hdr;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    union
     {
-        uipc_time now;
-        uipc_time diff;
-
-        uipc_time_current(&now);
-        uipc_time_difference(&now, abs, &diff);
-
-        if (diff.seconds <= 0 && diff.microseconds <= 0)
-            return UIPC_TIMEOUT;
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int) * 4)];
+    } control;
+    unsigned int i, passed;
+    ssize_t amount_read;
+    int flags = 0;
+
+#ifdef MSG_CMSG_CLOEXEC
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
 
-        timeout.tv_sec = (time_t) diff.seconds;
-        timeout.tv_usec = (USEC_T) diff.microseconds;
-    }	
+    memset(&hdr, 0, sizeof(hdr));
+    iov.iov_base = buffer;
+    iov.iov_len = size;
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control.buffer;
+    hdr.msg_controllen = sizeof(control.buffer);
 
-	FD_ZERO(&readset);
-	FD_SET(socket, &readset);
-	
-	ret = select(socket+1, &readset, NULL, NULL, abs ? &timeout : NULL);
+    amount_read = recvmsg(socket, &hdr, flags);
 
-    if (ret < 0)
+    if (amount_read < 0)
     {
         if (errno == EAGAIN || errno == EINTR)
-        {
             return UIPC_RETRY;
-        }
         else
-        {
             return UIPC_ERROR;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            passed = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+            for (i = 0; i < passed; i++)
+            {
+                int fd;
+
+                memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+
+                if (*fd_count < fd_max)
+                    fds[(*fd_count)++] = fd;
+                else
+                    close(fd);
+            }
         }
-    } else if (FD_ISSET(socket, &readset))
-		return UIPC_SUCCESS;
-    else if (abs && uipc_time_is_past(abs))
-        return UIPC_TIMEOUT;
+    }
 
-	return UIPC_RETRY;
+    if (amount_read == 0)
+    {
+        return UIPC_EOF;
+    }
+
+    *amount = amount_read;
+
+    return UIPC_SUCCESS;
 }
 
-uipc_status
-uipc_packet_sendable(int socket, uipc_time* abs)
+/* Waits until the socket is ready for the given poll events.
+   poll() is used rather than select() so descriptors past
+   FD_SETSIZE work when many children are supervised at once */
+static uipc_status
+packet_wait(int socket, short events, uipc_time* abs)
 {
-	fd_set writeset;
-	struct timeval timeout;
+    struct pollfd fd;
+    int timeout = -1;
     int ret = -1;
 
     if (abs)
     {
         uipc_time now;
         uipc_time diff;
-        
+
         uipc_time_current(&now);
         uipc_time_difference(&now, abs, &diff);
-        
+
         if (diff.seconds <= 0 && diff.microseconds <= 0)
             return UIPC_TIMEOUT;
-        
-        timeout.tv_sec = (time_t) diff.seconds;
-        timeout.tv_usec = (USEC_T) diff.microseconds;
-    }	
 
-	FD_ZERO(&writeset);
-	FD_SET(socket, &writeset);
-	
-	ret = select(socket+1, NULL, &writeset, NULL, abs ? &timeout : NULL);
+        timeout = (int) (diff.seconds * 1000 + (diff.microseconds + 999) / 1000);
+    }
+
+    fd.fd = socket;
+    fd.events = events;
+    fd.revents = 0;
+
+    ret = poll(&fd, 1, timeout);
 
     if (ret < 0)
     {
@@ -269,10 +363,24 @@ uipc_packet_sendable(int socket, uipc_time* abs)
             return UIPC_ERROR;
         }
     }
-	else if (FD_ISSET(socket, &writeset))
-		return UIPC_SUCCESS;
-	else if (abs && uipc_time_is_past(abs))
+    /* Hangups and errors are reported as ready so the
+       following read or write can find out what happened */
+    else if (fd.revents)
+        return UIPC_SUCCESS;
+    else if (abs && uipc_time_is_past(abs))
         return UIPC_TIMEOUT;
 
-	return UIPC_RETRY;
+    return UIPC_RETRY;
+}
+
+uipc_status
+uipc_packet_available(int socket, uipc_time* abs)
+{
+    return packet_wait(socket, POLLIN, abs);
+}
+
+uipc_status
+uipc_packet_sendable(int socket, uipc_time* abs)
+{
+    return packet_wait(socket, POLLOUT, abs);
 }
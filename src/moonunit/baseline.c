@@ -0,0 +1,501 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "baseline.h"
+
+#include <moonunit/library.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <math.h>
+
+/* Largest product of the sample sizes for which the
+   distribution of U is worked out exactly */
+#define EXACT_LIMIT 1000
+
+typedef struct
+{
+    double value;
+    bool current;
+} RankedSample;
+
+static void
+entry_free(void* key, void* value, void* unused)
+{
+    free(key);
+    free(value);
+}
+
+static char*
+test_key(MuTest* test)
+{
+    return format("%s/%s/%s",
+                  mu_library_name(test->library),
+                  mu_test_suite(test),
+                  mu_test_name(test));
+}
+
+static BaselineEntry*
+get_entry(Baseline* baseline, const char* key)
+{
+    BaselineEntry* entry = hashtable_get(baseline->entries, key);
+
+    if (!entry)
+    {
+        char* copy = strdup(key);
+
+        entry = xcalloc(1, sizeof(BaselineEntry));
+        hashtable_set(baseline->entries, copy, entry);
+        baseline->keys = array_append(baseline->keys, copy);
+    }
+
+    return entry;
+}
+
+/* Each test is a section holding what kind of timings it has and the timings */
+static void
+read_entry(const char* section, const char* key, const char* value, void* data)
+{
+    Baseline* baseline = (Baseline*) data;
+    BaselineEntry* entry = NULL;
+    const char* s;
+    char* end;
+
+    if (!strcmp(section, "global"))
+        return;
+
+    entry = get_entry(baseline, section);
+
+    if (!strcmp(key, "kind"))
+    {
+        entry->benchmark = !strcmp(value, "benchmark");
+    }
+    else if (!strcmp(key, "timings"))
+    {
+        entry->count = 0;
+
+        for (s = value; entry->count < BASELINE_SAMPLES; s = end)
+        {
+            double nsec = strtod(s, &end);
+
+            if (end == s)
+                break;
+
+            entry->samples[entry->count++] = nsec;
+        }
+    }
+}
+
+Baseline*
+baseline_open(const char* path, double threshold)
+{
+    Baseline* baseline = xmalloc(sizeof(Baseline));
+    FILE* file;
+
+    baseline->path = strdup(path);
+    baseline->threshold = threshold;
+    baseline->entries = hashtable_new(511, string_hashfunc, string_hashequal, entry_free, NULL);
+    baseline->keys = NULL;
+
+    /* A missing file just means no baseline yet */
+    if ((file = fopen(path, "r")))
+    {
+        ini_read(file, read_entry, baseline);
+        fclose(file);
+    }
+
+    return baseline;
+}
+
+static int
+double_compare(const void* _a, const void* _b)
+{
+    double a = *(double*) _a;
+    double b = *(double*) _b;
+
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static int
+ranked_compare(const void* _a, const void* _b)
+{
+    return double_compare(&((RankedSample*) _a)->value, &((RankedSample*) _b)->value);
+}
+
+static double
+median(const double* samples, unsigned int count)
+{
+    double* sorted = xmalloc(count * sizeof(*sorted));
+    double result;
+
+    memcpy(sorted, samples, count * sizeof(*sorted));
+    qsort(sorted, count, sizeof(*sorted), double_compare);
+
+    if (count % 2)
+        result = sorted[count / 2];
+    else
+        result = (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+
+    free(sorted);
+
+    return result;
+}
+
+/* Returns the Mann-Whitney U statistic of the current timings against
+   the baseline's, the number of pairs in which the current timing is the
+   larger with ties counting half, and sets ties to the sum of t^3 - t
+   over each group of t tied timings */
+static double
+mann_whitney_u(const double* current, unsigned int n1,
+               const double* base, unsigned int n2, double* ties)
+{
+    unsigned int total = n1 + n2;
+    RankedSample* all = xmalloc(total * sizeof(*all));
+    double rank_sum = 0;
+    double rank, t;
+    unsigned int i, j, k;
+
+    for (i = 0; i < n1; i++)
+    {
+        all[i].value = current[i];
+        all[i].current = true;
+    }
+
+    for (i = 0; i < n2; i++)
+    {
+        all[n1 + i].value = base[i];
+        all[n1 + i].current = false;
+    }
+
+    qsort(all, total, sizeof(*all), ranked_compare);
+
+    *ties = 0;
+
+    for (i = 0; i < total; i = j)
+    {
+        for (j = i + 1; j < total && all[j].value == all[i].value; j++);
+
+        /* Tied timings share the average of ranks i + 1 to j */
+        rank = (i + 1 + j) / 2.0;
+
+        for (k = i; k < j; k++)
+        {
+            if (all[k].current)
+                rank_sum += rank;
+        }
+
+        t = j - i;
+        *ties += t * t * t - t;
+    }
+
+    free(all);
+
+    return rank_sum - n1 * (n1 + 1) / 2.0;
+}
+
+/* Returns the distribution of U for samples of m and n with no ties,
+   where element u is the probability that U = u, built up by whether
+   the largest timing comes from the first sample (and so beats all of
+   the second) or the second */
+static double*
+u_distribution(unsigned int m, unsigned int n)
+{
+    unsigned int width = m * n + 1;
+    double* previous = xcalloc((n + 1) * width, sizeof(double));
+    double* current = xcalloc((n + 1) * width, sizeof(double));
+    double* swap;
+    double p;
+    unsigned int i, j, u;
+
+    /* With an empty first sample, U is always 0 */
+    for (j = 0; j <= n; j++)
+        previous[j * width] = 1;
+
+    for (i = 1; i <= m; i++)
+    {
+        memset(current, 0, (n + 1) * width * sizeof(double));
+        current[0] = 1;
+
+        for (j = 1; j <= n; j++)
+        {
+            for (u = 0; u <= i * j; u++)
+            {
+                p = (double) j / (i + j) * current[(j - 1) * width + u];
+
+                if (u >= j)
+                    p += (double) i / (i + j) * previous[j * width + u - j];
+
+                current[j * width + u] = p;
+            }
+        }
+
+        swap = previous;
+        previous = current;
+        current = swap;
+    }
+
+    memmove(previous, previous + n * width, width * sizeof(double));
+    free(current);
+
+    return previous;
+}
+
+/* Returns the two-sided p-value of U for samples of n1 and n2, exactly
+   for small samples and from the normal approximation otherwise */
+static double
+mann_whitney_p(double u, unsigned int n1, unsigned int n2, double ties)
+{
+    double below = 0, above = 0, p;
+    double n, mean, variance, z;
+    double* distribution;
+    unsigned int k;
+
+    if (n1 * n2 <= EXACT_LIMIT)
+    {
+        distribution = u_distribution(n1, n2);
+
+        for (k = 0; k <= n1 * n2; k++)
+        {
+            if (k <= u)
+                below += distribution[k];
+            if (k >= u)
+                above += distribution[k];
+        }
+
+        free(distribution);
+
+        p = 2 * (below < above ? below : above);
+
+        return p < 1 ? p : 1;
+    }
+
+    n = n1 + n2;
+    mean = (double) n1 * n2 / 2;
+    variance = (double) n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+
+    if (variance <= 0)
+        return 1;
+
+    /* With continuity correction */
+    z = (fabs(u - mean) - 0.5) / sqrt(variance);
+
+    return z > 0 ? erfc(z / sqrt(2.0)) : 1;
+}
+
+/* Judges a single duration, for which the U test can only reach 0.05
+   with some forty durations in the baseline.  Instead it must fall
+   outside the range of the baseline by more than the threshold, once
+   the baseline has enough durations to give some idea of the range */
+static MuTestVerdict
+single_verdict(Baseline* baseline, BaselineEntry* entry, double duration)
+{
+    double low = entry->samples[0], high = entry->samples[0];
+    unsigned int i;
+
+    if (entry->count < BASELINE_MIN_RUNS)
+        return MU_VERDICT_UNCHANGED;
+
+    for (i = 1; i < entry->count; i++)
+    {
+        if (entry->samples[i] < low)
+            low = entry->samples[i];
+        if (entry->samples[i] > high)
+            high = entry->samples[i];
+    }
+
+    if (duration > high * (1 + baseline->threshold / 100))
+        return MU_VERDICT_REGRESSED;
+    else if (duration < low * (1 - baseline->threshold / 100))
+        return MU_VERDICT_IMPROVED;
+    else
+        return MU_VERDICT_UNCHANGED;
+}
+
+MuTestComparison*
+baseline_compare(Baseline* baseline, MuTest* test, MuTestResult* result, unsigned long usec)
+{
+    MuTestComparison* comparison = NULL;
+    BaselineEntry* entry = NULL;
+    bool benchmark = result->benchmark != NULL;
+    double duration = usec * 1000.0;
+    const double* samples = &duration;
+    unsigned int count = 1;
+    double u, ties;
+    char* key;
+
+    /* Only the timings of passing tests mean anything */
+    if (result->status != MU_STATUS_SUCCESS || result->expected != MU_STATUS_SUCCESS)
+        return NULL;
+
+    if (benchmark)
+    {
+        samples = result->benchmark->sample;
+        count = result->benchmark->samples;
+
+        if (!count)
+            return NULL;
+    }
+
+    key = test_key(test);
+    entry = get_entry(baseline, key);
+    free(key);
+
+    if (entry->count && entry->benchmark == benchmark)
+    {
+        comparison = xcalloc(1, sizeof(*comparison));
+        comparison->benchmark = benchmark;
+        comparison->baseline_median = median(entry->samples, entry->count);
+        comparison->median = median(samples, count);
+        comparison->baseline_samples = entry->count;
+        comparison->samples = count;
+
+        if (comparison->baseline_median > 0)
+        {
+            comparison->change = (comparison->median - comparison->baseline_median) * 100 /
+                comparison->baseline_median;
+        }
+
+        if (count == 1)
+        {
+            comparison->p_value = -1;
+            comparison->verdict = single_verdict(baseline, entry, duration);
+        }
+        else
+        {
+            u = mann_whitney_u(samples, count, entry->samples, entry->count, &ties);
+            comparison->p_value = mann_whitney_p(u, count, entry->count, ties);
+
+            if (comparison->p_value >= BASELINE_ALPHA)
+                comparison->verdict = MU_VERDICT_UNCHANGED;
+            else if (comparison->change >= baseline->threshold)
+                comparison->verdict = MU_VERDICT_REGRESSED;
+            else if (comparison->change <= -baseline->threshold)
+                comparison->verdict = MU_VERDICT_IMPROVED;
+            else
+                comparison->verdict = MU_VERDICT_UNCHANGED;
+        }
+    }
+
+    if (!entry->count || entry->benchmark != benchmark)
+    {
+        /* Take the first timings of a test as its baseline */
+        entry->benchmark = benchmark;
+        entry->count = count < BASELINE_SAMPLES ? count : BASELINE_SAMPLES;
+        memcpy(entry->samples, samples, entry->count * sizeof(*samples));
+    }
+    else if (!benchmark && entry->count < BASELINE_SAMPLES &&
+             comparison->verdict == MU_VERDICT_UNCHANGED)
+    {
+        /* A test's duration is only one timing per run, so build up
+           the baseline over runs which showed no change */
+        entry->samples[entry->count++] = duration;
+    }
+
+    return comparison;
+}
+
+static int
+key_compare(const void* _a, const void* _b)
+{
+    return strcmp(*(char**) _a, *(char**) _b);
+}
+
+/* Writes the baseline out, replacing the old file in one step */
+int
+baseline_save(Baseline* baseline)
+{
+    char* temp = format("%s.tmp", baseline->path);
+    array* keys = baseline->keys;
+    FILE* file = NULL;
+    unsigned int i, j;
+    int result = -1;
+
+    /* Keep the file stable from one run to the next */
+    if (keys)
+        qsort(keys, array_size(keys), sizeof(*keys), key_compare);
+
+    if (!(file = fopen(temp, "w")))
+        goto done;
+
+    fprintf(file, "# MoonUnit timing baseline, in nanoseconds\n");
+
+    for (i = 0; i < array_size(keys); i++)
+    {
+        BaselineEntry* entry = hashtable_get(baseline->entries, keys[i]);
+
+        if (!entry->count)
+            continue;
+
+        fprintf(file, "\n[%s]\n", (char*) keys[i]);
+        fprintf(file, "kind=%s\n", entry->benchmark ? "benchmark" : "test");
+        fprintf(file, "timings=");
+
+        for (j = 0; j < entry->count; j++)
+        {
+            fprintf(file, j ? " %.6g" : "%.6g", entry->samples[j]);
+        }
+
+        fprintf(file, "\n");
+    }
+
+    if (fclose(file))
+        goto done;
+
+    if (rename(temp, baseline->path))
+        goto done;
+
+    result = 0;
+
+done:
+
+    if (result)
+    {
+        int saved = errno;
+        unlink(temp);
+        errno = saved;
+    }
+
+    free(temp);
+
+    return result;
+}
+
+void
+baseline_free(Baseline* baseline)
+{
+    hashtable_free(baseline->entries);
+    array_free(baseline->keys);
+    free(baseline->path);
+    free(baseline);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MOONUNIT_BASELINE_H__
+#define __MOONUNIT_BASELINE_H__
+
+#include <stdbool.h>
+#include <moonunit/test.h>
+#include <moonunit/private/util.h>
+
+/* Number of timings kept for each test */
+#define BASELINE_SAMPLES MU_BENCHMARK_MAX_SAMPLES
+
+/* Significance level below which a change counts */
+#define BASELINE_ALPHA 0.05
+
+/* Fewest durations a test's baseline needs before a single run is judged */
+#define BASELINE_MIN_RUNS 5
+
+typedef struct
+{
+    /* Whether the timings are per benchmark call rather than per test */
+    bool benchmark;
+    /* Timings in nanoseconds, in the order recorded */
+    double samples[BASELINE_SAMPLES];
+    unsigned int count;
+} BaselineEntry;
+
+typedef struct
+{
+    char* path;
+    /* Change of the median, in percent, past which a
+       significant difference makes a test regressed or improved */
+    double threshold;
+    hashtable* entries;
+    /* Keys of all entries, for writing them out */
+    array* keys;
+} Baseline;
+
+Baseline* baseline_open(const char* path, double threshold);
+MuTestComparison* baseline_compare(Baseline* baseline, MuTest* test, MuTestResult* result, unsigned long usec);
+int baseline_save(Baseline* baseline);
+void baseline_free(Baseline* baseline);
+
+#endif
@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "history.h"
+
+#include <moonunit/library.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static const MuTestStatus statuses[] =
+{
+    MU_STATUS_SUCCESS,
+    MU_STATUS_FAILURE,
+    MU_STATUS_ASSERTION,
+    MU_STATUS_CRASH,
+    MU_STATUS_TIMEOUT,
+    MU_STATUS_EXCEPTION,
+    MU_STATUS_RESOURCE,
+    MU_STATUS_SKIPPED
+};
+
+static void
+entry_free(void* key, void* value, void* unused)
+{
+    free(key);
+    free(value);
+}
+
+static char*
+test_key(MuTest* test)
+{
+    return format("%s/%s/%s",
+                  mu_library_name(test->library),
+                  mu_test_suite(test),
+                  mu_test_name(test));
+}
+
+static HistoryEntry*
+get_entry(History* history, const char* key)
+{
+    HistoryEntry* entry = hashtable_get(history->entries, key);
+
+    if (!entry)
+    {
+        char* copy = strdup(key);
+
+        entry = xcalloc(1, sizeof(HistoryEntry));
+        hashtable_set(history->entries, copy, entry);
+        history->keys = array_append(history->keys, copy);
+    }
+
+    return entry;
+}
+
+/* Each test is a section holding its last status and recent durations */
+static void
+read_entry(const char* section, const char* key, const char* value, void* data)
+{
+    History* history = (History*) data;
+    HistoryEntry* entry = NULL;
+    unsigned int i;
+    const char* s;
+    char* end;
+
+    /* Nothing before the first section is used */
+    if (!strcmp(section, "global"))
+        return;
+
+    entry = get_entry(history, section);
+
+    if (!strcmp(key, "status"))
+    {
+        for (i = 0; i < sizeof(statuses) / sizeof(*statuses); i++)
+        {
+            if (!strcmp(value, mu_test_status_to_string(statuses[i])))
+                entry->status = statuses[i];
+        }
+    }
+    else if (!strcmp(key, "failed"))
+    {
+        entry->failed = !strcmp(value, "yes");
+    }
+    else if (!strcmp(key, "durations"))
+    {
+        entry->count = 0;
+
+        for (s = value; entry->count < HISTORY_SAMPLES; s = end)
+        {
+            unsigned long usec = strtoul(s, &end, 10);
+
+            if (end == s)
+                break;
+
+            entry->calibrations[entry->count] = 0;
+            entry->samples[entry->count++] = usec;
+        }
+    }
+    else if (!strcmp(key, "calibrations"))
+    {
+        /* Follows the durations they go with */
+        for (s = value, i = 0; i < entry->count; s = end, i++)
+        {
+            unsigned long usec = strtoul(s, &end, 10);
+
+            if (end == s)
+                break;
+
+            entry->calibrations[i] = usec;
+        }
+    }
+}
+
+History*
+history_open(const char* path)
+{
+    History* history = xmalloc(sizeof(History));
+    FILE* file;
+
+    history->path = strdup(path);
+    history->calibration = 0;
+    history->entries = hashtable_new(511, string_hashfunc, string_hashequal, entry_free, NULL);
+    history->keys = NULL;
+
+    /* A missing file just means no history yet */
+    if ((file = fopen(path, "r")))
+    {
+        ini_read(file, read_entry, history);
+        fclose(file);
+    }
+
+    return history;
+}
+
+HistoryEntry*
+history_lookup(History* history, MuTest* test)
+{
+    char* key = test_key(test);
+    HistoryEntry* entry = hashtable_get(history->entries, key);
+
+    free(key);
+
+    return entry;
+}
+
+void
+history_record(History* history, MuTest* test, MuTestResult* result, unsigned long usec)
+{
+    char* key = test_key(test);
+    HistoryEntry* entry = get_entry(history, key);
+
+    free(key);
+
+    entry->status = result->status;
+
+    /* Skipped (or cancelled) tests say nothing about whether
+       the test works or how long it takes */
+    if (result->status == MU_STATUS_SKIPPED)
+        return;
+
+    entry->failed = result->status != result->expected;
+
+    if (entry->count == HISTORY_SAMPLES)
+    {
+        memmove(entry->samples, entry->samples + 1, sizeof(*entry->samples) * (HISTORY_SAMPLES - 1));
+        memmove(entry->calibrations, entry->calibrations + 1, sizeof(*entry->calibrations) * (HISTORY_SAMPLES - 1));
+        entry->count--;
+    }
+
+    entry->calibrations[entry->count] = history->calibration;
+    entry->samples[entry->count++] = usec;
+}
+
+static int
+sample_compare(const void* _a, const void* _b)
+{
+    unsigned long a = *(unsigned long*) _a;
+    unsigned long b = *(unsigned long*) _b;
+
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+/* Returns the given percentile of the recorded durations
+   (nearest rank), or 0 if there are none */
+unsigned long
+history_percentile(HistoryEntry* entry, unsigned int percent)
+{
+    return history_percentile_scaled(entry, percent, 0);
+}
+
+/* As history_percentile, but first stretches each duration recorded
+   under a faster calibration than the given one (if not 0) to how long
+   it would take now.  Durations are never shrunk, as a machine which
+   seems faster is more likely noise */
+unsigned long
+history_percentile_scaled(HistoryEntry* entry, unsigned int percent, unsigned long calibration)
+{
+    unsigned long sorted[HISTORY_SAMPLES];
+    unsigned int rank, i;
+
+    if (!entry || !entry->count)
+        return 0;
+
+    for (i = 0; i < entry->count; i++)
+    {
+        sorted[i] = entry->samples[i];
+
+        if (calibration && entry->calibrations[i] && calibration > entry->calibrations[i])
+            sorted[i] = (double) sorted[i] * calibration / entry->calibrations[i];
+    }
+
+    qsort(sorted, entry->count, sizeof(*sorted), sample_compare);
+
+    rank = (percent * entry->count + 99) / 100;
+
+    return sorted[rank ? rank - 1 : 0];
+}
+
+#define CALIBRATION_TRIES 5
+#define CALIBRATION_ROUNDS (1 << 20)
+
+/* Keeps the calibration work from being optimized away */
+volatile unsigned long calibration_sink;
+
+/* Times a fixed amount of arithmetic and memory traffic a few times and
+   returns the median in microseconds, as a rough measure of how fast
+   this machine is running at the moment, load included */
+unsigned long
+history_calibrate(void)
+{
+    unsigned char buffer[64 * 1024];
+    unsigned long times[CALIBRATION_TRIES];
+    struct timeval start, end;
+    unsigned long state;
+    unsigned int try, i;
+
+    memset(buffer, 0, sizeof(buffer));
+
+    for (try = 0; try < CALIBRATION_TRIES; try++)
+    {
+        gettimeofday(&start, NULL);
+
+        for (i = 0, state = 88172645463325252UL; i < CALIBRATION_ROUNDS; i++)
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            buffer[state % sizeof(buffer)] += (unsigned char) state;
+        }
+
+        calibration_sink = state + buffer[0];
+
+        gettimeofday(&end, NULL);
+
+        times[try] = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+    }
+
+    qsort(times, CALIBRATION_TRIES, sizeof(*times), sample_compare);
+
+    return times[CALIBRATION_TRIES / 2] ? times[CALIBRATION_TRIES / 2] : 1;
+}
+
+static int
+key_compare(const void* _a, const void* _b)
+{
+    return strcmp(*(char**) _a, *(char**) _b);
+}
+
+/* Writes the history out, replacing the old file in one step */
+int
+history_save(History* history)
+{
+    char* temp = format("%s.tmp", history->path);
+    array* keys = history->keys;
+    FILE* file = NULL;
+    unsigned int i, j;
+    int result = -1;
+
+    /* Keep the file stable from one run to the next */
+    if (keys)
+        qsort(keys, array_size(keys), sizeof(*keys), key_compare);
+
+    if (!(file = fopen(temp, "w")))
+        goto done;
+
+    fprintf(file, "# MoonUnit test history\n");
+
+    for (i = 0; i < array_size(keys); i++)
+    {
+        HistoryEntry* entry = hashtable_get(history->entries, keys[i]);
+        bool calibrated = false;
+
+        fprintf(file, "\n[%s]\n", (char*) keys[i]);
+        fprintf(file, "status=%s\n", mu_test_status_to_string(entry->status));
+        fprintf(file, "failed=%s\n", entry->failed ? "yes" : "no");
+        fprintf(file, "durations=");
+
+        for (j = 0; j < entry->count; j++)
+        {
+            fprintf(file, j ? " %lu" : "%lu", entry->samples[j]);
+            calibrated |= entry->calibrations[j] != 0;
+        }
+
+        fprintf(file, "\n");
+
+        if (calibrated)
+        {
+            fprintf(file, "calibrations=");
+
+            for (j = 0; j < entry->count; j++)
+            {
+                fprintf(file, j ? " %lu" : "%lu", entry->calibrations[j]);
+            }
+
+            fprintf(file, "\n");
+        }
+    }
+
+    if (fclose(file))
+        goto done;
+
+    if (rename(temp, history->path))
+        goto done;
+
+    result = 0;
+
+done:
+
+    if (result)
+    {
+        int saved = errno;
+        unlink(temp);
+        errno = saved;
+    }
+
+    free(temp);
+
+    return result;
+}
+
+void
+history_free(History* history)
+{
+    hashtable_free(history->entries);
+    array_free(history->keys);
+    free(history->path);
+    free(history);
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __MOONUNIT_HISTORY_H__
+#define __MOONUNIT_HISTORY_H__
+
+#include <stdbool.h>
+#include <moonunit/test.h>
+#include <moonunit/private/util.h>
+
+/* Number of recent durations kept for each test */
+#define HISTORY_SAMPLES 20
+
+typedef struct
+{
+    /* Status of the most recent run */
+    MuTestStatus status;
+    /* Whether the most recent run failed */
+    bool failed;
+    /* Durations of recent runs in microseconds, oldest first */
+    unsigned long samples[HISTORY_SAMPLES];
+    /* Calibration each duration was recorded under, or 0 if unknown */
+    unsigned long calibrations[HISTORY_SAMPLES];
+    unsigned int count;
+} HistoryEntry;
+
+typedef struct
+{
+    char* path;
+    /* How long the calibration workload took during this run, in
+       microseconds, or 0 if it was not timed.  Saved with each
+       duration recorded */
+    unsigned long calibration;
+    hashtable* entries;
+    /* Keys of all entries, for writing them out */
+    array* keys;
+} History;
+
+History* history_open(const char* path);
+HistoryEntry* history_lookup(History* history, MuTest* test);
+void history_record(History* history, MuTest* test, MuTestResult* result, unsigned long usec);
+unsigned long history_percentile(HistoryEntry* entry, unsigned int percent);
+unsigned long history_percentile_scaled(HistoryEntry* entry, unsigned int percent, unsigned long calibration);
+unsigned long history_calibrate(void);
+int history_save(History* history);
+void history_free(History* history);
+
+#endif
@@ -25,9 +25,17 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
 #include <dlfcn.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#ifdef HAVE_SYS_PERSONALITY_H
+#  include <sys/personality.h>
+#endif
+#include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -41,6 +49,7 @@
 #include "option.h"
 #include "run.h"
 #include "multilog.h"
+#include "merge.h"
 
 #define ALIGNMENT 60
 
@@ -148,7 +157,6 @@ int
 run(char* self)
 {
     MuError* err = NULL;
-    unsigned int file_index;
     RunSettings settings;
     array* loggers;
     unsigned int failed = 0;
@@ -167,6 +175,47 @@ run(char* self)
     }
 
     settings.self = self;
+    settings.loader = NULL;
+    settings.timeout = option.timeout;
+    settings.iterations = option.iterations;
+    settings.stress = option.stress;
+    settings.debug = option.debug;
+    settings.perf_counters = option.perf_counters;
+    settings.capture_output = option.capture_output;
+    settings.show_output = option.show_output;
+    settings.benchmark_precision = option.benchmark_precision;
+    settings.jobs = option.jobs;
+    settings.history = NULL;
+    settings.baseline = NULL;
+    settings.max_failures = option.max_failures;
+    settings.failures = 0;
+    settings.timeout_factor = option.timeout_factor;
+    settings.shard = option.shard;
+    settings.shards = option.shards;
+    settings.shard_load = NULL;
+
+    if (option.shards)
+    {
+        settings.shard_load = xcalloc(option.shards, sizeof(*settings.shard_load));
+    }
+
+    if (option.history)
+    {
+        settings.history = history_open(option.history);
+
+        /* Only worth the time if timeouts are adapted to how fast
+           this machine runs now and when each duration was recorded */
+        if (option.timeout_factor)
+        {
+            settings.history->calibration = history_calibrate();
+        }
+    }
+
+    if (option.baseline)
+    {
+        settings.baseline = baseline_open(option.baseline,
+                                          option.baseline_threshold ? option.baseline_threshold : 5.0);
+    }
 
     if (array_size(loggers) == 0)
     {
@@ -189,49 +238,50 @@ run(char* self)
 
     mu_logger_enter(settings.logger);
 
-    for (file_index = 0; file_index < array_size(option.files); file_index++)
+    if (option.all || array_size(option.tests) == 0)
     {
-        char* file = option.files[file_index];
+        failed = run_files(&settings, option.files, 0, NULL, &err);
+    }
+    else
+    {
+        failed = run_files(&settings, option.files, array_size(option.tests), (char**) option.tests, &err);
+    }
 
-        settings.loader = mu_plugin_get_loader_for_file(file);
+    MU_CATCH_ALL(err)
+    {
+        die("Error: %s", err->message);
+    }
 
-        if (!settings.loader)
-        {
-            die("Error: Could not find loader for file %s", basename_pure(file));
-        }
+    mu_logger_leave(settings.logger);
+    mu_logger_destroy(settings.logger);
 
-        if (option.timeout && mu_loader_option_type(settings.loader, "timeout") == MU_TYPE_INTEGER)
-        {
-            mu_loader_set_option(settings.loader, "timeout", option.timeout);
-        }
-        
-        if (option.iterations && mu_loader_option_type(settings.loader, "iterations") == MU_TYPE_INTEGER)
-        {
-            mu_loader_set_option(settings.loader, "iterations", option.iterations);
-        }
-        
-        if (option.debug && mu_loader_option_type(settings.loader, "debug") == MU_TYPE_BOOLEAN)
-        {
-            mu_loader_set_option(settings.loader, "debug", option.debug);
-        }
+    if (run_stopped(&settings))
+    {
+        fprintf(stderr, "Stopped after %u failure%s\n", settings.failures,
+                settings.failures == 1 ? "" : "s");
+    }
 
-        if (option.all || array_size(option.tests) == 0)
-        {
-            failed += run_all(&settings, file, &err);
-        }
-        else
+    if (settings.history)
+    {
+        if (history_save(settings.history))
         {
-            failed += run_tests(&settings, file, array_size(option.tests), (char**) option.tests, &err);
+            fprintf(stderr, "Warning: Could not write history file %s\n", option.history);
         }
 
-        MU_CATCH_ALL(err)
+        history_free(settings.history);
+    }
+
+    if (settings.baseline)
+    {
+        if (baseline_save(settings.baseline))
         {
-            die("Error: %s", err->message);
+            fprintf(stderr, "Warning: Could not write baseline file %s\n", option.baseline);
         }
+
+        baseline_free(settings.baseline);
     }
 
-    mu_logger_leave(settings.logger);
-    mu_logger_destroy(settings.logger);
+    free(settings.shard_load);
 
     option_release(&option);
 
@@ -241,6 +291,20 @@ run(char* self)
         return (int) failed;
 }
 
+static
+int
+merge(void)
+{
+    char* errormsg = NULL;
+
+    if (merge_results(option.merge, option.files, &errormsg))
+    {
+        die("Error: %s", errormsg);
+    }
+
+    return 0;
+}
+
 static
 int
 list_tests(void)
@@ -271,6 +335,26 @@ list_tests(void)
     return 0;
 }
 
+/* Starts over with address space layout randomization turned off, so that
+   where code and data land, and so how they share caches, is the same from
+   one run to the next.  Test processes inherit this from us */
+static
+void
+disable_aslr(char** argv)
+{
+#ifdef HAVE_PERSONALITY
+    int persona = personality(0xffffffff);
+
+    if (persona != -1 && !(persona & ADDR_NO_RANDOMIZE) &&
+        personality(persona | ADDR_NO_RANDOMIZE) != -1)
+    {
+        execv("/proc/self/exe", argv);
+        /* Carry on regardless if that failed */
+        personality(persona);
+    }
+#endif
+}
+
 int
 main (int argc, char** argv)
 {
@@ -281,6 +365,11 @@ main (int argc, char** argv)
         die("Error: %s", option.errormsg);
     }
 
+    if (option.mode == MODE_RUN && option.benchmark_precision)
+    {
+        disable_aslr(argv);
+    }
+
     switch (option.mode)
     {
     case MODE_RUN:
@@ -295,6 +384,9 @@ main (int argc, char** argv)
     case MODE_PLUGIN_INFO:
         res = plugin_info(option.plugin_info);
         break;
+    case MODE_MERGE:
+        res = merge();
+        break;
     case MODE_USAGE:
     case MODE_HELP:
         break;
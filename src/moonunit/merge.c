@@ -0,0 +1,790 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "merge.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * Merging works on the text of the reports written by the xml and
+ * json loggers rather than on a full parse of either format.  Each
+ * report is split into libraries, suites and tests; entries with the
+ * same key are combined, and each test is copied across verbatim.
+ * Suites and tests come out sorted by name, which is the order a run
+ * that was not sharded would have logged them in.
+ */
+
+typedef struct
+{
+    /* File or name the entry is matched on across reports */
+    char* key;
+    /* Text which opens the entry, or all of it for a test */
+    char* head;
+    /* Text which closes the entry */
+    char* tail;
+    /* Library failures */
+    array* extra;
+    /* Suites of a library or tests of a suite */
+    array* children;
+} MergeNode;
+
+typedef enum
+{
+    FORMAT_XML,
+    FORMAT_JSON
+} MergeFormat;
+
+typedef struct
+{
+    MergeFormat format;
+    /* Text before the first library */
+    char* head;
+    /* Text after the last library */
+    char* tail;
+    array* libraries;
+} MergeReport;
+
+static char*
+copy_range(const char* start, const char* end)
+{
+    char* result = xmalloc(end - start + 1);
+
+    memcpy(result, start, end - start);
+    result[end - start] = '\0';
+
+    return result;
+}
+
+static MergeNode*
+node_new(char* key)
+{
+    MergeNode* node = xcalloc(1, sizeof(MergeNode));
+
+    node->key = key;
+
+    return node;
+}
+
+static void
+node_free(MergeNode* node)
+{
+    unsigned int i;
+
+    for (i = 0; i < array_size(node->extra); i++)
+        free(node->extra[i]);
+
+    for (i = 0; i < array_size(node->children); i++)
+        node_free(node->children[i]);
+
+    array_free(node->extra);
+    array_free(node->children);
+    free(node->key);
+    free(node->head);
+    free(node->tail);
+    free(node);
+}
+
+/* Finds the entry with the given key, adding it if there is none.
+   Takes ownership of key */
+static MergeNode*
+node_find(array** nodes, char* key)
+{
+    MergeNode* node = NULL;
+    unsigned int i;
+
+    for (i = 0; i < array_size(*nodes); i++)
+    {
+        node = (*nodes)[i];
+
+        if (!strcmp(node->key, key))
+        {
+            free(key);
+            return node;
+        }
+    }
+
+    node = node_new(key);
+    *nodes = array_append(*nodes, node);
+
+    return node;
+}
+
+/* Adds a library failure unless another report already had it */
+static void
+node_add_extra(MergeNode* node, char* text)
+{
+    unsigned int i;
+
+    for (i = 0; i < array_size(node->extra); i++)
+    {
+        if (!strcmp(node->extra[i], text))
+        {
+            free(text);
+            return;
+        }
+    }
+
+    node->extra = array_append(node->extra, text);
+}
+
+static int
+node_compare(const void* _a, const void* _b)
+{
+    MergeNode* a = *(MergeNode**) _a;
+    MergeNode* b = *(MergeNode**) _b;
+
+    return strcmp(a->key, b->key);
+}
+
+static void
+node_sort(MergeNode* node)
+{
+    if (node->children)
+        qsort(node->children, array_size(node->children), sizeof(*node->children), node_compare);
+}
+
+static bool
+starts_with(const char* str, const char* prefix)
+{
+    return !strncmp(str, prefix, strlen(prefix));
+}
+
+/* Returns the raw value of an attribute in the tag at the start of line */
+static char*
+xml_attr(const char* line, const char* name)
+{
+    char* pattern = format(" %s=\"", name);
+    const char* end = strchr(line, '>');
+    const char* value = strstr(line, pattern);
+    char* result = NULL;
+
+    if (value && (!end || value < end))
+    {
+        value += strlen(pattern);
+        result = copy_range(value, value + strcspn(value, "\""));
+    }
+
+    free(pattern);
+
+    return result ? result : safe_strdup("");
+}
+
+/* The xml logger writes one tag per line and escapes any line breaks
+   in text, so each line can be classified by the tag it starts with */
+static int
+parse_xml(MergeReport* report, const char* text)
+{
+    MergeNode* library = NULL;
+    MergeNode* suite = NULL;
+    const char* test = NULL;
+    char* test_key = NULL;
+    const char* line = NULL;
+    const char* next = NULL;
+    const char* tag = NULL;
+    bool run = false;
+
+    for (line = text; *line; line = next)
+    {
+        next = strchr(line, '\n');
+        next = next ? next + 1 : line + strlen(line);
+        tag = line + strspn(line, " \t");
+
+        if (test)
+        {
+            if (starts_with(tag, "</test>"))
+            {
+                MergeNode* node = node_new(test_key);
+
+                node->head = copy_range(test, next);
+                suite->children = array_append(suite->children, node);
+                test = NULL;
+            }
+        }
+        else if (starts_with(tag, "<run"))
+        {
+            if (!report->head)
+                report->head = copy_range(text, next);
+            run = true;
+        }
+        else if (starts_with(tag, "</run>"))
+        {
+            if (!report->tail)
+                report->tail = safe_strdup(line);
+            return 0;
+        }
+        else if (!run)
+        {
+            continue;
+        }
+        else if (starts_with(tag, "<library "))
+        {
+            library = node_find(&report->libraries, xml_attr(tag, "file"));
+
+            if (!library->head)
+                library->head = copy_range(line, next);
+        }
+        else if (starts_with(tag, "</library>") && library)
+        {
+            if (!library->tail)
+                library->tail = copy_range(line, next);
+            library = NULL;
+        }
+        else if (starts_with(tag, "<abort ") && library)
+        {
+            node_add_extra(library, copy_range(line, next));
+        }
+        else if (starts_with(tag, "<suite ") && library)
+        {
+            suite = node_find(&library->children, xml_attr(tag, "name"));
+
+            if (!suite->head)
+                suite->head = copy_range(line, next);
+        }
+        else if (starts_with(tag, "</suite>") && suite)
+        {
+            if (!suite->tail)
+                suite->tail = copy_range(line, next);
+            suite = NULL;
+        }
+        else if (starts_with(tag, "<test ") && suite)
+        {
+            test = line;
+            test_key = xml_attr(tag, "name");
+        }
+    }
+
+    if (test)
+        free(test_key);
+
+    return -1;
+}
+
+static void
+write_xml(FILE* out, MergeReport* report)
+{
+    unsigned int i, j, k;
+
+    fputs(report->head, out);
+
+    for (i = 0; i < array_size(report->libraries); i++)
+    {
+        MergeNode* library = report->libraries[i];
+
+        fputs(library->head, out);
+
+        for (j = 0; j < array_size(library->extra); j++)
+            fputs(library->extra[j], out);
+
+        node_sort(library);
+
+        for (j = 0; j < array_size(library->children); j++)
+        {
+            MergeNode* suite = library->children[j];
+
+            fputs(suite->head, out);
+            node_sort(suite);
+
+            for (k = 0; k < array_size(suite->children); k++)
+            {
+                MergeNode* test = suite->children[k];
+
+                /* Reports which overlap only contribute each test once */
+                if (k == 0 || strcmp(test->key, ((MergeNode*) suite->children[k-1])->key))
+                    fputs(test->head, out);
+            }
+
+            fputs(suite->tail ? suite->tail : "      </suite>\n", out);
+        }
+
+        fputs(library->tail ? library->tail : "    </library>\n", out);
+    }
+
+    fputs(report->tail, out);
+}
+
+static const char*
+json_space(const char* p)
+{
+    return p + strspn(p, " \t\r\n");
+}
+
+/* Skips over a single value, returning NULL if the text ends first */
+static const char*
+json_skip(const char* p)
+{
+    int depth = 0;
+
+    do
+    {
+        p = json_space(p);
+
+        switch (*p)
+        {
+        case '\0':
+            return NULL;
+        case '"':
+            for (p++; *p && *p != '"'; p++)
+            {
+                if (*p == '\\' && p[1])
+                    p++;
+            }
+            if (!*p)
+                return NULL;
+            p++;
+            break;
+        case '{':
+        case '[':
+            depth++;
+            p++;
+            break;
+        case '}':
+        case ']':
+            depth--;
+            p++;
+            break;
+        case ',':
+        case ':':
+            p++;
+            break;
+        default:
+            p += strcspn(p, ",:]} \t\r\n");
+            break;
+        }
+    } while (depth > 0);
+
+    return p;
+}
+
+/* Moves to the next member or element of an object or array,
+   returning false once the closing bracket is reached */
+static bool
+json_next(const char** p, char close)
+{
+    const char* s = json_space(*p);
+
+    if (*s == ',')
+        s = json_space(s + 1);
+
+    *p = s;
+
+    return *s && *s != close;
+}
+
+/* Reads an object member, setting name and value to the text of the
+   key and value, and leaves p after it */
+static bool
+json_member(const char** p, const char** name, const char** value, const char** end)
+{
+    const char* s = *p;
+
+    *name = s;
+
+    if (*s != '"' || !(s = json_skip(s)))
+        return false;
+
+    s = json_space(s);
+
+    if (*s != ':')
+        return false;
+
+    *value = json_space(s + 1);
+
+    if (!(*end = json_skip(*value)))
+        return false;
+
+    *p = *end;
+
+    return true;
+}
+
+static bool
+json_name_is(const char* name, const char* expected)
+{
+    size_t len = strlen(expected);
+
+    return name[0] == '"' && !strncmp(name + 1, expected, len) && name[len + 1] == '"';
+}
+
+static char*
+json_join(char* list, const char* start, const char* end)
+{
+    char* item = copy_range(start, end);
+    char* result = NULL;
+
+    if (!list)
+        return item;
+
+    result = format("%s,%s", list, item);
+
+    free(list);
+    free(item);
+
+    return result;
+}
+
+/* Returns the name of a test object, or an empty string */
+static char*
+json_test_key(const char* p)
+{
+    const char* name, *value, *end;
+
+    for (p++; json_next(&p, '}'); )
+    {
+        if (!json_member(&p, &name, &value, &end))
+            break;
+
+        if (json_name_is(name, "name"))
+            return copy_range(value, end);
+    }
+
+    return safe_strdup("");
+}
+
+static const char*
+json_parse_suite(MergeNode* library, const char* p)
+{
+    MergeNode* suite = NULL;
+    const char* tests = NULL;
+    const char* name, *value, *end;
+
+    for (p++; json_next(&p, '}'); )
+    {
+        if (!json_member(&p, &name, &value, &end))
+            return NULL;
+
+        if (json_name_is(name, "name"))
+            suite = node_find(&library->children, copy_range(value, end));
+        else if (json_name_is(name, "tests") && *value == '[')
+            tests = value;
+    }
+
+    if (!*p || !suite)
+        return NULL;
+
+    if (tests)
+    {
+        for (tests++; json_next(&tests, ']'); tests = end)
+        {
+            MergeNode* test = NULL;
+
+            if (!(end = json_skip(tests)))
+                return NULL;
+
+            test = node_new(*tests == '{' ? json_test_key(tests) : safe_strdup(""));
+            test->head = copy_range(tests, end);
+            suite->children = array_append(suite->children, test);
+        }
+    }
+
+    return p + 1;
+}
+
+static const char*
+json_parse_library(MergeReport* report, const char* p)
+{
+    MergeNode* library = NULL;
+    char* head = NULL;
+    array* failures = NULL;
+    array* suites = NULL;
+    const char* name, *value, *end;
+    unsigned int i;
+
+    for (p++; json_next(&p, '}'); )
+    {
+        if (!json_member(&p, &name, &value, &end))
+            goto error;
+
+        if (json_name_is(name, "file"))
+            library = node_find(&report->libraries, copy_range(value, end));
+
+        if (json_name_is(name, "failure"))
+            failures = array_append(failures, copy_range(name, end));
+        else if (json_name_is(name, "suites") && *value == '[')
+            suites = array_append(suites, (void*) value);
+        else
+            head = json_join(head, name, end);
+    }
+
+    if (!*p || !library)
+        goto error;
+
+    if (!library->head)
+    {
+        library->head = head;
+        head = NULL;
+    }
+
+    for (i = 0; i < array_size(failures); i++)
+    {
+        node_add_extra(library, failures[i]);
+        failures[i] = NULL;
+    }
+
+    for (i = 0; i < array_size(suites); i++)
+    {
+        const char* s = suites[i];
+
+        for (s++; json_next(&s, ']'); )
+        {
+            if (*s != '{' || !(s = json_parse_suite(library, s)))
+                goto error;
+        }
+    }
+
+    p++;
+
+done:
+
+    for (i = 0; i < array_size(failures); i++)
+        free(failures[i]);
+
+    array_free(failures);
+    array_free(suites);
+    free(head);
+
+    return p;
+
+error:
+
+    p = NULL;
+    goto done;
+}
+
+static int
+parse_json(MergeReport* report, const char* text)
+{
+    const char* p = json_space(text);
+    const char* name, *value, *end;
+    char* head = NULL;
+
+    if (*p != '{')
+        return -1;
+
+    for (p++; json_next(&p, '}'); )
+    {
+        if (!json_member(&p, &name, &value, &end))
+            goto error;
+
+        if (json_name_is(name, "libraries") && *value == '[')
+        {
+            const char* l = value;
+
+            for (l++; json_next(&l, ']'); )
+            {
+                if (*l != '{' || !(l = json_parse_library(report, l)))
+                    goto error;
+            }
+        }
+        else
+        {
+            head = json_join(head, name, end);
+        }
+    }
+
+    if (!*p)
+        goto error;
+
+    if (!report->head)
+        report->head = head ? head : safe_strdup("");
+    else
+        free(head);
+
+    return 0;
+
+error:
+
+    free(head);
+
+    return -1;
+}
+
+static void
+write_json(FILE* out, MergeReport* report)
+{
+    unsigned int i, j, k;
+
+    fprintf(out, "{%s%s\"libraries\":[", report->head, *report->head ? "," : "");
+
+    for (i = 0; i < array_size(report->libraries); i++)
+    {
+        MergeNode* library = report->libraries[i];
+
+        fprintf(out, "%s{%s", i ? "," : "", library->head ? library->head : "");
+
+        for (j = 0; j < array_size(library->extra); j++)
+            fprintf(out, ",%s", (char*) library->extra[j]);
+
+        node_sort(library);
+
+        if (library->children)
+            fputs(",\"suites\":[", out);
+
+        for (j = 0; j < array_size(library->children); j++)
+        {
+            MergeNode* suite = library->children[j];
+            bool first = true;
+
+            fprintf(out, "%s{\"name\":%s,\"tests\":[", j ? "," : "", suite->key);
+            node_sort(suite);
+
+            for (k = 0; k < array_size(suite->children); k++)
+            {
+                MergeNode* test = suite->children[k];
+
+                if (k == 0 || strcmp(test->key, ((MergeNode*) suite->children[k-1])->key))
+                {
+                    fprintf(out, "%s%s", first ? "" : ",", test->head);
+                    first = false;
+                }
+            }
+
+            fputs("]}", out);
+        }
+
+        if (library->children)
+            fputs("]", out);
+
+        fputs("}", out);
+    }
+
+    fputs("]}\n", out);
+}
+
+static char*
+read_file(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    char* contents = NULL;
+    size_t len = 0;
+    size_t read = 0;
+
+    if (!file)
+        return NULL;
+
+    do
+    {
+        contents = xrealloc(contents, len + 4096 + 1);
+        read = fread(contents + len, 1, 4096, file);
+        len += read;
+    } while (read == 4096);
+
+    contents[len] = '\0';
+
+    fclose(file);
+
+    return contents;
+}
+
+int
+merge_results(const char* output, array* inputs, char** errormsg)
+{
+    MergeReport report = {0};
+    FILE* out = NULL;
+    unsigned int i;
+    int result = -1;
+
+    for (i = 0; i < array_size(inputs); i++)
+    {
+        const char* path = inputs[i];
+        char* text = read_file(path);
+        MergeFormat kind;
+        int rc;
+
+        if (!text)
+        {
+            *errormsg = format("Could not read %s: %s", path, strerror(errno));
+            goto done;
+        }
+
+        kind = *json_space(text) == '{' ? FORMAT_JSON : FORMAT_XML;
+
+        if (i == 0)
+        {
+            report.format = kind;
+        }
+        else if (kind != report.format)
+        {
+            *errormsg = format("%s is not in the same format as %s", path, (char*) inputs[0]);
+            free(text);
+            goto done;
+        }
+
+        if (kind == FORMAT_JSON)
+            rc = parse_json(&report, text);
+        else
+            rc = parse_xml(&report, text);
+
+        free(text);
+
+        if (rc)
+        {
+            *errormsg = format("%s is not a MoonUnit XML or JSON report", path);
+            goto done;
+        }
+    }
+
+    if (!strcmp(output, "-"))
+    {
+        out = stdout;
+    }
+    else if (!(out = fopen(output, "w")))
+    {
+        *errormsg = format("Could not open %s: %s", output, strerror(errno));
+        goto done;
+    }
+
+    if (report.format == FORMAT_JSON)
+        write_json(out, &report);
+    else
+        write_xml(out, &report);
+
+    if (out != stdout ? fclose(out) : fflush(out))
+    {
+        *errormsg = format("Could not write %s: %s", output, strerror(errno));
+        goto done;
+    }
+
+    result = 0;
+
+done:
+
+    for (i = 0; i < array_size(report.libraries); i++)
+        node_free(report.libraries[i]);
+
+    array_free(report.libraries);
+    free(report.head);
+    free(report.tail);
+
+    return result;
+}
@@ -39,10 +39,15 @@
 #include <signal.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <limits.h>
+#include <float.h>
 
 #include "option.h"
 #include "upopt.h"
 
+/* Most shards a run may be split into; each takes a slot in a table */
+#define MAX_SHARDS 4096
+
 enum
 {
     OPTION_TEST,
@@ -51,7 +56,21 @@ enum
     OPTION_LOGGER,
     OPTION_LOADER_OPTION,
     OPTION_ITERATIONS,
+    OPTION_STRESS,
     OPTION_TIMEOUT,
+    OPTION_ADAPTIVE_TIMEOUT,
+    OPTION_JOBS,
+    OPTION_PERF_COUNTERS,
+    OPTION_CAPTURE_OUTPUT,
+    OPTION_SHOW_OUTPUT,
+    OPTION_BENCHMARK_PRECISION,
+    OPTION_MAX_FAILURES,
+    OPTION_FAIL_FAST,
+    OPTION_HISTORY,
+    OPTION_BASELINE,
+    OPTION_BASELINE_THRESHOLD,
+    OPTION_SHARD,
+    OPTION_MERGE,
     OPTION_LIST_PLUGINS,
     OPTION_PLUGIN_INFO,
     OPTION_RESOURCE,
@@ -76,6 +95,51 @@ error(OptionTable* table, int code, const char* fmt, ...)
 
 #define UPOPT_ERROR(table, ...) error(table, UPOPT_STATUS_ERROR, __VA_ARGS__)
 
+/* Parses a whole number of at least min, returning false
+   if value is anything else, including out of range */
+static bool
+parse_count(const char* value, unsigned long min, unsigned int* count)
+{
+    unsigned long parsed;
+    char* end = NULL;
+
+    /* strtoul would quietly negate these */
+    while (*value == ' ' || *value == '\t')
+        value++;
+
+    if (*value < '0' || *value > '9')
+        return false;
+
+    errno = 0;
+    parsed = strtoul(value, &end, 10);
+
+    if (errno || *end || parsed < min || parsed > UINT_MAX)
+        return false;
+
+    *count = (unsigned int) parsed;
+
+    return true;
+}
+
+/* Parses a number greater than 0, returning false if value is
+   anything else, including out of range */
+static bool
+parse_factor(const char* value, double* factor)
+{
+    double parsed;
+    char* end = NULL;
+
+    errno = 0;
+    parsed = strtod(value, &end);
+
+    if (errno || end == value || *end || !(parsed > 0 && parsed <= DBL_MAX))
+        return false;
+
+    *factor = parsed;
+
+    return true;
+}
+
 static const struct UpoptOptionInfo options[] =
 {
     {
@@ -120,6 +184,13 @@ static const struct UpoptOptionInfo options[] =
         .description = "Run each test count iterations",
         .argument = "count"
     },
+    {
+        .longname = "stress",
+        .shortname = '\0',
+        .constant = OPTION_STRESS,
+        .description = "Also run each test as count simultaneous copies",
+        .argument = "count"
+    },
     {
         .longname = "timeout",
         .shortname = '\0',
@@ -127,6 +198,97 @@ static const struct UpoptOptionInfo options[] =
         .description = "Terminate unresponsive tests after t milliseconds",
         .argument = "t"
     },
+    {
+        .longname = "adaptive-timeout",
+        .shortname = '\0',
+        .constant = OPTION_ADAPTIVE_TIMEOUT,
+        .description = "Time out tests after factor times the p99 of their recorded durations",
+        .argument = "factor"
+    },
+    {
+        .longname = "jobs",
+        .shortname = 'j',
+        .constant = OPTION_JOBS,
+        .description = "Run up to count tests at once (auto for one per CPU)",
+        .argument = "count"
+    },
+    {
+        .longname = "perf-counters",
+        .shortname = '\0',
+        .constant = OPTION_PERF_COUNTERS,
+        .description = "Count cycles, instructions and cache misses in each test",
+        .argument = NULL
+    },
+    {
+        .longname = "capture-output",
+        .shortname = '\0',
+        .constant = OPTION_CAPTURE_OUTPUT,
+        .description = "Capture what tests print and report it for tests which fail",
+        .argument = NULL
+    },
+    {
+        .longname = "show-output",
+        .shortname = '\0',
+        .constant = OPTION_SHOW_OUTPUT,
+        .description = "Capture what tests print and report it even when they pass",
+        .argument = NULL
+    },
+    {
+        .longname = "benchmark-precision",
+        .shortname = '\0',
+        .constant = OPTION_BENCHMARK_PRECISION,
+        .description = "Pin benchmarks to quiet CPUs and sample until within percent",
+        .argument = "percent"
+    },
+    {
+        .longname = "max-failures",
+        .shortname = '\0',
+        .constant = OPTION_MAX_FAILURES,
+        .description = "Stop the run after count failures",
+        .argument = "count"
+    },
+    {
+        .longname = "fail-fast",
+        .shortname = '\0',
+        .constant = OPTION_FAIL_FAST,
+        .description = "Stop the run after the first failure",
+        .argument = NULL
+    },
+    {
+        .longname = "history",
+        .shortname = '\0',
+        .constant = OPTION_HISTORY,
+        .description = "Schedule tests using and record timings to file",
+        .argument = "file"
+    },
+    {
+        .longname = "baseline",
+        .shortname = '\0',
+        .constant = OPTION_BASELINE,
+        .description = "Compare timings against and record new ones to file",
+        .argument = "file"
+    },
+    {
+        .longname = "baseline-threshold",
+        .shortname = '\0',
+        .constant = OPTION_BASELINE_THRESHOLD,
+        .description = "Report changes from the baseline beyond percent (default: 5)",
+        .argument = "percent"
+    },
+    {
+        .longname = "shard",
+        .shortname = '\0',
+        .constant = OPTION_SHARD,
+        .description = "Run only shard k of n, balanced by recorded durations",
+        .argument = "k/n"
+    },
+    {
+        .longname = "merge",
+        .shortname = '\0',
+        .constant = OPTION_MERGE,
+        .description = "Merge XML or JSON result files given as arguments into file",
+        .argument = "file"
+    },
     {
         .longname = "list-tests",
         .shortname = '\0',
@@ -187,6 +349,7 @@ option_parse(int argc, char** argv, OptionTable* option)
 
     option->iterations = 0;
     option->timeout = 0;
+    option->jobs = 1;
     option->mode = MODE_RUN;
 
     while ((rc = upopt_next(context, &constant, &value, &option->errormsg)) != UPOPT_STATUS_DONE)
@@ -217,10 +380,118 @@ option_parse(int argc, char** argv, OptionTable* option)
             option->resources = array_append(option->resources, strdup(value));
             break;
         case OPTION_ITERATIONS:
-            option->iterations = atoi(value);
+            if (!parse_count(value, 1, &option->iterations))
+            {
+                rc = UPOPT_ERROR(option, "Invalid iteration count: %s", value);
+                goto error;
+            }
+            break;
+        case OPTION_STRESS:
+            if (!parse_count(value, 2, &option->stress))
+            {
+                rc = UPOPT_ERROR(option, "Invalid stress count: %s", value);
+                goto error;
+            }
             break;
         case OPTION_TIMEOUT:
-            option->timeout = atoi(value);
+        {
+            unsigned int timeout;
+
+            if (!parse_count(value, 1, &timeout))
+            {
+                rc = UPOPT_ERROR(option, "Invalid timeout: %s", value);
+                goto error;
+            }
+            option->timeout = timeout;
+            break;
+        }
+        case OPTION_ADAPTIVE_TIMEOUT:
+            if (!parse_factor(value, &option->timeout_factor))
+            {
+                rc = UPOPT_ERROR(option, "Invalid timeout factor: %s", value);
+                goto error;
+            }
+            break;
+        case OPTION_JOBS:
+            if (!strcmp(value, "auto"))
+            {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                option->jobs = cpus > 0 ? (unsigned int) cpus : 1;
+            }
+            else if (!parse_count(value, 1, &option->jobs))
+            {
+                rc = UPOPT_ERROR(option, "Invalid job count: %s", value);
+                goto error;
+            }
+            break;
+        case OPTION_PERF_COUNTERS:
+            option->perf_counters = true;
+            break;
+        case OPTION_CAPTURE_OUTPUT:
+            option->capture_output = true;
+            break;
+        case OPTION_SHOW_OUTPUT:
+            option->show_output = true;
+            break;
+        case OPTION_BENCHMARK_PRECISION:
+            if (!parse_factor(value, &option->benchmark_precision))
+            {
+                rc = UPOPT_ERROR(option, "Invalid benchmark precision: %s", value);
+                goto error;
+            }
+            break;
+        case OPTION_MAX_FAILURES:
+            if (!parse_count(value, 1, &option->max_failures))
+            {
+                rc = UPOPT_ERROR(option, "Invalid failure count: %s", value);
+                goto error;
+            }
+            break;
+        case OPTION_FAIL_FAST:
+            option->max_failures = 1;
+            break;
+        case OPTION_HISTORY:
+            free(option->history);
+            option->history = strdup(value);
+            break;
+        case OPTION_BASELINE:
+            free(option->baseline);
+            option->baseline = strdup(value);
+            break;
+        case OPTION_BASELINE_THRESHOLD:
+            if (!parse_factor(value, &option->baseline_threshold))
+            {
+                rc = UPOPT_ERROR(option, "Invalid baseline threshold: %s", value);
+                goto error;
+            }
+            break;
+        case OPTION_SHARD:
+        {
+            const char* slash = strchr(value, '/');
+            char shard[32];
+
+            if (!slash || (size_t) (slash - value) >= sizeof(shard))
+            {
+                rc = UPOPT_ERROR(option, "Invalid shard: %s", value);
+                goto error;
+            }
+
+            memcpy(shard, value, slash - value);
+            shard[slash - value] = '\0';
+
+            if (!parse_count(shard, 1, &option->shard) ||
+                !parse_count(slash + 1, 1, &option->shards) ||
+                option->shards > MAX_SHARDS ||
+                option->shard > option->shards)
+            {
+                rc = UPOPT_ERROR(option, "Invalid shard: %s", value);
+                goto error;
+            }
+            break;
+        }
+        case OPTION_MERGE:
+            option->mode = MODE_MERGE;
+            option->merge = value;
             break;
         case OPTION_LIST_TESTS:
             option->mode = MODE_LIST_TESTS;
@@ -252,6 +523,14 @@ option_parse(int argc, char** argv, OptionTable* option)
     {
         rc = UPOPT_ERROR(option, "No libraries specified");
     }
+    else if (option->mode == MODE_RUN && option->timeout_factor && !option->history)
+    {
+        rc = UPOPT_ERROR(option, "--adaptive-timeout requires --history");
+    }
+    else if (option->mode == MODE_MERGE && !array_size(option->files))
+    {
+        rc = UPOPT_ERROR(option, "No result files specified");
+    }
     
 error:
     
@@ -456,4 +735,7 @@ option_release(OptionTable* option)
         free(option->loader_options[i]);
 
     array_free(option->loader_options);
+
+    free(option->history);
+    free(option->baseline);
 }
@@ -40,17 +40,31 @@ typedef struct
         MODE_LIST_TESTS,
         MODE_LIST_PLUGINS,
         MODE_PLUGIN_INFO,
+        MODE_MERGE,
         MODE_USAGE,
         MODE_HELP
     } mode;
     bool all;
     bool debug;
+    bool perf_counters;
+    bool capture_output;
+    bool show_output;
     unsigned int iterations;
+    unsigned int stress;
+    unsigned int jobs;
+    unsigned int shard, shards;
+    unsigned int max_failures;
     long timeout;
+    double timeout_factor;
+    double benchmark_precision;
+    double baseline_threshold;
     char* logger;
+    char* history;
+    char* baseline;
     array* tests, *files, *loggers, *resources;
     array* loader_options;
     const char* plugin_info;
+    const char* merge;
     char* errormsg;
 } OptionTable;
 
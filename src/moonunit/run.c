@@ -34,9 +34,14 @@
 #include <moonunit/private/util.h>
 #include <moonunit/library.h>
 #include <moonunit/error.h>
+#include <moonunit/plugin.h>
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 static int
 test_compare(const void* _a, const void* _b)
@@ -92,6 +97,74 @@ done:
     return result;
 }
 
+static unsigned long
+elapsed_usec(struct timeval* start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_usec - start->tv_usec);
+}
+
+/* Fewest recorded durations a test needs before its timeout is adapted */
+#define ADAPTIVE_MIN_SAMPLES 3
+/* Shortest adapted timeout in milliseconds, to allow for scheduling noise */
+#define ADAPTIVE_MIN_TIMEOUT 100
+
+/* Sets the loader's timeout for the next test from its recorded
+   durations, falling back to the loader's own timeout for tests with
+   too little history.  A test which sets its own timeout still wins */
+static void
+adapt_timeout(RunSettings* settings, MuTest* test)
+{
+    HistoryEntry* entry = NULL;
+    double timeout = settings->default_timeout;
+
+    if (!settings->default_timeout)
+        return;
+
+    entry = history_lookup(settings->history, test);
+
+    if (entry && entry->count >= ADAPTIVE_MIN_SAMPLES)
+    {
+        timeout = history_percentile_scaled(entry, 99, settings->history->calibration) / 1000.0 *
+            settings->timeout_factor;
+
+        if (timeout < ADAPTIVE_MIN_TIMEOUT)
+            timeout = ADAPTIVE_MIN_TIMEOUT;
+        else if (timeout > INT_MAX)
+            timeout = INT_MAX;
+    }
+
+    mu_loader_set_option(settings->loader, "timeout", (int) timeout);
+}
+
+/* Starts adapting timeouts for tests run by the current loader */
+static void
+timeout_begin(RunSettings* settings)
+{
+    MuLoader* loader = settings->loader;
+
+    settings->default_timeout = 0;
+
+    if (settings->timeout_factor && mu_loader_option_type(loader, "timeout") == MU_TYPE_INTEGER)
+    {
+        mu_option_get(loader->options, loader, "timeout", &settings->default_timeout);
+    }
+}
+
+/* Puts the loader's own timeout back */
+static void
+timeout_end(RunSettings* settings)
+{
+    if (settings->default_timeout)
+    {
+        mu_loader_set_option(settings->loader, "timeout", settings->default_timeout);
+        settings->default_timeout = 0;
+    }
+}
+
 static void
 event_proxy_cb(MuLogEvent const* event, void* data)
 {
@@ -100,118 +173,785 @@ event_proxy_cb(MuLogEvent const* event, void* data)
     mu_logger_test_log(logger, event);
 }
 
-unsigned int
-run_tests(RunSettings* settings, const char* path, int setc, char** set, MuError** _err)
+/* A test dispatched in the background whose
+   events and result are held until it is logged */
+typedef struct
 {
-    MuError* err = NULL;
+    MuTest* test;
+    array* events;
+    MuTestResult* result;
+    struct timeval started;
+    unsigned long usec;
+    struct LibraryRun* library;
+    /* Set if the loader stopped reporting before the test finished */
+    bool lost;
+} PendingTest;
+
+static void
+event_buffer_cb(MuLogEvent const* event, void* data)
+{
+    PendingTest* pending = (PendingTest*) data;
+    MuLogEvent* copy = xmalloc(sizeof(MuLogEvent));
+
+    *copy = *event;
+    copy->file = safe_strdup(event->file);
+    copy->message = safe_strdup(event->message);
+
+    pending->events = array_append(pending->events, copy);
+}
+
+static void
+enter_suite(MuLogger* logger, const char** current_suite, MuTest* test)
+{
+    if (*current_suite == NULL || strcmp(*current_suite, mu_test_suite(test)))
+    {
+        if (*current_suite)
+            mu_logger_suite_leave(logger);
+        *current_suite = mu_test_suite(test);
+        mu_logger_suite_enter(logger, mu_test_suite(test));
+    }
+}
+
+static bool
+test_failed(MuTestResult* summary)
+{
+    return summary->status != MU_STATUS_SKIPPED &&
+        summary->status != summary->expected;
+}
+
+bool
+run_stopped(RunSettings* settings)
+{
+    return settings->max_failures && settings->failures >= settings->max_failures;
+}
+
+static unsigned int
+finish_test(RunSettings* settings, MuTest* test, MuTestResult* summary, unsigned long usec)
+{
+    MuLoader* loader = settings->loader;
     unsigned int failed = 0;
+
+    summary->comparison = settings->baseline ?
+        baseline_compare(settings->baseline, test, summary, usec) : NULL;
+
+    mu_logger_test_leave(settings->logger, test, summary);
+
+    if (settings->history)
+        history_record(settings->history, test, summary, usec);
+
+    /* A test which got significantly slower fails the run like any other */
+    if (test_failed(summary) ||
+        (summary->comparison && summary->comparison->verdict == MU_VERDICT_REGRESSED))
+        failed++;
+
+    /* The comparison is ours, not the loader's */
+    free(summary->comparison);
+    summary->comparison = NULL;
+
+    loader->free_result(loader, summary);
+
+    return failed;
+}
+
+static unsigned int
+log_pending(RunSettings* settings, const char** current_suite, PendingTest* pending)
+{
     MuLogger* logger = settings->logger;
-    MuLoader* loader = settings->loader;
-    MuLibrary* library = NULL;
-    MuTest** tests = NULL;
+    unsigned int index;
 
-    library = mu_loader_open(loader, path, &err);
+    enter_suite(logger, current_suite, pending->test);
 
-    /* Even if library loading failed, log that
-       we attempted to visit it */
-    mu_logger_library_enter(logger, path, library); 
+    mu_logger_test_enter(logger, pending->test);
+
+    for (index = 0; index < array_size(pending->events); index++)
+    {
+        MuLogEvent* event = pending->events[index];
+
+        mu_logger_test_log(logger, event);
+
+        free((void*) event->file);
+        free((void*) event->message);
+        free(event);
+    }
+
+    array_free(pending->events);
+    pending->events = NULL;
+
+    if (pending->lost)
+    {
+        MuTestResult lost;
+
+        /* Nothing is known about how it went, so it is not recorded */
+        memset(&lost, 0, sizeof(lost));
+        lost.status = MU_STATUS_FAILURE;
+        lost.expected = MU_STATUS_SUCCESS;
+        lost.stage = MU_STAGE_UNKNOWN;
+        lost.reason = "Loader stopped reporting before the test finished";
+
+        mu_logger_test_leave(logger, pending->test, &lost);
+
+        return 1;
+    }
+
+    return finish_test(settings, pending->test, pending->result, pending->usec);
+}
+
+/* Where a test falls in the order tests are started in */
+typedef struct
+{
+    unsigned int index;
+    /* 0 if it failed last time, 1 if it has no history, 2 otherwise */
+    int rank;
+    unsigned long cost;
+} ScheduleSlot;
+
+static int
+slot_compare(const void* _a, const void* _b)
+{
+    const ScheduleSlot* a = (const ScheduleSlot*) _a;
+    const ScheduleSlot* b = (const ScheduleSlot*) _b;
+
+    if (a->rank != b->rank)
+        return a->rank - b->rank;
+    else if (a->cost != b->cost)
+        return a->cost > b->cost ? -1 : 1;
+    else
+        return a->index < b->index ? -1 : 1;
+}
+
+/* Works out the order to start tests in from their history:
+   tests that failed last time go first so regressions show up
+   early, then tests never seen before, then the slowest ones so
+   they are not left running alone at the end */
+static unsigned int*
+schedule_tests(History* history, MuTest** tests, unsigned int count)
+{
+    ScheduleSlot* slots = xcalloc(count, sizeof(ScheduleSlot));
+    unsigned int* order = xcalloc(count, sizeof(unsigned int));
+    unsigned int index;
+
+    for (index = 0; index < count; index++)
+    {
+        HistoryEntry* entry = history_lookup(history, tests[index]);
+
+        slots[index].index = index;
+
+        if (!entry || !entry->count)
+            slots[index].rank = 1;
+        else if (entry->failed)
+            slots[index].rank = 0;
+        else
+            slots[index].rank = 2;
+
+        slots[index].cost = history_percentile(entry, 50);
+    }
+
+    qsort(slots, count, sizeof(ScheduleSlot), slot_compare);
+
+    for (index = 0; index < count; index++)
+    {
+        order[index] = slots[index].index;
+    }
+
+    free(slots);
+
+    return order;
+}
+
+/* Keeps only the tests that belong to this shard.  Tests are handed
+   out longest first to the shard with the least work so far, going by
+   the median duration recorded in the history; tests with no history
+   are assumed to take the average.  The split depends only on the
+   tests and the history, so every shard works out the same one */
+static unsigned int
+shard_tests(RunSettings* settings, MuTest** tests, unsigned int count)
+{
+    ScheduleSlot* slots = xcalloc(count, sizeof(ScheduleSlot));
+    bool* mine = xcalloc(count, sizeof(bool));
+    unsigned long total = 0;
+    unsigned int known = 0;
+    unsigned int index, shard, kept;
+
+    for (index = 0; index < count; index++)
+    {
+        HistoryEntry* entry = NULL;
+
+        if (settings->history)
+            entry = history_lookup(settings->history, tests[index]);
+
+        slots[index].index = index;
+
+        if (entry && entry->count)
+        {
+            /* Count every test for something so ties still spread out */
+            slots[index].cost = history_percentile(entry, 50) + 1;
+            total += slots[index].cost;
+            known++;
+        }
+        else
+        {
+            slots[index].rank = 1;
+        }
+    }
+
+    for (index = 0; index < count; index++)
+    {
+        if (slots[index].rank)
+        {
+            slots[index].rank = 0;
+            slots[index].cost = known ? total / known : 1;
+        }
+    }
+
+    qsort(slots, count, sizeof(ScheduleSlot), slot_compare);
+
+    for (index = 0; index < count; index++)
+    {
+        unsigned int lightest = 0;
+
+        for (shard = 1; shard < settings->shards; shard++)
+        {
+            if (settings->shard_load[shard] < settings->shard_load[lightest])
+                lightest = shard;
+        }
+
+        settings->shard_load[lightest] += slots[index].cost;
+        mine[slots[index].index] = lightest == settings->shard - 1;
+    }
+
+    /* Keep the tests in their original order */
+    for (index = 0, kept = 0; index < count; index++)
+    {
+        if (mine[index])
+            tests[kept++] = tests[index];
+    }
+
+    free(mine);
+    free(slots);
+
+    return kept;
+}
+
+/* A library being run: its selected tests, in the order they are
+   logged, and how far along starting and logging them it is */
+typedef struct LibraryRun
+{
+    const char* path;
+    MuLibrary* library;
+    MuTest** tests;
+    PendingTest* pending;
+    /* Order to start tests in, or NULL for the order they are logged in */
+    unsigned int* order;
+    unsigned int count;
+    unsigned int started;
+    unsigned int logged;
+    /* Tests still running in the background */
+    unsigned int running;
+    /* Why the library could not be loaded or set up, if it could not */
+    char* failure;
+    bool entered;
+    /* Set once no more of its tests will be started */
+    bool abandoned;
+    const char* current_suite;
+} LibraryRun;
+
+/* Loads a library, sets it up and picks out the tests to run from it.
+   A library which fails to load or set up is remembered as a failure
+   to log later; other errors are raised */
+static void
+library_open(RunSettings* settings, LibraryRun* run, const char* path, int setc, char** set, MuError** _err)
+{
+    MuError* err = NULL;
+    unsigned int index;
+    unsigned int count = 0;
+    MuTest** selected = NULL;
+
+    run->path = path;
+    run->library = mu_loader_open(settings->loader, path, &err);
 
     MU_CATCH(err, MU_ERROR_LOAD_LIBRARY)
     {
-        mu_logger_library_fail(logger, err->message);
-        failed++;
+        run->failure = strdup(err->message);
         MU_HANDLE(&err);
-        goto leave;
+        return;
+    }
+    MU_CATCH_ALL(err)
+    {
+        MU_RERAISE_RETURN_VOID(_err, err);
     }
 
-    mu_library_construct(library, &err);
+    mu_library_construct(run->library, &err);
 
     MU_CATCH(err, MU_ERROR_CONSTRUCT_LIBRARY)
     {
-        mu_logger_library_fail(logger, err->message);
-        failed++;
+        run->failure = strdup(err->message);
         MU_HANDLE(&err);
-        goto leave;
+        return;
     }
-
     MU_CATCH_ALL(err)
     {
-        MU_RERAISE_GOTO(error, _err, err);
+        MU_RERAISE_RETURN_VOID(_err, err);
     }
 
-    tests = mu_library_get_tests(library);
-    
-    if (tests)
+    run->tests = mu_library_get_tests(run->library);
+
+    if (!run->tests)
+        return;
+
+    qsort(run->tests, test_count(run->tests), sizeof(*run->tests), test_compare);
+
+    selected = xmalloc(sizeof(*selected) * test_count(run->tests));
+
+    for (index = 0; run->tests[index]; index++)
     {
-        qsort(tests, test_count(tests), sizeof(*tests), test_compare);
-        
-        unsigned int index;
-        const char* current_suite = NULL;
-        
-        for (index = 0; tests[index]; index++)
+        if (set == NULL || in_set(run->tests[index], setc, set))
+            selected[count++] = run->tests[index];
+    }
+
+    if (settings->shards)
+    {
+        count = shard_tests(settings, selected, count);
+    }
+
+    run->count = count;
+    run->pending = xcalloc(count ? count : 1, sizeof(PendingTest));
+
+    for (index = 0; index < count; index++)
+    {
+        run->pending[index].test = selected[index];
+        run->pending[index].library = run;
+    }
+
+    if (settings->history && settings->jobs > 1)
+    {
+        run->order = schedule_tests(settings->history, selected, count);
+    }
+
+    free(selected);
+}
+
+/* Logs the start of a library and any failure to load it */
+static unsigned int
+library_enter(RunSettings* settings, LibraryRun* run)
+{
+    run->entered = true;
+
+    /* Even if library loading failed, log that
+       we attempted to visit it */
+    mu_logger_library_enter(settings->logger, run->path, run->library);
+
+    if (run->failure)
+    {
+        mu_logger_library_fail(settings->logger, run->failure);
+        settings->failures++;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Tears down a library after its tests, logs the end of it and closes it */
+static unsigned int
+library_close(RunSettings* settings, LibraryRun* run, MuError** _err)
+{
+    MuError* err = NULL;
+    unsigned int failed = 0;
+
+    if (run->current_suite)
+        mu_logger_suite_leave(settings->logger);
+
+    if (run->library && !run->failure)
+    {
+        mu_library_destruct(run->library, &err);
+
+        MU_CATCH(err, MU_ERROR_DESTRUCT_LIBRARY)
         {
-            MuTestResult* summary = NULL;
-            MuTest* test = tests[index];
+            mu_logger_library_fail(settings->logger, err->message);
+            failed++;
+            settings->failures++;
+            MU_HANDLE(&err);
+        }
+        MU_CATCH_ALL(err)
+        {
+            MU_RERAISE_GOTO(error, _err, err);
+        }
+    }
 
-            if (set != NULL && !in_set(test, setc, set))
-                continue;
-            
-            if (current_suite == NULL || strcmp(current_suite, mu_test_suite(test)))
+    mu_logger_library_leave(settings->logger);
+
+error:
+
+    if (run->tests)
+        mu_library_free_tests(run->library, run->tests);
+
+    if (run->library)
+        mu_library_close(run->library);
+
+    free(run->failure);
+    free(run->order);
+    free(run->pending);
+
+    return failed;
+}
+
+/* Logs as much of a library as has finished, returning true once all
+   of it has been logged and it has been closed.  After the run has
+   been stopped, tests which never started are left out */
+static bool
+library_log(RunSettings* settings, LibraryRun* run, unsigned int* failed, MuError** _err)
+{
+    if (!run->entered)
+        *failed += library_enter(settings, run);
+
+    while (run->logged < run->count)
+    {
+        PendingTest* pending = &run->pending[run->logged];
+
+        if (pending->result || pending->lost)
+            *failed += log_pending(settings, &run->current_suite, pending);
+        else if (run->running || !(run->abandoned || run_stopped(settings)))
+            return false;
+
+        run->logged++;
+    }
+
+    *failed += library_close(settings, run, _err);
+
+    return true;
+}
+
+/* Starts the next test of a library, returning true if it is
+   running in the background */
+static bool
+library_start(RunSettings* settings, LibraryRun* run, MuLogLevel max_level)
+{
+    MuLoader* loader = settings->loader;
+    PendingTest* next = &run->pending[run->order ? run->order[run->started] : run->started];
+
+    run->started++;
+    adapt_timeout(settings, next->test);
+    gettimeofday(&next->started, NULL);
+
+    if (loader->dispatch_start(loader, next->test, event_buffer_cb, next, max_level))
+    {
+        run->running++;
+        return true;
+    }
+
+    next->result = loader->dispatch(loader, next->test, event_buffer_cb, next, max_level);
+    next->usec = elapsed_usec(&next->started);
+
+    if (test_failed(next->result))
+        settings->failures++;
+
+    return false;
+}
+
+/* Gives up on the tests still running in the background when the
+   loader can no longer report on them, and on starting any more */
+static void
+lose_running(RunSettings* settings, LibraryRun* runs, unsigned int count)
+{
+    unsigned int index, start;
+
+    for (index = 0; index < count; index++)
+    {
+        LibraryRun* run = &runs[index];
+
+        for (start = 0; start < run->started; start++)
+        {
+            PendingTest* pending = &run->pending[run->order ? run->order[start] : start];
+
+            if (!pending->result)
             {
-                if (current_suite)
-                    mu_logger_suite_leave(logger);
-                current_suite = mu_test_suite(test);
-                mu_logger_suite_enter(logger, mu_test_suite(test));
+                pending->lost = true;
+                settings->failures++;
             }
-            
-            mu_logger_test_enter(logger, test);
-            summary = loader->dispatch(loader, test, event_proxy_cb, logger,
-                                       mu_logger_max_log_level(logger));
-            mu_logger_test_leave(logger, test, summary);
+        }
 
-            if (summary->status != MU_STATUS_SKIPPED &&
-                    summary->status != summary->expected)
-                failed++;
+        run->running = 0;
+        run->abandoned = true;
+    }
+}
+
+/* Fetches the pages of libraries about to be loaded in the background */
+static void
+prefetch_libraries(char** files, unsigned int count)
+{
+#ifdef HAVE_POSIX_FADVISE
+    unsigned int index;
+    int fd;
 
-            loader->free_result(loader, summary);
+    for (index = 0; index < count; index++)
+    {
+        if ((fd = open(files[index], O_RDONLY)) >= 0)
+        {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+            close(fd);
         }
-        
-        if (current_suite)
-            mu_logger_suite_leave(logger);
     }
+#endif
+}
 
-    mu_library_destruct(library, &err);
+/* Runs the tests of several libraries which share a loader, keeping up
+   to settings->jobs of them running in the background at once.  When
+   the pool has room and the current library has no tests left to
+   start, the next library is loaded, set up and started on while the
+   tests before it are still running.  Each library is still logged
+   whole and in order, once all of its tests are done */
+static unsigned int
+run_pipelined(RunSettings* settings, char** files, unsigned int nfiles, int setc, char** set, MuError** _err)
+{
+    MuError* err = NULL;
+    MuLoader* loader = settings->loader;
+    MuLogLevel max_level = mu_logger_max_log_level(settings->logger);
+    LibraryRun* runs = xcalloc(nfiles, sizeof(LibraryRun));
+    PendingTest* done = NULL;
+    MuTestResult* result = NULL;
+    unsigned int opened = 0;
+    unsigned int starting = 0;
+    unsigned int logging = 0;
+    unsigned int running = 0;
+    unsigned int failed = 0;
 
-    MU_CATCH(err, MU_ERROR_DESTRUCT_LIBRARY)
+    prefetch_libraries(files, nfiles);
+    timeout_begin(settings);
+
+    for (;;)
     {
-        mu_logger_library_fail(logger, err->message);
-        failed++;
-        MU_HANDLE(&err);
-        goto leave;
+        /* Keep the pool of running tests full */
+        while (running < settings->jobs && !run_stopped(settings) && !err)
+        {
+            if (starting < opened && runs[starting].started == runs[starting].count)
+            {
+                starting++;
+            }
+            else if (starting < opened)
+            {
+                if (library_start(settings, &runs[starting], max_level))
+                    running++;
+            }
+            else if (opened < nfiles)
+            {
+                library_open(settings, &runs[opened], files[opened], setc, set, &err);
+                opened++;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        /* Log every library whose tests are all done, in order */
+        while (logging < opened && !err && library_log(settings, &runs[logging], &failed, &err))
+        {
+            logging++;
+        }
+
+        if (running)
+        {
+            if (!(result = loader->dispatch_wait(loader, (void**) &done)))
+            {
+                lose_running(settings, runs + logging, opened - logging);
+                mu_error_raise(&err, MU_ERROR_GENERAL,
+                               "Loader stopped reporting with %u tests still running", running);
+                break;
+            }
+
+            done->result = result;
+            done->usec = elapsed_usec(&done->started);
+            done->library->running--;
+            running--;
+
+            if (test_failed(result) && ++settings->failures == settings->max_failures &&
+                running && loader->dispatch_cancel)
+            {
+                loader->dispatch_cancel(loader);
+            }
+        }
+        else if (logging == opened && (opened == nfiles || run_stopped(settings) || err))
+        {
+            break;
+        }
     }
-    MU_CATCH_ALL(err)
+
+    /* Only left behind by an unexpected error, which ends the run.
+       Tests the loader lost track of are still logged as failures */
+    for (; logging < opened; logging++)
     {
-        MU_RERAISE_GOTO(error, _err, err);
-    }    
+        MuError* ignore = NULL;
 
-leave:
+        if (runs[logging].abandoned)
+        {
+            library_log(settings, &runs[logging], &failed, &ignore);
+        }
+        else
+        {
+            runs[logging].entered = true;
+            library_close(settings, &runs[logging], &ignore);
+        }
 
-    mu_logger_library_leave(logger);
-    
-error:
-    if (tests)
-        mu_library_free_tests(library, tests);
-   
-    if (library)
-        mu_library_close(library);
+        if (ignore)
+            MU_HANDLE(&ignore);
+    }
+
+    timeout_end(settings);
+    free(runs);
+
+    if (err)
+        MU_RERAISE_RETURN(failed, _err, err);
 
     return failed;
 }
 
+/* Runs the tests of a library one at a time */
+static unsigned int
+run_tests(RunSettings* settings, const char* path, int setc, char** set, MuError** _err)
+{
+    MuError* err = NULL;
+    MuLogger* logger = settings->logger;
+    MuLoader* loader = settings->loader;
+    LibraryRun run = {0};
+    unsigned int failed = 0;
+    unsigned int index;
+
+    library_open(settings, &run, path, setc, set, &err);
+
+    if (err)
+        MU_RERAISE_RETURN(0, _err, err);
+
+    failed += library_enter(settings, &run);
+    timeout_begin(settings);
+
+    for (index = 0; index < run.count && !run_stopped(settings); index++)
+    {
+        MuTestResult* summary = NULL;
+        MuTest* test = run.pending[index].test;
+        struct timeval started;
+        unsigned int result;
+
+        enter_suite(logger, &run.current_suite, test);
+
+        mu_logger_test_enter(logger, test);
+        adapt_timeout(settings, test);
+        gettimeofday(&started, NULL);
+        summary = loader->dispatch(loader, test, event_proxy_cb, logger,
+                                   mu_logger_max_log_level(logger));
+        result = finish_test(settings, test, summary, elapsed_usec(&started));
+        failed += result;
+        settings->failures += result;
+    }
+
+    timeout_end(settings);
+    failed += library_close(settings, &run, &err);
+
+    if (err)
+        MU_RERAISE_RETURN(failed, _err, err);
+
+    return failed;
+}
+
+/* Finds the loader for a library and passes on the run's settings */
+static MuLoader*
+find_loader(RunSettings* settings, const char* path)
+{
+    MuLoader* loader = mu_plugin_get_loader_for_file(path);
+
+    if (!loader)
+        return NULL;
+
+    if (settings->timeout && mu_loader_option_type(loader, "timeout") == MU_TYPE_INTEGER)
+    {
+        mu_loader_set_option(loader, "timeout", settings->timeout);
+    }
+
+    if (settings->iterations && mu_loader_option_type(loader, "iterations") == MU_TYPE_INTEGER)
+    {
+        mu_loader_set_option(loader, "iterations", settings->iterations);
+    }
+
+    if (settings->stress && mu_loader_option_type(loader, "stress") == MU_TYPE_INTEGER)
+    {
+        mu_loader_set_option(loader, "stress", settings->stress);
+    }
+
+    if (settings->debug && mu_loader_option_type(loader, "debug") == MU_TYPE_BOOLEAN)
+    {
+        mu_loader_set_option(loader, "debug", settings->debug);
+    }
+
+    if (settings->perf_counters && mu_loader_option_type(loader, "perf_counters") == MU_TYPE_BOOLEAN)
+    {
+        mu_loader_set_option(loader, "perf_counters", settings->perf_counters);
+    }
+
+    if (settings->capture_output && mu_loader_option_type(loader, "capture") == MU_TYPE_BOOLEAN)
+    {
+        mu_loader_set_option(loader, "capture", settings->capture_output);
+    }
+
+    if (settings->show_output && mu_loader_option_type(loader, "show_output") == MU_TYPE_BOOLEAN)
+    {
+        mu_loader_set_option(loader, "show_output", settings->show_output);
+    }
+
+    if (settings->benchmark_precision && mu_loader_option_type(loader, "benchmark_precision") == MU_TYPE_FLOAT)
+    {
+        mu_loader_set_option(loader, "benchmark_precision", settings->benchmark_precision);
+    }
+
+    return loader;
+}
+
 unsigned int
-run_all(RunSettings* settings, const char* path, MuError** _err)
+run_files(RunSettings* settings, array* files, int setc, char** set, MuError** _err)
 {
-    return run_tests(settings, path, 0, NULL, _err);
+    MuError* err = NULL;
+    unsigned int count = array_size(files);
+    MuLoader** loaders = xcalloc(count ? count : 1, sizeof(MuLoader*));
+    unsigned int failed = 0;
+    unsigned int index = 0;
+    unsigned int end;
+
+    while (index < count && !run_stopped(settings))
+    {
+        const char* file = files[index];
+
+        if (!loaders[index] && !(loaders[index] = find_loader(settings, file)))
+        {
+            MU_RAISE_GOTO(error, _err, MU_ERROR_GENERAL, "Could not find loader for file %s", basename_pure(file));
+        }
+
+        settings->loader = loaders[index];
+
+        if (settings->jobs > 1 && settings->loader->dispatch_start && settings->loader->dispatch_wait)
+        {
+            /* Run the following libraries with the same loader together */
+            for (end = index + 1; end < count; end++)
+            {
+                if (!loaders[end] && !(loaders[end] = find_loader(settings, files[end])))
+                    break;
+                if (loaders[end] != settings->loader)
+                    break;
+            }
+
+            failed += run_pipelined(settings, (char**) files + index, end - index, setc, set, &err);
+            index = end;
+        }
+        else
+        {
+            failed += run_tests(settings, file, setc, set, &err);
+            index++;
+        }
+
+        MU_PROPAGATE(error, _err, err);
+    }
+
+error:
+
+    free(loaders);
+
+    return failed;
 }
 
 void
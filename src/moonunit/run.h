@@ -31,15 +31,47 @@
 #include <moonunit/logger.h>
 #include <moonunit/loader.h>
 
+#include "history.h"
+#include "baseline.h"
+
 typedef struct
 {
     const char* self;
+    /* Loader of the library being run */
     MuLoader* loader;
     MuLogger* logger;
+    /* Passed on to loaders which have the matching options, unless 0 */
+    long timeout;
+    unsigned int iterations;
+    unsigned int stress;
+    bool debug;
+    bool perf_counters;
+    bool capture_output;
+    bool show_output;
+    double benchmark_precision;
+    /* Maximum number of tests to run concurrently */
+    unsigned int jobs;
+    /* Durations and results of past runs, or NULL */
+    History* history;
+    /* Timings to compare tests against, or NULL */
+    Baseline* baseline;
+    /* Shard of the tests to run (from 1), out of shards, or 0 to run all */
+    unsigned int shard, shards;
+    /* Estimated time given to each shard so far */
+    unsigned long* shard_load;
+    /* Multiple of the 99th percentile of a test's recorded durations to
+       time it out after, or 0 to leave timeouts to the loader */
+    double timeout_factor;
+    /* The loader's own timeout, while adapting it */
+    int default_timeout;
+    /* Stop once this many failures are seen, or 0 to run everything */
+    unsigned int max_failures;
+    /* Failures seen so far */
+    unsigned int failures;
 } RunSettings;
 
-unsigned int run_tests(RunSettings* settings, const char* path, int setc, char** set, MuError** _err);
-unsigned int run_all(RunSettings* settings, const char* path, MuError** _err);
+unsigned int run_files(RunSettings* settings, array* files, int setc, char** set, MuError** _err);
+bool run_stopped(RunSettings* settings);
 void print_tests(MuLoader* loader, const char* path, int setc, char** set, MuError** _err);
 
 #endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#    include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+#    include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+#    include <sys/sendfile.h>
+#endif
+
+#include <moonunit/private/util.h>
+
+#include "attach.h"
+
+int
+attach_new(void)
+{
+#ifdef HAVE_MEMFD_CREATE
+    int fd = memfd_create("moonunit-attachment", MFD_CLOEXEC);
+
+    if (fd >= 0 || errno != ENOSYS)
+        return fd;
+#endif
+    {
+        char path[] = "/tmp/moonunit-attachment-XXXXXX";
+        int fd = mkstemp(path);
+
+        if (fd >= 0)
+            unlink(path);
+
+        return fd;
+    }
+}
+
+static
+int
+attach_write(int out, const void* data, size_t length)
+{
+    ssize_t amount;
+
+    while (length)
+    {
+        amount = write(out, data, length);
+
+        if (amount < 0 && errno == EINTR)
+            continue;
+        else if (amount <= 0)
+            return -1;
+
+        data = (const char*) data + amount;
+        length -= amount;
+    }
+
+    return 0;
+}
+
+static
+int
+attach_copy(int out, int fd)
+{
+    char buffer[4096];
+    ssize_t amount;
+
+#ifdef HAVE_SENDFILE
+    /* Works from any file into another, without the contents
+       coming up into this process */
+    while ((amount = sendfile(out, fd, NULL, 1 << 30)) != 0)
+    {
+        if (amount < 0 && errno == EINTR)
+            continue;
+        else if (amount < 0 && (errno == EINVAL || errno == ENOSYS))
+            break;
+        else if (amount < 0)
+            return -1;
+    }
+
+    if (amount == 0)
+        return 0;
+#endif
+
+    while ((amount = read(fd, buffer, sizeof(buffer))) != 0)
+    {
+        if (amount < 0 && errno == EINTR)
+            continue;
+        else if (amount < 0 || attach_write(out, buffer, amount))
+            return -1;
+    }
+
+    return 0;
+}
+
+int
+attach_capture(int fd, const void* data, size_t length)
+{
+    int out = attach_new();
+
+    if (out < 0)
+        return -1;
+
+    if ((fd >= 0 ? attach_copy(out, fd) : attach_write(out, data, length)) ||
+        lseek(out, 0, SEEK_SET) < 0)
+    {
+        close(out);
+        return -1;
+    }
+
+    return out;
+}
+
+void
+attach_append(MuTestAttachment** list, const char* name, int fd)
+{
+    MuTestAttachment* attachment = xmalloc(sizeof(*attachment));
+    struct stat info;
+
+    attachment->name = safe_strdup(name);
+    attachment->fd = fd;
+    attachment->size = fstat(fd, &info) ? 0 : info.st_size;
+    attachment->next = NULL;
+
+    while (*list)
+    {
+        list = &(*list)->next;
+    }
+
+    *list = attachment;
+}
+
+void
+attach_free(MuTestAttachment* list)
+{
+    MuTestAttachment* next;
+
+    for (; list; list = next)
+    {
+        next = list->next;
+        close(list->fd);
+        free((char*) list->name);
+        free(list);
+    }
+}
@@ -0,0 +1,624 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#    include <config.h>
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#ifdef HAVE_SCHED_H
+#    include <sched.h>
+#endif
+
+#include <moonunit/private/util.h>
+
+#include "benchmark.h"
+
+/* Time spent warming up before any samples are taken */
+#define WARMUP_NSEC 50000000.0
+/* Time each sample should take, long enough to swamp clock overhead */
+#define SAMPLE_NSEC 5000000.0
+/* Time to keep taking samples for, once the minimum is reached */
+#define MEASURE_NSEC 500000000.0
+#define MIN_SAMPLES 10
+/* CPU time each sample of a complexity measurement should take */
+#define COMPLEXITY_SAMPLE_NSEC 5000000.0
+/* Samples taken of each size, of which the median counts */
+#define COMPLEXITY_SAMPLES 11
+/* How much worse than the best fit a simpler fit may be and still be
+   chosen, relative to the best and in absolute relative error */
+#define COMPLEXITY_SLACK 1.5
+#define COMPLEXITY_NOISE 0.02
+/* How many times worse the best fit within the bound must be than one
+   beyond it, and how many times the standard error of the medians its
+   error must exceed, before the bound counts as exceeded */
+#define COMPLEXITY_MARGIN 2.0
+#define COMPLEXITY_SIGNIFICANCE 3.0
+
+double
+benchmark_now_nsec(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+#endif
+}
+
+static double
+time_calls(MuThunk op, unsigned long count)
+{
+    double start = benchmark_now_nsec();
+    unsigned long i;
+
+    for (i = 0; i < count; i++)
+    {
+        op();
+    }
+
+    return benchmark_now_nsec() - start;
+}
+
+/* Returns the CPU time used by the calling thread, so that measurements
+   which only care how time grows are not thrown off by other processes
+   taking turns on the CPU partway through */
+static double
+thread_cpu_nsec(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return ts.tv_sec * 1e9 + ts.tv_nsec;
+#endif
+
+    return benchmark_now_nsec();
+}
+
+static double
+time_sized_calls(MuSizedThunk op, unsigned long size, void* data, unsigned long count)
+{
+    double start = thread_cpu_nsec();
+    unsigned long i;
+
+    for (i = 0; i < count; i++)
+    {
+        op(size, data);
+    }
+
+    return thread_cpu_nsec() - start;
+}
+
+/* Returns how many calls to time next when the last count took elapsed
+   nanoseconds and a sample should take target */
+static unsigned long
+grow_iterations(unsigned long iterations, double elapsed, double target)
+{
+    double scale = elapsed > 0 ? target * 1.2 / elapsed : 10;
+
+    if (scale > 10)
+        scale = 10;
+    else if (scale < 2)
+        scale = 2;
+
+    return (unsigned long) (iterations * scale);
+}
+
+static int
+compare_double(const void* _a, const void* _b)
+{
+    double a = *(const double*) _a;
+    double b = *(const double*) _b;
+
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+/* Two-sided 95% critical value of Student's t distribution */
+static double
+t_critical(unsigned int df)
+{
+    static const double table[] =
+    {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+
+    if (df == 0)
+        return 0;
+    else if (df <= sizeof(table) / sizeof(*table))
+        return table[df - 1];
+    else
+        return 1.960;
+}
+
+static void
+benchmark_statistics(MuTestBenchmark* result)
+{
+    double sorted[MU_BENCHMARK_MAX_SAMPLES];
+    unsigned int n = result->samples;
+    double sum = 0, squares = 0, margin;
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+    {
+        sum += result->sample[i];
+    }
+
+    result->mean = sum / n;
+
+    for (i = 0; i < n; i++)
+    {
+        squares += (result->sample[i] - result->mean) * (result->sample[i] - result->mean);
+    }
+
+    result->stddev = n > 1 ? sqrt(squares / (n - 1)) : 0;
+
+    memcpy(sorted, result->sample, n * sizeof(*sorted));
+    qsort(sorted, n, sizeof(*sorted), compare_double);
+
+    result->median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    /* Nearest rank */
+    result->p99 = sorted[(99 * n + 99) / 100 - 1];
+
+    margin = t_critical(n - 1) * result->stddev / sqrt(n);
+    result->ci_low = result->mean - margin;
+    result->ci_high = result->mean + margin;
+}
+
+/* Reads the first line of a small file into buffer */
+static bool
+read_line(const char* path, char* buffer, size_t size)
+{
+    FILE* file = fopen(path, "r");
+    bool ok;
+
+    if (!file)
+        return false;
+
+    ok = fgets(buffer, size, file) != NULL;
+    fclose(file);
+
+    if (ok)
+        buffer[strcspn(buffer, "\n")] = '\0';
+
+    return ok;
+}
+
+static long
+involuntary_switches(void)
+{
+    struct rusage ru;
+
+    return getrusage(RUSAGE_SELF, &ru) ? 0 : ru.ru_nivcsw;
+}
+
+/* Notes what else might be disturbing the measurements */
+static void
+benchmark_environment(MuTestBenchmark* result)
+{
+    char buffer[256];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    char* path;
+
+#ifdef HAVE_SCHED_GETCPU
+    result->cpu = sched_getcpu();
+#else
+    result->cpu = -1;
+#endif
+
+    if (read_line("/proc/loadavg", buffer, sizeof(buffer)))
+    {
+        result->load = atof(buffer) / (cpus > 0 ? cpus : 1);
+    }
+
+    if (result->cpu >= 0)
+    {
+        path = format("/sys/devices/system/cpu/cpu%i/cpufreq/scaling_governor", result->cpu);
+        result->frequency_scaling =
+            read_line(path, buffer, sizeof(buffer)) && strcmp(buffer, "performance");
+        free(path);
+    }
+}
+
+void
+benchmark_measure(MuThunk op, double precision, MuTestBenchmark* result)
+{
+    unsigned long iterations = 1;
+    double started, elapsed;
+    long switches;
+
+    memset(result, 0, sizeof(*result));
+
+    started = benchmark_now_nsec();
+
+    /* Grow the number of calls per sample until a sample takes long
+       enough to time reliably.  This also warms up caches, branch
+       predictors and lazily bound symbols */
+    while ((elapsed = time_calls(op, iterations)) < SAMPLE_NSEC)
+    {
+        iterations = grow_iterations(iterations, elapsed, SAMPLE_NSEC);
+    }
+
+    while (benchmark_now_nsec() - started < WARMUP_NSEC)
+    {
+        time_calls(op, iterations);
+    }
+
+    benchmark_environment(result);
+
+    started = benchmark_now_nsec();
+    switches = involuntary_switches();
+
+    while (result->samples < MU_BENCHMARK_MAX_SAMPLES)
+    {
+        result->sample[result->samples++] = time_calls(op, iterations) / iterations;
+
+        if (result->samples < MIN_SAMPLES)
+            continue;
+
+        if (precision > 0)
+        {
+            /* Stop as soon as the mean is known well enough */
+            benchmark_statistics(result);
+            if ((result->ci_high - result->mean) * 100 <= precision * result->mean)
+            {
+                result->converged = true;
+                break;
+            }
+        }
+        else if (benchmark_now_nsec() - started >= MEASURE_NSEC)
+        {
+            break;
+        }
+    }
+
+    result->preemptions = involuntary_switches() - switches;
+    result->iterations = iterations;
+
+    benchmark_statistics(result);
+}
+
+static double
+complexity_term(MuComplexity complexity, double n)
+{
+    if (n < 1)
+        n = 1;
+
+    switch (complexity)
+    {
+    case MU_COMPLEXITY_LOGARITHMIC:
+        return log2(n);
+    case MU_COMPLEXITY_LINEAR:
+        return n;
+    case MU_COMPLEXITY_LINEARITHMIC:
+        return n * log2(n);
+    case MU_COMPLEXITY_QUADRATIC:
+        return n * n;
+    case MU_COMPLEXITY_CONSTANT:
+    default:
+        return 1;
+    }
+}
+
+/* Fits time = constant + coefficient * term(size) by least squares on the
+   relative error, so that small sizes count as much as large ones, and
+   returns the root mean square relative error of the fit */
+static double
+complexity_fit_one(MuTestComplexity* result, MuComplexity complexity,
+                   double* constant, double* coefficient)
+{
+    double s = 0, sf = 0, st = 0, sff = 0, sft = 0;
+    double weight, term, residual, error = 0, determinant;
+    unsigned int i;
+
+    for (i = 0; i < result->sizes; i++)
+    {
+        weight = 1 / (result->time[i] * result->time[i]);
+        term = complexity_term(complexity, result->size[i]);
+
+        s += weight;
+        sf += weight * term;
+        st += weight * result->time[i];
+        sff += weight * term * term;
+        sft += weight * term * result->time[i];
+    }
+
+    determinant = s * sff - sf * sf;
+
+    *coefficient = 0;
+
+    if (complexity != MU_COMPLEXITY_CONSTANT && determinant > 0)
+        *coefficient = (s * sft - sf * st) / determinant;
+
+    /* Time that shrinks with size is no growth at all */
+    if (*coefficient < 0)
+        *coefficient = 0;
+
+    *constant = (st - *coefficient * sf) / s;
+
+    for (i = 0; i < result->sizes; i++)
+    {
+        term = complexity_term(complexity, result->size[i]);
+        residual = (result->time[i] - *constant - *coefficient * term) / result->time[i];
+        error += residual * residual;
+    }
+
+    return sqrt(error / result->sizes);
+}
+
+/* Picks the simplest complexity which fits nearly as well as the best,
+   since the more complex ones can always match noise a little better.
+   The bound is only exceeded if the best fit beyond it beats the best
+   within it by a wide margin, and the one within it misses by far more
+   than the medians could be off by; a worse complexity which merely fits better
+   leaves the result inconclusive */
+static void
+complexity_fit(MuTestComplexity* result)
+{
+    double constant[MU_COMPLEXITY_QUADRATIC + 1];
+    double coefficient[MU_COMPLEXITY_QUADRATIC + 1];
+    double error[MU_COMPLEXITY_QUADRATIC + 1];
+    double best = HUGE_VAL, within = HUGE_VAL, beyond = HUGE_VAL;
+    int complexity, worse = MU_COMPLEXITY_QUADRATIC;
+
+    for (complexity = MU_COMPLEXITY_CONSTANT; complexity <= MU_COMPLEXITY_QUADRATIC; complexity++)
+    {
+        error[complexity] = complexity_fit_one(result, complexity,
+                                               &constant[complexity], &coefficient[complexity]);
+        if (error[complexity] < best)
+            best = error[complexity];
+
+        if (complexity <= (int) result->bound && error[complexity] < within)
+        {
+            within = error[complexity];
+        }
+        else if (complexity > (int) result->bound && error[complexity] < beyond)
+        {
+            beyond = error[complexity];
+            worse = complexity;
+        }
+    }
+
+    for (complexity = MU_COMPLEXITY_CONSTANT; complexity <= MU_COMPLEXITY_QUADRATIC; complexity++)
+    {
+        if (error[complexity] <= best * COMPLEXITY_SLACK + COMPLEXITY_NOISE)
+            break;
+    }
+
+    if (beyond < within)
+    {
+        result->exceeded = within >= beyond * COMPLEXITY_MARGIN &&
+            within >= result->noise * COMPLEXITY_SIGNIFICANCE + COMPLEXITY_NOISE;
+        result->inconclusive = !result->exceeded;
+
+        /* Report the fit which exceeded the bound, even if a
+           simpler one would otherwise have been close enough */
+        if (result->exceeded && complexity <= (int) result->bound)
+            complexity = worse;
+    }
+
+    result->fit = complexity;
+    result->constant = constant[complexity];
+    result->coefficient = coefficient[complexity];
+    result->error = error[complexity];
+}
+
+void
+benchmark_complexity(MuSizedThunk op, void* data, MuComplexity bound,
+                     const unsigned long* sizes, unsigned int count,
+                     MuTestComplexity* result)
+{
+    double samples[MU_COMPLEXITY_MAX_SIZES][COMPLEXITY_SAMPLES];
+    unsigned long iterations[MU_COMPLEXITY_MAX_SIZES];
+    double elapsed, median, spread, noise = 0;
+    unsigned int i, j;
+
+    memset(result, 0, sizeof(*result));
+    result->bound = bound;
+
+    if (count > MU_COMPLEXITY_MAX_SIZES)
+        count = MU_COMPLEXITY_MAX_SIZES;
+
+    for (i = 0; i < count; i++)
+    {
+        /* As for benchmarks, calibrating warms things up too */
+        iterations[i] = 1;
+        while ((elapsed = time_sized_calls(op, sizes[i], data, iterations[i])) < COMPLEXITY_SAMPLE_NSEC)
+        {
+            iterations[i] = grow_iterations(iterations[i], elapsed, COMPLEXITY_SAMPLE_NSEC);
+        }
+    }
+
+    /* Take turns between the sizes, so that anything which slows the
+       machine down for a while affects them all alike rather than
+       bending the curve at whichever size was being timed */
+    for (j = 0; j < COMPLEXITY_SAMPLES; j++)
+    {
+        for (i = 0; i < count; i++)
+        {
+            samples[i][j] = time_sized_calls(op, sizes[i], data, iterations[i]) / iterations[i];
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        qsort(samples[i], COMPLEXITY_SAMPLES, sizeof(*samples[i]), compare_double);
+
+        /* Keep the fit's weights finite for workloads too quick to time */
+        median = samples[i][COMPLEXITY_SAMPLES / 2] > 0 ? samples[i][COMPLEXITY_SAMPLES / 2] : 1e-3;
+        /* Standard error of the median relative to it, estimating the
+           standard deviation from the interquartile range */
+        spread = (samples[i][COMPLEXITY_SAMPLES * 3 / 4] - samples[i][COMPLEXITY_SAMPLES / 4]) / 1.349 *
+            1.253 / sqrt(COMPLEXITY_SAMPLES) / median;
+        noise += spread * spread;
+
+        result->size[i] = sizes[i];
+        result->time[i] = median;
+    }
+
+    result->sizes = count;
+    result->noise = count ? sqrt(noise / count) : 0;
+
+    complexity_fit(result);
+}
+
+#ifdef HAVE_SCHED_SETAFFINITY
+
+static bool cpus_known = false;
+/* CPUs the loader could run on to begin with */
+static cpu_set_t cpus_all;
+/* CPUs for benchmarks not yet claimed by one */
+static cpu_set_t cpus_free;
+
+/* Adds the CPUs in a list such as "2-3,6" to set */
+static int
+parse_cpu_list(const char* list, cpu_set_t* set)
+{
+    int count = 0;
+    int first, last;
+    char* end;
+
+    while (*list)
+    {
+        first = last = (int) strtol(list, &end, 10);
+        if (end == list)
+            break;
+        if (*end == '-')
+            last = (int) strtol(end + 1, &end, 10);
+        for (; first <= last && first < CPU_SETSIZE; first++, count++)
+            CPU_SET(first, set);
+        list = *end == ',' ? end + 1 : end;
+    }
+
+    return count;
+}
+
+static void
+benchmark_cpus_init(void)
+{
+    char buffer[1024];
+
+    CPU_ZERO(&cpus_all);
+    CPU_ZERO(&cpus_free);
+
+    sched_getaffinity(0, sizeof(cpus_all), &cpus_all);
+
+    /* CPUs set aside with isolcpus= have nothing else scheduled on them */
+    if (!read_line("/sys/devices/system/cpu/isolated", buffer, sizeof(buffer)) ||
+        !parse_cpu_list(buffer, &cpus_free))
+    {
+        CPU_OR(&cpus_free, &cpus_free, &cpus_all);
+
+        /* Otherwise avoid the first CPU, which usually fields more interrupts */
+        if (CPU_COUNT(&cpus_free) > 1)
+            CPU_CLR(0, &cpus_free);
+    }
+
+    cpus_known = true;
+}
+
+int
+benchmark_cpu_claim(void)
+{
+    int cpu;
+
+    if (!cpus_known)
+        benchmark_cpus_init();
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &cpus_free))
+        {
+            CPU_CLR(cpu, &cpus_free);
+            return cpu;
+        }
+    }
+
+    return -1;
+}
+
+void
+benchmark_cpu_release(int cpu)
+{
+    if (cpu >= 0)
+        CPU_SET(cpu, &cpus_free);
+}
+
+void
+benchmark_pin(pid_t pid, int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0)
+    {
+        sched_setaffinity(pid, sizeof(cpus_all), &cpus_all);
+    }
+    else
+    {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        sched_setaffinity(pid, sizeof(set), &set);
+    }
+}
+
+#else
+
+int
+benchmark_cpu_claim(void)
+{
+    return -1;
+}
+
+void
+benchmark_cpu_release(int cpu)
+{
+}
+
+void
+benchmark_pin(pid_t pid, int cpu)
+{
+}
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __MU_BENCHMARK_H__
+#define __MU_BENCHMARK_H__
+
+#include <sys/types.h>
+#include <moonunit/test.h>
+
+/* Reads the monotonic clock, in nanoseconds */
+double benchmark_now_nsec(void);
+
+/* Warms up and times repeated calls to op, filling in result.  If precision
+   is not 0, samples are taken until the confidence interval of the mean is
+   within that percentage of it, or the most samples have been taken */
+void benchmark_measure(MuThunk op, double precision, MuTestBenchmark* result);
+
+/* Times calls to op with each of the sizes, fits the timings to the
+   complexity classes and judges whether they grew faster than bound */
+void benchmark_complexity(MuSizedThunk op, void* data, MuComplexity bound,
+                          const unsigned long* sizes, unsigned int count,
+                          MuTestComplexity* result);
+
+/* Picks a CPU for a benchmark to have to itself, or returns -1 if none is free */
+int benchmark_cpu_claim(void);
+void benchmark_cpu_release(int cpu);
+/* Restricts a process to one CPU, or lets it run anywhere again if cpu is -1 */
+void benchmark_pin(pid_t pid, int cpu);
+
+#endif
@@ -66,6 +66,7 @@ add(MuEntryInfo* entry, CLibrary* library, MuError **_err)
     switch (entry->type)
     {
     case MU_ENTRY_TEST:
+    case MU_ENTRY_BENCHMARK:
     {
         CTest* test = ctest_new(library, entry);
 
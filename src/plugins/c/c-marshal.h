@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __CMARSHAL_H__
+#define __CMARSHAL_H__
+
+#include <moonunit/test.h>
+#include <uipc/generate.h>
+
+/* Results, backtraces and events are sent for every test, so
+   these get marshalling code of their own */
+#define BACKTRACE_FIELDS(X, T)                  \
+    X(STRING, T, file_name, 0)                  \
+    X(STRING, T, func_name, 0)                  \
+    X(POINTER, T, up, &backtrace_info)
+
+UIPC_GENERATE(backtrace, MuBacktrace, BACKTRACE_FIELDS)
+
+static uipc_typeinfo usage_info =
+{
+    .name = "MuTestUsage",
+    .size = sizeof(MuTestUsage),
+    .members =
+    {
+        UIPC_END
+    }
+};
+
+static uipc_typeinfo counters_info =
+{
+    .name = "MuTestCounters",
+    .size = sizeof(MuTestCounters),
+    .members =
+    {
+        UIPC_END
+    }
+};
+
+static uipc_typeinfo benchmark_info =
+{
+    .name = "MuTestBenchmark",
+    .size = sizeof(MuTestBenchmark),
+    .members =
+    {
+        UIPC_END
+    }
+};
+
+static uipc_typeinfo complexity_info =
+{
+    .name = "MuTestComplexity",
+    .size = sizeof(MuTestComplexity),
+    .members =
+    {
+        UIPC_END
+    }
+};
+
+static uipc_typeinfo stress_info =
+{
+    .name = "MuTestStress",
+    .size = sizeof(MuTestStress),
+    .members =
+    {
+        UIPC_END
+    }
+};
+
+/* Histograms run to many buckets of small numbers, so send them compactly */
+static uipc_typeinfo bucket_info =
+{
+    .name = "MuMetricBucket",
+    .size = sizeof(MuMetricBucket),
+    .members =
+    {
+        UIPC_VARINT(MuMetricBucket, upper),
+        UIPC_VARINT(MuMetricBucket, count),
+        UIPC_END
+    }
+};
+
+static uipc_typeinfo metric_info =
+{
+    .name = "MuTestMetric",
+    .size = sizeof(MuTestMetric),
+    .members =
+    {
+        UIPC_STRING(MuTestMetric, name),
+        UIPC_ARRAY(MuTestMetric, buckets, bucket_count, &bucket_info),
+        UIPC_POINTER(MuTestMetric, next, &metric_info),
+        UIPC_END
+    }
+};
+
+#define TESTRESULT_FIELDS(X, T)                 \
+    X(STRING, T, file, 0)                       \
+    X(STRING, T, reason, 0)                     \
+    X(POINTER, T, backtrace, &backtrace_info)   \
+    X(POINTER, T, usage, &usage_info)           \
+    X(POINTER, T, counters, &counters_info)     \
+    X(POINTER, T, benchmark, &benchmark_info)   \
+    X(POINTER, T, complexity, &complexity_info) \
+    X(POINTER, T, stress, &stress_info)         \
+    X(POINTER, T, metrics, &metric_info)
+
+UIPC_GENERATE(testresult, MuTestResult, TESTRESULT_FIELDS)
+
+#define LOGEVENT_FIELDS(X, T)                   \
+    X(STRING, T, file, 0)                       \
+    X(STRING, T, message, 0)
+
+UIPC_GENERATE(logevent, MuLogEvent, LOGEVENT_FIELDS)
+
+#endif
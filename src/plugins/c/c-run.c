@@ -41,27 +41,61 @@
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <errno.h>
+#include <poll.h>
 #ifdef HAVE_SIGNAL_H
 #    include <signal.h>
 #endif
 #include <stdarg.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#ifdef HAVE_SYS_EPOLL_H
+#    include <sys/epoll.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+#    include <sys/syscall.h>
+#endif
 #include <pthread.h>
 
 #include "backtrace.h"
+#include "benchmark.h"
+#include "metric.h"
+#include "attach.h"
 #include "c-token.h"
 #include "c-load.h"
 #include "c-run.h"
+#include "c-marshal.h"
 
 #ifdef CPLUSPLUS_ENABLED
 #    include "cplusplus.h"
 #endif
 
+#ifdef SYS_pidfd_open
+#    define HAVE_PIDFD
+#endif
+
 static long default_timeout = 2000;
 static unsigned int default_iterations = 1;
+/* Copies of each test to run at once after it runs alone, or 0 for none */
+static unsigned int default_stress = 0;
 static bool is_debug = false;
+static bool use_zygote = false;
+static bool use_batch = false;
+static bool use_perf = false;
+/* Whether children send events through shared memory */
+static bool use_ring = false;
+/* Whether the output of children goes into a file for each test rather
+   than the terminal, and whether it is reported when the test passes */
+static bool use_capture = false;
+static bool show_output = false;
+/* Percentage the confidence interval of a benchmark should narrow to,
+   with benchmarks pinned to CPUs of their own, or 0 to do neither */
+static double benchmark_precision = 0;
 static MuInterfaceToken* current_token;
 
 typedef struct
@@ -79,67 +113,60 @@ typedef struct
     unsigned int count;
 } IterationsMsg;
 
-static uipc_typeinfo backtrace_info =
+typedef struct
 {
-    .name = "MuBacktrace",
-    .size = sizeof(MuBacktrace),
-    .members =
-    {
-        UIPC_STRING(MuBacktrace, file_name),
-        UIPC_STRING(MuBacktrace, func_name),
-        UIPC_POINTER(MuBacktrace, up, &backtrace_info),
-        UIPC_END
-    }
-};
+    MuTest* test;
+    MuLogLevel max_level;
+} RunMsg;
+
+/* Names the contents of the descriptor passed along with it */
+typedef struct
+{
+    const char* name;
+} AttachMsg;
 
-static uipc_typeinfo testresult_info =
+static uipc_typeinfo timeout_info =
 {
-    .name = "MuTestResult",
-    .size = sizeof(MuTestResult),
+    .size = sizeof(TimeoutMsg),
     .members =
     {
-        UIPC_STRING(MuTestResult, file),
-        UIPC_STRING(MuTestResult, reason),
-        UIPC_POINTER(MuTestResult, backtrace, &backtrace_info),
         UIPC_END
     }
 };
 
-static uipc_typeinfo logevent_info =
+static uipc_typeinfo iterations_info =
 {
-    .size = sizeof(MuLogEvent),
+    .size = sizeof(IterationsMsg),
     .members =
     {
-        UIPC_STRING(MuLogEvent, file),
-        UIPC_STRING(MuLogEvent, message),
         UIPC_END
     }
 };
 
-
-static uipc_typeinfo timeout_info =
+static uipc_typeinfo expect_info =
 {
-    .size = sizeof(TimeoutMsg),
+    .size = sizeof(ExpectMsg),
     .members =
     {
         UIPC_END
     }
 };
 
-static uipc_typeinfo iterations_info =
+static uipc_typeinfo run_info =
 {
-    .size = sizeof(IterationsMsg),
+    .size = sizeof(RunMsg),
     .members =
     {
         UIPC_END
     }
 };
 
-static uipc_typeinfo expect_info =
+static uipc_typeinfo attach_info =
 {
-    .size = sizeof(ExpectMsg),
+    .size = sizeof(AttachMsg),
     .members =
     {
+        UIPC_STRING(AttachMsg, name),
         UIPC_END
     }
 };
@@ -149,6 +176,14 @@ static uipc_typeinfo expect_info =
 #define MSG_TYPE_TIMEOUT 2
 #define MSG_TYPE_EXPECT 3
 #define MSG_TYPE_ITERATIONS 4
+#define MSG_TYPE_RUN 5
+#define MSG_TYPE_READY 6
+#define MSG_TYPE_ATTACH 7
+
+/* Messages to the parent are held back until there are this many bytes
+   of them, they have waited this long or something must go out at once */
+#define QUEUE_BYTES (64 * 1024)
+#define QUEUE_NSEC 10000000.0
 
 static MuInterfaceToken*
 ctoken_current(void* data)
@@ -156,6 +191,27 @@ ctoken_current(void* data)
     return (MuInterfaceToken*) data;
 }
 
+/* Queues a message for the parent, replacing the last one queued if it is
+   of the same type and latest is set, and sends the queue if it is due */
+static
+void
+ctoken_queue_fork(CTokenFork* token, uipc_message* message, bool latest)
+{
+    uipc_handle* ipc_handle = token->ipc_handle;
+    double now = benchmark_now_nsec();
+
+    if (!uipc_queued(ipc_handle))
+        token->queued_since = now;
+
+    if (latest)
+        uipc_queue_latest(ipc_handle, message);
+    else
+        uipc_queue(ipc_handle, message);
+
+    if (uipc_queued(ipc_handle) >= QUEUE_BYTES || now - token->queued_since >= QUEUE_NSEC)
+        uipc_flush(ipc_handle, NULL);
+}
+
 static
 void
 ctoken_event_fork(MuInterfaceToken* _token, const MuLogEvent* event)
@@ -172,14 +228,110 @@ ctoken_event_fork(MuInterfaceToken* _token, const MuLogEvent* event)
 
     ((MuLogEvent*) event)->stage = token->current_stage;    
 
-    uipc_message* message = uipc_msg_new(MSG_TYPE_EVENT);
-    uipc_msg_set_payload(message, event, &logevent_info);
-    uipc_send(ipc_handle, message, NULL);
-    uipc_msg_free(message);
+    if (!token->ring)
+    {
+        uipc_message* message = uipc_msg_new(MSG_TYPE_EVENT);
+        uipc_msg_set_payload(message, event, &logevent_info);
+        ctoken_queue_fork(token, message, false);
+        uipc_msg_free(message);
+    }
+    /* Events too large for the ring go over the socket, at once, and
+       the parent holds back what follows in the ring until they arrive */
+    else if (!ring_write(token->ring, MSG_TYPE_EVENT, event, &logevent_info))
+    {
+        uipc_message* message = uipc_msg_new(MSG_TYPE_EVENT);
+        uipc_msg_set_payload(message, event, &logevent_info);
+        uipc_send(ipc_handle, message, NULL);
+        uipc_msg_free(message);
+    }
 
     pthread_mutex_unlock(&token->lock);
 }
 
+/* Fills in usage from what the system reports for a process */
+static void
+usage_from_rusage(MuTestUsage* usage, struct rusage* ru)
+{
+    usage->user_usec = ru->ru_utime.tv_sec * 1000000UL + ru->ru_utime.tv_usec;
+    usage->system_usec = ru->ru_stime.tv_sec * 1000000UL + ru->ru_stime.tv_usec;
+#ifdef __APPLE__
+    /* Reported in bytes rather than kilobytes */
+    usage->max_rss = ru->ru_maxrss / 1024;
+#else
+    usage->max_rss = ru->ru_maxrss;
+#endif
+    usage->minor_faults = ru->ru_minflt;
+    usage->major_faults = ru->ru_majflt;
+    usage->voluntary_switches = ru->ru_nvcsw;
+    usage->involuntary_switches = ru->ru_nivcsw;
+}
+
+/* Reads the I/O counters of this process, where the system keeps them.
+   This runs from signal handlers, so it sticks to plain system calls */
+static void
+usage_read_io(MuTestUsage* usage)
+{
+    char buffer[512];
+    char* line;
+    ssize_t length;
+    int fd;
+
+    usage->read_bytes = -1;
+    usage->write_bytes = -1;
+
+    if ((fd = open("/proc/self/io", O_RDONLY)) < 0)
+        return;
+
+    length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+
+    if (length <= 0)
+        return;
+
+    buffer[length] = '\0';
+
+    for (line = buffer; line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL)
+    {
+        if (!strncmp(line, "rchar: ", 7))
+            usage->read_bytes = strtoll(line + 7, NULL, 10);
+        else if (!strncmp(line, "wchar: ", 7))
+            usage->write_bytes = strtoll(line + 7, NULL, 10);
+    }
+}
+
+/* Measures this process so far */
+static void
+usage_sample(MuTestUsage* usage)
+{
+    struct rusage ru;
+
+    memset(usage, 0, sizeof(*usage));
+
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+        usage_from_rusage(usage, &ru);
+
+    usage_read_io(usage);
+}
+
+/* Turns a sample into the usage since an earlier one.  Peak memory
+   cannot be split up this way, so it stays as it is */
+static void
+usage_since(MuTestUsage* usage, MuTestUsage* start)
+{
+    usage->user_usec -= start->user_usec;
+    usage->system_usec -= start->system_usec;
+    usage->minor_faults -= start->minor_faults;
+    usage->major_faults -= start->major_faults;
+    usage->voluntary_switches -= start->voluntary_switches;
+    usage->involuntary_switches -= start->involuntary_switches;
+
+    if (usage->read_bytes >= 0 && start->read_bytes >= 0)
+    {
+        usage->read_bytes -= start->read_bytes;
+        usage->write_bytes -= start->write_bytes;
+    }
+}
+
 static void ctoken_free_fork(CTokenFork* token);
 
 static
@@ -188,22 +340,65 @@ ctoken_result_fork(MuInterfaceToken* _token, const MuTestResult* summary)
 {    
     CTokenFork* token = (CTokenFork*) _token;
     uipc_handle* ipc_handle = token->ipc_handle;
+    MuTestUsage usage;
+    MuTestCounters counters;
 
     assert(ipc_handle != NULL);
 
     pthread_mutex_lock(&token->lock);
     
+    /* Report what the test cost; the parent may know better */
+    usage_sample(&usage);
+    usage_since(&usage, &token->baseline);
+
     ((MuTestResult*) summary)->stage = token->current_stage;
+    ((MuTestResult*) summary)->usage = &usage;
+    ((MuTestResult*) summary)->counters = NULL;
+    ((MuTestResult*) summary)->benchmark = token->benchmarked ? &token->benchmark : NULL;
+    ((MuTestResult*) summary)->comparison = NULL;
+    ((MuTestResult*) summary)->complexity = token->fitted ? &token->complexity : NULL;
+    ((MuTestResult*) summary)->stress = token->stressing ? &token->stress_result : NULL;
+    /* Only the histograms go back, not each latency */
+    ((MuTestResult*) summary)->metrics = metric_summarize(token->metrics);
+
+    if (token->counting)
+    {
+        /* The test may have ended without leaving the test stage */
+        perf_stop(&token->perf);
+        if (perf_read(&token->perf, &counters))
+            ((MuTestResult*) summary)->counters = &counters;
+    }
+
+    /* Anything the test printed is looked at once the result is in,
+       but a crash may have left stdio in no state to be flushed */
+    if (summary->status != MU_STATUS_CRASH)
+    {
+        fflush(stdout);
+        fflush(stderr);
+    }
+
     uipc_message* message = uipc_msg_new(MSG_TYPE_RESULT);
     uipc_msg_set_payload(message, summary, &testresult_info);
     uipc_send(ipc_handle, message, NULL);
     uipc_msg_free(message);
+    metric_free_summary(summary->metrics);
+    ((MuTestResult*) summary)->metrics = NULL;
+
+    /* A batch worker goes back for another test only if this one ran
+       through its teardowns and was not marked unsafe.  Any other result
+       ends the test partway, and what it left behind could fail the next */
+    if (token->batch && token->finished && !token->unsafe &&
+        getpid() == token->child &&
+        pthread_equal(pthread_self(), token->self))
+    {
+        pthread_mutex_unlock(&token->lock);
+        siglongjmp(token->jmpbuf, 1);
+    }
 
+    /* The lock stays held so no other thread reports on the way out */
     ctoken_free_fork(token);
     uipc_close(ipc_handle);
     _exit(0);
-
-    pthread_mutex_unlock(&token->lock);
 }
 
 static
@@ -232,9 +427,10 @@ ctoken_meta_fork(MuInterfaceToken* _token, MuInterfaceMeta type, ...)
         if (!ipc_handle)
             return;
         
+        /* Only read once the test is over */
         uipc_message* message = uipc_msg_new(MSG_TYPE_EXPECT);
         uipc_msg_set_payload(message, &msg, &expect_info);
-        uipc_send(ipc_handle, message, NULL);
+        ctoken_queue_fork(token, message, true);
         uipc_msg_free(message);
         break;
     }
@@ -246,6 +442,8 @@ ctoken_meta_fork(MuInterfaceToken* _token, MuInterfaceMeta type, ...)
         if (!ipc_handle)
             return;
         
+        /* Goes out at once, with anything queued, since the
+           parent may otherwise time the test out too early */
         uipc_message* message = uipc_msg_new(MSG_TYPE_TIMEOUT);
         uipc_msg_set_payload(message, &msg, &timeout_info);
         uipc_send(ipc_handle, message, NULL);
@@ -262,13 +460,64 @@ ctoken_meta_fork(MuInterfaceToken* _token, MuInterfaceMeta type, ...)
         
         uipc_message* message = uipc_msg_new(MSG_TYPE_ITERATIONS);
         uipc_msg_set_payload(message, &msg, &iterations_info);
-        uipc_send(ipc_handle, message, NULL);
+        ctoken_queue_fork(token, message, true);
         uipc_msg_free(message);
         break;
     }
     case MU_META_LOG_LEVEL:
         *va_arg(ap, MuLogLevel*) = token->max_log_level;
         break;
+    case MU_META_UNSAFE:
+        token->unsafe = true;
+        break;
+    case MU_META_STRESS:
+        if (!token->stressing)
+            token->stress = va_arg(ap, unsigned int);
+        break;
+    case MU_META_COMPLEXITY:
+    {
+        MuComplexity bound = va_arg(ap, MuComplexity);
+        MuSizedThunk workload = va_arg(ap, MuSizedThunk);
+        void* data = va_arg(ap, void*);
+        const unsigned long* sizes = va_arg(ap, const unsigned long*);
+        unsigned int count = va_arg(ap, unsigned int);
+        MuTestComplexity* complexity = va_arg(ap, MuTestComplexity*);
+
+        benchmark_complexity(workload, data, bound, sizes, count, complexity);
+        token->complexity = *complexity;
+        token->fitted = true;
+        break;
+    }
+    case MU_META_METRIC:
+    {
+        MuMetricType metric_type = va_arg(ap, MuMetricType);
+        const char* name = va_arg(ap, const char*);
+        double value = va_arg(ap, double);
+
+        metric_record(&token->metrics, metric_type, name, value);
+        break;
+    }
+    case MU_META_ATTACH:
+    {
+        AttachMsg msg = { va_arg(ap, const char*) };
+        int fd = va_arg(ap, int);
+        const void* data = va_arg(ap, const void*);
+        size_t length = va_arg(ap, size_t);
+        int copy = attach_capture(fd, data, length);
+
+        if (copy >= 0)
+        {
+            /* Descriptors cannot be queued, so this goes out at once,
+               after anything queued, and the parent gets a duplicate */
+            uipc_message* message = uipc_msg_new(MSG_TYPE_ATTACH);
+            uipc_msg_set_payload(message, &msg, &attach_info);
+            uipc_msg_set_fd(message, copy);
+            uipc_send(token->ipc_handle, message, NULL);
+            uipc_msg_free(message);
+            close(copy);
+        }
+        break;
+    }
     }
 
     va_end(ap);
@@ -416,6 +665,30 @@ ctoken_meta_inproc(MuInterfaceToken* _token, MuInterfaceMeta type, ...)
     case MU_META_LOG_LEVEL:
         *va_arg(ap, MuLogLevel*) = token->max_log_level;
         break;
+    case MU_META_COMPLEXITY:
+    {
+        MuComplexity bound = va_arg(ap, MuComplexity);
+        MuSizedThunk workload = va_arg(ap, MuSizedThunk);
+        void* data = va_arg(ap, void*);
+        const unsigned long* sizes = va_arg(ap, const unsigned long*);
+        unsigned int count = va_arg(ap, unsigned int);
+        MuTestComplexity* complexity = va_arg(ap, MuTestComplexity*);
+
+        benchmark_complexity(workload, data, bound, sizes, count, complexity);
+        break;
+    }
+    case MU_META_ATTACH:
+    {
+        const char* name = va_arg(ap, const char*);
+        int fd = va_arg(ap, int);
+        const void* data = va_arg(ap, const void*);
+        size_t length = va_arg(ap, size_t);
+        int copy = attach_capture(fd, data, length);
+
+        if (copy >= 0)
+            attach_append(&token->result->attachments, name, copy);
+        break;
+    }
     default:
         break;
     }
@@ -463,22 +736,22 @@ signal_handler(int sig)
     }
 }
 
+/* List of signals we care about */
+static int siglist[] =
+{
+    SIGSEGV,
+    SIGBUS,
+    SIGILL,
+    SIGPIPE,
+    SIGFPE,
+    SIGABRT,
+    SIGTERM,
+    0
+};
+
 static void
 signal_setup(void)
 {
-    /* List of signals we care about */
-    static int siglist[] =
-    {
-        SIGSEGV,
-        SIGBUS,
-        SIGILL,
-        SIGPIPE,
-        SIGFPE,
-        SIGABRT,
-        SIGTERM,
-        0
-    };
-
     struct sigaction act;
     int i;
     
@@ -500,6 +773,17 @@ signal_setup(void)
     }
 }
 
+static void
+signal_restore(void)
+{
+    int i;
+
+    for (i = 0; siglist[i]; i++)
+    {
+        (void) signal(siglist[i], SIG_DFL);
+    }
+}
+
 static CTokenFork*
 ctoken_new_fork(MuTest* test)
 {
@@ -510,6 +794,7 @@ ctoken_new_fork(MuTest* test)
     token->base.result = ctoken_result_fork;
     token->base.event = ctoken_event_fork;
     token->expected = MU_STATUS_SUCCESS;
+    token->output = -1;
     pthread_mutex_init(&token->lock, NULL);
 
     return token;
@@ -532,6 +817,12 @@ ctoken_new_inproc(MuTest* test)
 static void
 ctoken_free_fork(CTokenFork* token)
 {
+    metric_clear(&token->metrics);
+    attach_free(token->attachments);
+    if (token->output >= 0)
+        close(token->output);
+    if (token->ring)
+        ring_free(token->ring);
     pthread_mutex_destroy(&token->lock);
     free(token);
 }
@@ -549,23 +840,137 @@ ctoken_free_inproc(CTokenInproc* token)
 #   define INVOKE(thunk) ((thunk)())
 #endif
 
+/* Times the body of the current benchmark */
 static void
-cloader_run_child(MuTest* test, CTokenFork* token)
+cloader_benchmark(void)
 {
-    MuThunk thunk;
+    CTokenFork* token = (CTokenFork*) current_token;
 
-    /* Set up the C/C++ interface to call into our token */
-    mu_interface_set_current_token_callback(ctoken_current, token);
-        
-    /* Set up handlers to catch asynchronous/fatal signals */
-    signal_setup();
+    benchmark_measure(((CTest*) token->base.test)->entry->run, benchmark_precision, &token->benchmark);
+    token->benchmarked = true;
+}
+
+/* Time to run the test for in a row alone, and in each copy */
+#define STRESS_NSEC 50000000.0
+#define STRESS_MAX_ROUNDS 10000
+
+/* Copies of the current test started together */
+typedef struct
+{
+    CTokenFork* token;
+    MuThunk run;
+    unsigned int rounds;
+    pthread_barrier_t start;
+} CStress;
+
+static void*
+cloader_stress_copy(void* data)
+{
+    CStress* stress = (CStress*) data;
+    unsigned int i;
+
+    pthread_barrier_wait(&stress->start);
+
+    for (i = 0; i < stress->rounds; i++)
+        INVOKE(stress->run);
+
+    pthread_mutex_lock(&stress->token->lock);
+    stress->token->stress_result.completed++;
+    pthread_mutex_unlock(&stress->token->lock);
+
+    return NULL;
+}
+
+/* Runs copies of the current test at once, each on a thread of its own,
+   and compares their throughput with that of the test run alone.  Both
+   run the test as many times in a row as the first run, which was cold,
+   suggests will take a while, so that neither rests on one short run.
+   All of these runs share the fixture set up before them.
+   A copy which fails reports it and ends the process from its own thread */
+static void
+cloader_run_stress(MuTest* test, CTokenFork* token, double first_nsec)
+{
+    MuTestStress* result = &token->stress_result;
+    pthread_t* threads = xcalloc(token->stress, sizeof(*threads));
+    CStress stress;
+    double started;
+    unsigned int i;
+    int error;
+
+    memset(result, 0, sizeof(*result));
+    result->copies = token->stress;
+    result->rounds = STRESS_MAX_ROUNDS;
+
+    if (first_nsec * STRESS_MAX_ROUNDS > STRESS_NSEC)
+        result->rounds = first_nsec < STRESS_NSEC ? STRESS_NSEC / first_nsec : 1;
+
+    stress.token = token;
+    stress.run = ((CTest*) test)->entry->run;
+    stress.rounds = result->rounds;
+
+    started = benchmark_now_nsec();
+
+    for (i = 0; i < result->rounds; i++)
+        INVOKE(stress.run);
+
+    result->single_nsec = (benchmark_now_nsec() - started) / result->rounds;
+
+    /* Hold the copies back until all of them and we are ready */
+    pthread_barrier_init(&stress.start, NULL, token->stress + 1);
+
+    token->stressing = true;
+
+    for (i = 0; i < token->stress; i++)
+    {
+        if ((error = pthread_create(&threads[i], NULL, cloader_stress_copy, &stress)))
+        {
+            /* The copies already started are stuck at the barrier */
+            token->unsafe = true;
+            mu_interface_result(NULL, 0, MU_STATUS_FAILURE,
+                                "Could not start copy %u of the test: %s", i + 1, strerror(error));
+        }
+    }
+
+    pthread_barrier_wait(&stress.start);
+    started = benchmark_now_nsec();
+
+    for (i = 0; i < token->stress; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    result->stress_nsec = benchmark_now_nsec() - started;
+
+    if (result->single_nsec > 0)
+        result->single_throughput = 1e9 / result->single_nsec;
+    if (result->stress_nsec > 0)
+        result->throughput = (double) result->copies * result->rounds * 1e9 / result->stress_nsec;
+    if (result->single_throughput > 0)
+        result->scaling = result->throughput / result->single_throughput;
+
+    pthread_barrier_destroy(&stress.start);
+    free(threads);
+}
+
+static void
+cloader_run_library_setup(MuTest* test, CTokenFork* token)
+{
+    MuThunk thunk;
 
     /* Stage: library setup */
     token->current_stage = MU_STAGE_LIBRARY_SETUP;
     
     if ((thunk = cloader_library_setup(test->loader, test->library)))
         INVOKE(thunk);
-    
+}
+
+/* Runs every stage of a test after library setup */
+static void
+cloader_run_test(MuTest* test, CTokenFork* token)
+{
+    MuThunk thunk;
+    double started, single_nsec = 0;
+
     /* Stage: fixture setup */
     token->current_stage = MU_STAGE_FIXTURE_SETUP;
     
@@ -575,7 +980,41 @@ cloader_run_child(MuTest* test, CTokenFork* token)
     /* Stage: test */
     token->current_stage = MU_STAGE_TEST;
     
-    INVOKE(((CTest*) test)->entry->run);
+    if (token->counting)
+        perf_start(&token->perf);
+
+    if (((CTest*) test)->entry->type == MU_ENTRY_BENCHMARK)
+    {
+        INVOKE(cloader_benchmark);
+    }
+    else
+    {
+        started = benchmark_now_nsec();
+        INVOKE(((CTest*) test)->entry->run);
+        single_nsec = benchmark_now_nsec() - started;
+    }
+
+    if (token->counting)
+        perf_stop(&token->perf);
+
+    if (((CTest*) test)->entry->type != MU_ENTRY_BENCHMARK && token->stress > 1)
+    {
+        /* Set the fixtures up afresh for the stress runs, which all share
+           them, as documented for MU_STRESS */
+        token->current_stage = MU_STAGE_FIXTURE_TEARDOWN;
+
+        if ((thunk = cloader_fixture_teardown(test->loader, test)))
+            INVOKE(thunk);
+
+        token->current_stage = MU_STAGE_FIXTURE_SETUP;
+
+        if ((thunk = cloader_fixture_setup(test->loader, test)))
+            INVOKE(thunk);
+
+        token->current_stage = MU_STAGE_TEST;
+
+        cloader_run_stress(test, token, single_nsec);
+    }
     
     /* Stage: fixture teardown */
     token->current_stage = MU_STAGE_FIXTURE_TEARDOWN;
@@ -590,9 +1029,133 @@ cloader_run_child(MuTest* test, CTokenFork* token)
         INVOKE(thunk);
     
     /* If we got this far without incident, explicitly succeed */
+    token->finished = true;
     mu_interface_result(NULL, 0, MU_STATUS_SUCCESS, NULL);
 }
 
+/* Sends the standard output and error of a child into fd, which
+   is closed, after what is buffered goes where it was going */
+static void
+cloader_redirect_output(int fd)
+{
+    fflush(stdout);
+    fflush(stderr);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+}
+
+/* Tells the parent a batch worker is ready and waits for its next test */
+static MuTest*
+cloader_worker_next(CTokenFork* token)
+{
+    uipc_message* message = uipc_msg_new(MSG_TYPE_READY);
+    RunMsg* msg = NULL;
+    MuTest* test = NULL;
+    int output;
+
+    uipc_send(token->ipc_handle, message, NULL);
+    uipc_msg_free(message);
+
+    message = NULL;
+
+    if (uipc_recv(token->ipc_handle, &message, NULL) == UIPC_SUCCESS)
+    {
+        if (uipc_msg_get_type(message) == MSG_TYPE_RUN)
+        {
+            msg = uipc_msg_get_payload(message, &run_info);
+            test = msg->test;
+            token->base.test = test;
+            token->max_log_level = msg->max_level;
+            token->expected = MU_STATUS_SUCCESS;
+            uipc_msg_free_payload(msg, &run_info);
+
+            /* Each test gets a file of its own for its output */
+            if ((output = uipc_msg_take_fd(message)) >= 0)
+                cloader_redirect_output(output);
+        }
+
+        uipc_msg_free(message);
+    }
+
+    return test;
+}
+
+/* Sends what was queued for the parent if the test calls exit() itself */
+static void
+cloader_child_exit(void)
+{
+    CTokenFork* token = (CTokenFork*) current_token;
+
+    if (token && token->ipc_handle && getpid() == token->child)
+        uipc_flush(token->ipc_handle, NULL);
+}
+
+static void
+cloader_run_child(CTokenFork* token, bool library_setup)
+{
+    /* Each test tears the library down, so a batch worker sets it up
+       again for every test after the first, even if a zygote did that */
+    volatile bool setup = library_setup;
+
+    /* Set up the C/C++ interface to call into our token */
+    mu_interface_set_current_token_callback(ctoken_current, token);
+        
+    /* Set up handlers to catch asynchronous/fatal signals */
+    signal_setup();
+    atexit(cloader_child_exit);
+
+    token->batch = use_batch;
+    token->self = pthread_self();
+    token->counting = use_perf;
+
+    if (token->counting)
+        perf_open(&token->perf);
+
+    do
+    {
+        /* A batch worker comes back here when a test finishes cleanly */
+        if (!sigsetjmp(token->jmpbuf, 1))
+        {
+            usage_sample(&token->baseline);
+            token->benchmarked = false;
+            token->fitted = false;
+            token->stress = default_stress;
+            token->stressing = false;
+            token->finished = false;
+            metric_clear(&token->metrics);
+
+            if (token->counting)
+                perf_reset(&token->perf);
+
+            if (setup)
+                cloader_run_library_setup(token->base.test, token);
+            setup = true;
+            cloader_run_test(token->base.test, token);
+        }
+    } while (cloader_worker_next(token));
+}
+
+#ifdef HAVE_WAIT4
+static const bool have_child_usage = true;
+#else
+static const bool have_child_usage = false;
+#endif
+
+/* Reaps a child if it has exited, along with what it used
+   if the system can tell us */
+static pid_t
+reap_child(pid_t pid, int* status, struct rusage* usage)
+{
+#ifdef HAVE_WAIT4
+    return wait4(pid, status, WNOHANG, usage);
+#else
+    if (usage)
+        memset(usage, 0, sizeof(*usage));
+    return waitpid(pid, status, WNOHANG);
+#endif
+}
+
 #ifdef HAVE_SIGTIMEDWAIT
 static void
 sigchld_handler()
@@ -600,7 +1163,7 @@ sigchld_handler()
 }
 
 static int
-wait_child(pid_t pid, int* status, int ms)
+wait_child_signal(pid_t pid, int* status, struct rusage* usage, int ms)
 {
     sigset_t set, oldset;
     struct sigaction act, oldact;
@@ -620,7 +1183,7 @@ wait_child(pid_t pid, int* status, int ms)
     
     /* Check if the child already exited before
        we blocked the signal */
-    if (waitpid(pid, status, WNOHANG) == pid)
+    if (reap_child(pid, status, usage) == pid)
     {
         /* It did, so we are done */
         ret = 0;
@@ -633,7 +1196,7 @@ wait_child(pid_t pid, int* status, int ms)
     sigtimedwait(&set, NULL, &timeout);
     
     /* Check one more time for status */
-    if (waitpid(pid, status, WNOHANG) == pid)
+    if (reap_child(pid, status, usage) == pid)
     {
         /* It finally exited */
         ret = 0;
@@ -669,7 +1232,7 @@ sigchld_handler(int sig)
 }
 
 static int
-wait_child(pid_t pid, int* status, int ms)
+wait_child_signal(pid_t pid, int* status, struct rusage* usage, int ms)
 {
     sigset_t set, oldset;
     struct sigaction act, oldact;
@@ -698,7 +1261,7 @@ wait_child(pid_t pid, int* status, int ms)
 
     /* Check if the child already exited before
        we blocked the signal */
-    if (waitpid(pid, status, WNOHANG) == pid)
+    if (reap_child(pid, status, usage) == pid)
     {
         /* It did, so we are done */
         ret = 0;
@@ -712,7 +1275,7 @@ wait_child(pid_t pid, int* status, int ms)
     timeout.tv_usec = (ms % 1000) * 1000; 
     select(loop[0] + 1, &readfds, NULL, NULL, &timeout); 
     
-    if (waitpid(pid, status, WNOHANG) == pid)
+    if (reap_child(pid, status, usage) == pid)
     {
         /* It's done now */
         ret = 0;
@@ -739,219 +1302,1746 @@ done:
 }
 #endif
 
-/* Main loop for harvesting messages from the child process */
-static MuTestResult*
-cloader_run_parent(MuTest* test, CTokenFork* token, MuLogCallback cb, void* cb_data, unsigned int* iterations)
+/* Returns a descriptor which becomes readable when the
+   given process exits, or -1 if this is not supported */
+static int
+pid_open(pid_t pid)
 {
-    uipc_handle* ipc = token->ipc_handle;
-    MuTestResult *summary = NULL;
-    uipc_message* message = NULL;
-    int status;
-    uipc_status uipc_result = UIPC_SUCCESS;
-    long timeout = default_timeout;
+#ifdef HAVE_PIDFD
+    return (int) syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int
+wait_child(pid_t pid, int* status, struct rusage* usage, int ms)
+{
+    struct pollfd fd;
+
+    /* Without pidfds, fall back to catching SIGCHLD */
+    if ((fd.fd = pid_open(pid)) < 0)
+    {
+        return wait_child_signal(pid, status, usage, ms);
+    }
+
+    fd.events = POLLIN;
+    fd.revents = 0;
+
+    while (poll(&fd, 1, ms) < 0 && errno == EINTR);
+
+    close(fd.fd);
+
+    if (reap_child(pid, status, usage) == pid)
+    {
+        return 0;
+    }
+    else
+    {
+        /* Kill the thing and wait once more to reap
+           the zombie process */
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+}
+
+/* What an event from the supervisor refers to */
+typedef struct CWatch
+{
+    struct CJob* job;
+    enum
+    {
+        /* Data on the socket of the child */
+        WATCH_SOCKET,
+        /* Exit of the child */
+        WATCH_EXIT,
+        /* Events in the ring of the child */
+        WATCH_RING
+    } kind;
+} CWatch;
+
+/* A forked test child supervised by the parent */
+typedef struct CJob
+{
+    MuTest* test;
+    CTokenFork* token;
+    /* Parent end of the socket pair */
+    int socket;
+    MuLogCallback cb;
+    void* data;
+    MuLogLevel max_level;
+    unsigned int iterations;
+    unsigned int iteration;
+    long timeout;
     uipc_time deadline;
-    bool done = false;
+    /* Zygote the child was forked from, if any */
+    struct CZygote* zygote;
     /* Have we timed out once already? */
-    bool timedout = false;
+    bool timedout;
+    /* Was the child killed by cloader_dispatch_cancel? */
+    bool cancelled;
+    /* Are we still harvesting messages from the child? */
+    bool harvesting;
+    uipc_status status;
+    MuTestResult* summary;
+    /* Descriptor which becomes readable when the child exits, or -1 */
+    int pidfd;
+    /* Set by cloader_poll_jobs from supervisor events */
+    bool readable;
+    bool exited;
+    bool ring_ready;
+    /* Set when draining reached a detour record in the ring, until the
+       event it stands for has come over the socket */
+    bool detour;
+    /* CPU the child is pinned to for a benchmark, or -1 */
+    int cpu;
+    CWatch watch_socket;
+    CWatch watch_exit;
+    CWatch watch_ring;
+    struct CJob* next;
+} CJob;
+
+/* Jobs started with cloader_dispatch_start */
+static CJob* running_jobs = NULL;
+static CJob* finished_jobs = NULL;
+
+/* epoll instance watching the sockets and exits of running jobs */
+static int supervisor = -1;
+#ifdef HAVE_SYS_EPOLL_H
+static bool supervisor_broken = false;
+#endif
+
+/* A batch worker waiting for its next test */
+typedef struct CWorker
+{
+    MuLibrary* library;
+    pid_t pid;
+    int socket;
+    uipc_handle* ipc_handle;
+    CRing* ring;
+    /* Zygote the worker was forked from, if any */
+    struct CZygote* zygote;
+    struct CWorker* next;
+} CWorker;
+
+static CWorker* idle_workers = NULL;
+
+static MuTestResult*
+spawn_failure(void)
+{
+    MuTestResult* summary = xcalloc(1, sizeof(MuTestResult));
+
+    summary->status = MU_STATUS_FAILURE;
+    summary->stage = MU_STAGE_UNKNOWN;
+    summary->line = 0;
+    summary->reason = format("Could not start test process: %s", strerror(errno));
+
+    return summary;
+}
+
+/* A process which has run library setup once and forks
+   test children from its post-setup image on request */
+typedef struct CZygote
+{
+    MuLibrary* library;
+    /* Process id, or -1 if library setup did not succeed in it */
+    pid_t pid;
+    /* Parent end of the control socket */
+    int control;
+    /* Children which exited before anyone waited on them */
+    struct ZygoteExit* exits;
+    struct CZygote* next;
+} CZygote;
+
+typedef struct
+{
+    MuTest* test;
+    MuLogLevel max_level;
+    /* Whether the descriptors of an event ring follow the socket */
+    bool ring;
+    /* Whether a file for the output of the child comes last */
+    bool output;
+} ZygoteRequest;
+
+typedef enum
+{
+    ZYGOTE_SPAWNED,
+    ZYGOTE_EXITED
+} ZygoteReplyType;
+
+typedef struct
+{
+    ZygoteReplyType type;
+    pid_t pid;
+    /* errno for ZYGOTE_SPAWNED, wait status for ZYGOTE_EXITED */
+    int status;
+    /* What the child used, for ZYGOTE_EXITED */
+    struct rusage usage;
+} ZygoteReply;
+
+typedef struct ZygoteExit
+{
+    pid_t pid;
+    int status;
+    struct rusage usage;
+    struct ZygoteExit* next;
+} ZygoteExit;
+
+static CZygote* zygotes = NULL;
+static int zygote_loop[2];
+
+/* Closes the connections a newly forked process has
+   inherited to the other children of the parent */
+static void
+cloader_close_inherited(void)
+{
+    CJob* job;
+    CWorker* worker;
+    CZygote* zygote;
+
+    for (job = running_jobs; job; job = job->next)
+    {
+        close(job->socket);
+
+        if (job->pidfd >= 0)
+            close(job->pidfd);
+
+        if (job->token->output >= 0)
+            close(job->token->output);
+
+        if (job->token->ring)
+        {
+            close(job->token->ring->memfd);
+            close(job->token->ring->eventfd);
+        }
+    }
+
+    if (supervisor >= 0)
+    {
+        close(supervisor);
+    }
+
+    for (worker = idle_workers; worker; worker = worker->next)
+    {
+        close(worker->socket);
+
+        if (worker->ring)
+        {
+            close(worker->ring->memfd);
+            close(worker->ring->eventfd);
+        }
+    }
+
+    for (zygote = zygotes; zygote; zygote = zygote->next)
+    {
+        if (zygote->control >= 0)
+            close(zygote->control);
+    }
+}
+
+static void cloader_job_process(CJob* job, uipc_status status, uipc_message* message);
+
+/* Most file descriptors passed along with a zygote message */
+#define ZYGOTE_MAX_FDS 4
+
+/* Sends a message on a zygote control socket,
+   passing along count file descriptors from fds */
+static ssize_t
+zygote_send(int socket, const void* msg, size_t len, const int* fds, unsigned int count)
+{
+    struct msghdr hdr;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    union
+    {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)];
+    } control;
+    ssize_t ret;
+
+    memset(&hdr, 0, sizeof(hdr));
+    iov.iov_base = (void*) msg;
+    iov.iov_len = len;
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+
+    if (count)
+    {
+        hdr.msg_control = control.buffer;
+        hdr.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+        cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    }
+
+    do
+    {
+        ret = sendmsg(socket, &hdr, MSG_NOSIGNAL);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret;
+}
+
+/* Receives a message from a zygote control socket, storing up to count
+   file descriptors passed along with it in fds and filling the rest with -1 */
+static ssize_t
+zygote_recv(int socket, void* msg, size_t len, int* fds, unsigned int count)
+{
+    struct msghdr hdr;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    union
+    {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)];
+    } control;
+    unsigned int i, passed;
+    ssize_t ret;
+
+    memset(&hdr, 0, sizeof(hdr));
+    iov.iov_base = msg;
+    iov.iov_len = len;
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control.buffer;
+    hdr.msg_controllen = sizeof(control.buffer);
+
+    do
+    {
+        ret = recvmsg(socket, &hdr, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    for (i = 0; i < count; i++)
+    {
+        fds[i] = -1;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&hdr); ret > 0 && cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            passed = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+            for (i = 0; i < passed; i++)
+            {
+                int fd;
+
+                memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+
+                /* Nobody asked for this one */
+                if (i < count)
+                    fds[i] = fd;
+                else
+                    close(fd);
+            }
+        }
+    }
+
+    return ret;
+}
+
+static void
+zygote_sigchld(int sig)
+{
+    char c = 0;
+
+    write(zygote_loop[1], (void*) &c, 1);
+}
+
+static void
+zygote_drop_event(MuLogEvent const* event, void* data)
+{
+}
+
+/* Runs a test in a child forked by the zygote over the socket,
+   event ring and output descriptors passed with the request */
+static void
+zygote_child(ZygoteRequest* request, int* passed)
+{
+    CTokenFork* token = ctoken_new_fork(request->test);
+    int socket = passed[0];
+    int output = request->output ? passed[request->ring ? 3 : 1] : -1;
+    uipc_handle* ipc = uipc_attach(socket);
+
+    if (output >= 0)
+        cloader_redirect_output(output);
+
+    current_token = &token->base;
+
+    /* Set up token */
+    token->ipc_handle = ipc;
+    token->max_log_level = request->max_level;
+    token->child = getpid();
+
+    if (request->ring && passed[1] >= 0 && passed[2] >= 0)
+    {
+        if ((token->ring = ring_attach(passed[1], passed[2])))
+        {
+            token->ring->peer = socket;
+        }
+        else
+        {
+            /* Fall back to sending events over the socket */
+            close(passed[1]);
+            close(passed[2]);
+        }
+    }
+
+    cloader_run_child(token, false);
+
+    /* Tear down ipc handle and close connection */
+    token->ipc_handle = NULL;
+    uipc_detach(ipc);
+    close(socket);
+
+    exit(0);
+}
+
+/* Forks children on request until the parent closes the control
+   socket, and tells it whenever one of them exits */
+static void
+zygote_serve(int control)
+{
+    struct sigaction act;
+    struct pollfd fds[2];
+    ZygoteRequest request;
+    ZygoteReply reply;
+    pid_t pid;
+    int passed[ZYGOTE_MAX_FDS];
+    int status;
+    unsigned int i;
+    char c;
+
+    if (pipe(zygote_loop))
+    {
+        _exit(1);
+    }
+
+    act.sa_handler = zygote_sigchld;
+    sigemptyset(&act.sa_mask);
+    act.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &act, NULL);
+
+    for (;;)
+    {
+        fds[0].fd = control;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = zygote_loop[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents)
+        {
+            read(zygote_loop[0], &c, 1);
+
+            while ((pid = reap_child(-1, &status, &reply.usage)) > 0)
+            {
+                reply.type = ZYGOTE_EXITED;
+                reply.pid = pid;
+                reply.status = status;
+                zygote_send(control, &reply, sizeof(reply), NULL, 0);
+            }
+        }
+
+        if (fds[0].revents)
+        {
+            /* Stop when the parent goes away */
+            if (zygote_recv(control, &request, sizeof(request), passed, ZYGOTE_MAX_FDS) <= 0)
+                break;
+
+            if (passed[0] < 0)
+                continue;
+
+            if (!(pid = fork()))
+            {
+                close(control);
+                close(zygote_loop[0]);
+                close(zygote_loop[1]);
+                signal(SIGCHLD, SIG_DFL);
+
+                zygote_child(&request, passed);
+            }
+
+            reply.type = ZYGOTE_SPAWNED;
+            reply.pid = pid;
+            reply.status = pid < 0 ? errno : 0;
+            for (i = 0; i < ZYGOTE_MAX_FDS; i++)
+            {
+                if (passed[i] >= 0)
+                    close(passed[i]);
+            }
+            zygote_send(control, &reply, sizeof(reply), NULL, 0);
+        }
+    }
+
+    _exit(0);
+}
+
+/* Runs library setup in the zygote and reports how it went */
+static void
+zygote_main(MuTest* test, int setup, int control)
+{
+    CTokenFork* token = ctoken_new_fork(test);
+    MuTestResult summary;
+    uipc_message* message;
+
+    current_token = &token->base;
+
+    /* Set up token */
+    token->ipc_handle = uipc_attach(setup);
+    token->child = getpid();
+
+    mu_interface_set_current_token_callback(ctoken_current, token);
+    signal_setup();
+
+    /* If this fails, the token reports the result and exits for us */
+    cloader_run_library_setup(test, token);
+
+    signal_restore();
+
+    memset(&summary, 0, sizeof(summary));
+    summary.status = MU_STATUS_SUCCESS;
+    summary.stage = MU_STAGE_LIBRARY_SETUP;
+
+    message = uipc_msg_new(MSG_TYPE_RESULT);
+    uipc_msg_set_payload(message, &summary, &testresult_info);
+    uipc_send(token->ipc_handle, message, NULL);
+    uipc_msg_free(message);
+
+    uipc_close(token->ipc_handle);
+    ctoken_free_fork(token);
+    current_token = NULL;
+
+    zygote_serve(control);
+}
+
+/* Forks a zygote for the library of a test and waits for library setup
+   to finish in it.  If it does not succeed, the zygote is marked as
+   unusable and tests run library setup themselves, reporting any problem */
+static CZygote*
+zygote_start(MuTest* test)
+{
+    CZygote* zygote = xcalloc(1, sizeof(CZygote));
+    CJob job = {0};
+    int control[2];
+    int setup[2];
+    pid_t pid;
+    uipc_message* message = NULL;
+    uipc_status status;
+
+    zygote->library = test->library;
+    zygote->pid = -1;
+    zygote->control = -1;
+    zygote->next = zygotes;
+    zygotes = zygote;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, control))
+    {
+        return zygote;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, setup))
+    {
+        close(control[0]);
+        close(control[1]);
+        return zygote;
+    }
+
+    fflush(NULL);
+
+    if (!(pid = fork()))
+    {
+        /* Zygote */
+
+        /* Close connections to any other children still running */
+        cloader_close_inherited();
+
+        close(control[0]);
+        close(setup[0]);
+
+        zygote_main(test, setup[1], control[1]);
+    }
+
+    close(control[1]);
+    close(setup[1]);
+
+    if (pid < 0)
+    {
+        close(control[0]);
+        close(setup[0]);
+        return zygote;
+    }
+
+    /* Harvest the outcome of library setup as we would a test */
+    job.test = test;
+    job.cb = zygote_drop_event;
+    job.token = ctoken_new_fork(test);
+    job.token->ipc_handle = uipc_attach(setup[0]);
+    job.token->child = pid;
+    job.socket = setup[0];
+    job.timeout = default_timeout;
+    job.harvesting = true;
+
+    uipc_time_current_offset(&job.deadline, 0, job.timeout * 1000);
+
+    while (job.harvesting)
+    {
+        message = NULL;
+        status = uipc_recv(job.token->ipc_handle, &message, &job.deadline);
+        cloader_job_process(&job, status, message);
+    }
+
+    uipc_detach(job.token->ipc_handle);
+    close(setup[0]);
+    ctoken_free_fork(job.token);
+
+    if (job.summary && job.summary->status == MU_STATUS_SUCCESS && !job.timedout)
+    {
+        zygote->pid = pid;
+        zygote->control = control[0];
+    }
+    else
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(control[0]);
+    }
+
+    if (job.summary)
+    {
+        cloader_free_result(NULL, job.summary);
+    }
+
+    return zygote;
+}
+
+/* Returns the zygote for the library of a test, starting it
+   if needed, or NULL if the library cannot use one */
+static CZygote*
+zygote_lookup(MuTest* test)
+{
+    CZygote* zygote;
+
+    for (zygote = zygotes; zygote; zygote = zygote->next)
+    {
+        if (zygote->library == test->library)
+            break;
+    }
+
+    if (!zygote)
+    {
+        zygote = zygote_start(test);
+    }
+
+    return zygote->pid > 0 ? zygote : NULL;
+}
+
+/* Waits up to ms milliseconds (or forever if negative) for a reply
+   from a zygote.  Returns 1 on success, 0 on timeout or -1 on error */
+static int
+zygote_read(CZygote* zygote, ZygoteReply* reply, int ms)
+{
+    struct pollfd fd;
+    int ret;
+
+    fd.fd = zygote->control;
+    fd.events = POLLIN;
+
+    do
+    {
+        ret = poll(&fd, 1, ms);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret <= 0)
+    {
+        return ret;
+    }
+
+    if (zygote_recv(zygote->control, reply, sizeof(*reply), NULL, 0) != sizeof(*reply))
+    {
+        return -1;
+    }
+
+    return 1;
+}
+
+/* Sets aside an exit notification until someone waits for it */
+static void
+zygote_stash(CZygote* zygote, ZygoteReply* reply)
+{
+    ZygoteExit* dead = xmalloc(sizeof(ZygoteExit));
+
+    dead->pid = reply->pid;
+    dead->status = reply->status;
+    dead->usage = reply->usage;
+    dead->next = zygote->exits;
+    zygote->exits = dead;
+}
+
+/* Asks a zygote to fork a child running the given test over socket,
+   writing its events into ring if that is not NULL and its output
+   into output if that is not -1 */
+static pid_t
+zygote_fork(CZygote* zygote, MuTest* test, MuLogLevel max_level, int socket, CRing* ring, int output)
+{
+    ZygoteRequest request;
+    ZygoteReply reply;
+    int fds[ZYGOTE_MAX_FDS];
+    unsigned int count = 0;
+
+    request.test = test;
+    request.max_level = max_level;
+    request.ring = ring != NULL;
+    request.output = output >= 0;
+
+    fds[count++] = socket;
+
+    if (ring)
+    {
+        fds[count++] = ring->memfd;
+        fds[count++] = ring->eventfd;
+    }
+
+    if (output >= 0)
+    {
+        fds[count++] = output;
+    }
+
+    if (zygote_send(zygote->control, &request, sizeof(request), fds, count) < 0)
+    {
+        return -1;
+    }
+
+    for (;;)
+    {
+        if (zygote_read(zygote, &reply, -1) <= 0)
+        {
+            errno = EPIPE;
+            return -1;
+        }
+
+        if (reply.type == ZYGOTE_SPAWNED)
+        {
+            if (reply.pid < 0)
+                errno = reply.status;
+            return reply.pid;
+        }
+
+        zygote_stash(zygote, &reply);
+    }
+}
+
+/* Like wait_child, but for a child of a zygote */
+static int
+zygote_wait(CZygote* zygote, pid_t pid, int* status, struct rusage* usage, int ms)
+{
+    ZygoteExit* dead, **link;
+    ZygoteReply reply;
+    bool killed = false;
+    int ret;
+
+    for (;;)
+    {
+        for (link = &zygote->exits; (dead = *link); link = &dead->next)
+        {
+            if (dead->pid == pid)
+            {
+                *link = dead->next;
+                if (!killed)
+                {
+                    *status = dead->status;
+                    if (usage)
+                        *usage = dead->usage;
+                }
+                free(dead);
+                return killed ? -1 : 0;
+            }
+        }
+
+        ret = zygote_read(zygote, &reply, killed ? -1 : ms);
+
+        if (ret < 0)
+        {
+            return -1;
+        }
+        else if (ret == 0)
+        {
+            /* Kill the thing and wait for the zygote to reap it */
+            kill(pid, SIGKILL);
+            killed = true;
+        }
+        else if (reply.type == ZYGOTE_EXITED)
+        {
+            zygote_stash(zygote, &reply);
+        }
+    }
+}
+
+/* Shuts down the zygote for a library, if there is one */
+static void
+zygote_stop(MuLibrary* library)
+{
+    CZygote* zygote, **link;
+    ZygoteExit* dead;
+
+    for (link = &zygotes; (zygote = *link); link = &zygote->next)
+    {
+        if (zygote->library == library)
+        {
+            *link = zygote->next;
+
+            if (zygote->pid > 0)
+            {
+                /* The zygote exits when it sees the control socket close */
+                close(zygote->control);
+                waitpid(zygote->pid, NULL, 0);
+            }
+
+            while ((dead = zygote->exits))
+            {
+                zygote->exits = dead->next;
+                free(dead);
+            }
+
+            free(zygote);
+            break;
+        }
+    }
+}
+
+/* Sets up a job to harvest results from a child which just began its test */
+static void
+cloader_job_begin(CJob* job, CTokenFork* token, int socket, CZygote* zygote)
+{
+    job->token = token;
+    job->zygote = zygote;
+    job->socket = socket;
+    job->timeout = default_timeout;
+    job->timedout = false;
+    job->cancelled = false;
+    job->harvesting = true;
+    job->status = UIPC_SUCCESS;
+    job->summary = NULL;
+    job->pidfd = -1;
+    job->readable = false;
+    job->exited = false;
+    job->ring_ready = false;
+    job->detour = false;
+    job->cpu = -1;
+
+    /* Keep other tests off the CPU a benchmark runs on.  The child
+       spends its first few milliseconds warming up anyway */
+    if (benchmark_precision > 0 &&
+        ((CTest*) job->test)->entry->type == MU_ENTRY_BENCHMARK &&
+        (job->cpu = benchmark_cpu_claim()) >= 0)
+    {
+        benchmark_pin(token->child, job->cpu);
+    }
+
+    uipc_time_current_offset(&job->deadline, 0, job->timeout * 1000);
+}
+
+/* Closes the connection to a batch worker and reaps it */
+static void
+cloader_worker_free(CWorker* worker)
+{
+    int status = 0;
+
+    uipc_detach(worker->ipc_handle);
+    close(worker->socket);
+
+    if (worker->ring)
+        ring_free(worker->ring);
+
+    /* The worker exits as soon as it sees the connection close */
+    if (worker->zygote)
+        zygote_wait(worker->zygote, worker->pid, &status, NULL, 500);
+    else
+        wait_child(worker->pid, &status, NULL, 500);
+
+    free(worker);
+}
+
+/* Shuts down any idle batch workers for a library */
+static void
+cloader_worker_stop(MuLibrary* library)
+{
+    CWorker* worker, **link;
+
+    for (link = &idle_workers; (worker = *link);)
+    {
+        if (worker->library == library)
+        {
+            *link = worker->next;
+            cloader_worker_free(worker);
+        }
+        else
+        {
+            link = &worker->next;
+        }
+    }
+}
+
+/* Hands the test of a job to an idle batch worker for its library */
+static bool
+cloader_job_resume(CJob* job)
+{
+    CWorker* worker, **link;
+    CTokenFork* token;
+    RunMsg msg;
+    uipc_message* message;
+    uipc_status status;
+
+    for (link = &idle_workers; (worker = *link); link = &worker->next)
+    {
+        if (worker->library == job->test->library)
+            break;
+    }
+
+    if (!worker)
+    {
+        return false;
+    }
+
+    *link = worker->next;
+
+    msg.test = job->test;
+    msg.max_level = job->max_level;
+
+    token = ctoken_new_fork(job->test);
+    token->output = use_capture || show_output ? attach_new() : -1;
+
+    message = uipc_msg_new(MSG_TYPE_RUN);
+    uipc_msg_set_payload(message, &msg, &run_info);
+    if (token->output >= 0)
+        uipc_msg_set_fd(message, token->output);
+    status = uipc_send(worker->ipc_handle, message, NULL);
+    uipc_msg_free(message);
+
+    if (status != UIPC_SUCCESS)
+    {
+        ctoken_free_fork(token);
+        cloader_worker_free(worker);
+        return false;
+    }
+
+    token->ipc_handle = worker->ipc_handle;
+    token->ring = worker->ring;
+    token->child = worker->pid;
+
+    cloader_job_begin(job, token, worker->socket, worker->zygote);
+
+    free(worker);
+
+    return true;
+}
+
+/* Keeps the child of a finished job around as a batch
+   worker if it says it is ready for another test */
+static bool
+cloader_job_park(CJob* job)
+{
+    uipc_message* message = NULL;
+    uipc_time deadline;
+    CWorker* worker;
+    bool ready;
+
+    uipc_time_current_offset(&deadline, 0, 500 * 1000);
+
+    if (uipc_recv(job->token->ipc_handle, &message, &deadline) != UIPC_SUCCESS)
+    {
+        return false;
+    }
+
+    ready = uipc_msg_get_type(message) == MSG_TYPE_READY;
+    uipc_msg_free(message);
+
+    if (!ready)
+    {
+        return false;
+    }
+
+    worker = xmalloc(sizeof(CWorker));
+
+    worker->library = job->test->library;
+    worker->pid = job->token->child;
+    worker->socket = job->socket;
+    worker->ipc_handle = job->token->ipc_handle;
+    worker->ring = job->token->ring;
+    worker->zygote = job->zygote;
+    /* The worker keeps its ring for the tests to come */
+    job->token->ring = NULL;
+    worker->next = idle_workers;
+    idle_workers = worker;
+
+    return true;
+}
+
+/* Starts the test of a job, either in an idle batch
+   worker or in a freshly forked child process */
+static bool
+cloader_job_spawn(CJob* job)
+{
+    int sockets[2];
+    pid_t pid;
+    CZygote* zygote = NULL;
+    CTokenFork* token = NULL;
+
+    if (use_batch && cloader_job_resume(job))
+    {
+        return true;
+    }
+
+    zygote = use_zygote ? zygote_lookup(job->test) : NULL;
+    token = ctoken_new_fork(job->test);
+    /* Without a ring, events go over the socket like everything else */
+    token->ring = use_ring ? ring_new() : NULL;
+    token->output = use_capture || show_output ? attach_new() : -1;
+
+    current_token = &token->base;
+    
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets))
+    {
+        ctoken_free_fork(token);
+        return false;
+    }
+    
+    if (zygote)
+    {
+        /* Have the zygote fork the child from its post-setup image */
+        pid = zygote_fork(zygote, job->test, job->max_level, sockets[1], token->ring, token->output);
+    }
+    else
+    {
+        /* We must force a flush of all open output streams or the child
+         * will end up flushing non-empty buffers on exit, resulting in
+         * bizarre duplicate output
+         */
+
+        fflush(NULL);
+    
+        if (!(pid = fork()))
+        {
+            /* Child */
+        
+            uipc_handle* ipc;
+
+            /* Close connections to any other children still running */
+            cloader_close_inherited();
+                
+            /* Set up ipc handle, close unneeded socket end */
+            ipc = uipc_attach(sockets[1]);
+            close(sockets[0]);
+        
+            /* Set up token */
+            token->ipc_handle = ipc;
+            token->max_log_level = job->max_level;
+            token->child = getpid();
+
+            if (token->ring)
+                token->ring->peer = sockets[1];
+
+            if (token->output >= 0)
+            {
+                cloader_redirect_output(token->output);
+                token->output = -1;
+            }
+        
+            /* Run test procedure */
+            cloader_run_child(token, true);
+
+            /* Tear down ipc handle and close connection */
+            token->ipc_handle = NULL;
+            uipc_detach(ipc);
+            close(sockets[1]);
+
+            /* Exit (although it's unlikely we'll get here) */
+            exit(0);
+        }
+    }
+
+    if (pid < 0)
+    {
+        close(sockets[0]);
+        close(sockets[1]);
+        ctoken_free_fork(token);
+        return false;
+    }
+
+    /* Parent */
+
+    /* Set up ipc handle, close unneeded socket end */
+    token->ipc_handle = uipc_attach(sockets[0]);
+    close(sockets[1]);
+        
+    /* Set up token */
+    token->child = pid;
+
+    cloader_job_begin(job, token, sockets[0], zygote);
+
+    return true;
+}
+
+/* Passes on the events the child has written into its ring, stopping
+   at a detour record unless all is set because no more will arrive */
+static void
+cloader_job_drain(CJob* job, bool all)
+{
+    CRing* ring = job->token->ring;
+    unsigned int type;
+    const void* payload;
+    MuLogEvent* event;
+
+    if (!ring || (job->detour && !all))
+    {
+        return;
+    }
+
+    while (ring_peek(ring, &type, &payload))
+    {
+        if (type == MSG_TYPE_EVENT)
+        {
+            uipc_unmarshal_payload((void**) &event, payload, &logevent_info);
+            ring_release(ring);
+            job->cb(event, job->data);
+            uipc_msg_free_payload(event, &logevent_info);
+        }
+        else if (type == RING_DETOUR && !all)
+        {
+            /* The next event comes over the socket */
+            ring_release(ring);
+            job->detour = true;
+            break;
+        }
+        else
+        {
+            ring_release(ring);
+        }
+    }
+}
+
+/* Handles the outcome of one attempt to receive a message from the child */
+static void
+cloader_job_process(CJob* job, uipc_status status, uipc_message* message)
+{
+    job->status = status;
+
+    /* Whatever came through the socket was sent after these, up to
+       where an event too large for the ring was left out of it */
+    cloader_job_drain(job, status != UIPC_SUCCESS);
+
+    if (status == UIPC_SUCCESS)
+    {
+        switch (uipc_msg_get_type(message))
+        {
+        case MSG_TYPE_RESULT:
+            job->summary = uipc_msg_take_payload(message, &testresult_info);
+            /* Attachments came separately and are added when finishing */
+            job->summary->attachments = NULL;
+            job->harvesting = false;
+            break;
+        case MSG_TYPE_EVENT:
+        {
+            /* Only needed for as long as the callback */
+            MuLogEvent* event = uipc_msg_view_payload(message, &logevent_info);
+            job->cb(event, job->data);
+
+            /* Events in the ring after this one were held back for it */
+            if (job->detour)
+            {
+                job->detour = false;
+                cloader_job_drain(job, false);
+            }
+            break;
+        } 
+        case MSG_TYPE_EXPECT:
+        {
+            ExpectMsg* msg = uipc_msg_get_payload(message, &expect_info);
+            job->token->expected = msg->expect_status;
+            uipc_msg_free_payload(msg, &expect_info);
+            break;
+        }
+        case MSG_TYPE_TIMEOUT:
+        {
+            TimeoutMsg* msg = uipc_msg_get_payload(message, &timeout_info);
+            job->timeout = msg->timeout;
+            uipc_time_current_offset(&job->deadline, 0, job->timeout * 1000);
+            uipc_msg_free_payload(msg, &timeout_info);
+            break;
+        }
+        case MSG_TYPE_ITERATIONS:
+        {
+            IterationsMsg* msg = uipc_msg_get_payload(message, &iterations_info);
+            job->iterations = msg->count;
+            uipc_msg_free_payload(msg, &iterations_info);
+            break;
+        }
+        case MSG_TYPE_ATTACH:
+        {
+            AttachMsg* msg = uipc_msg_view_payload(message, &attach_info);
+            int fd = uipc_msg_take_fd(message);
+
+            if (fd >= 0)
+                attach_append(&job->token->attachments, msg->name, fd);
+            break;
+        }
+        }
+
+        uipc_msg_free(message);
+    }
+    /* If the test timed out */
+    else if (status == UIPC_TIMEOUT && !job->timedout)
+    {
+        /* Poke the child process to give it a chance to send us results */
+        kill(job->token->child, SIGTERM);
+        /* Put another 10th of a second on the clock */
+        uipc_time_current_offset(&job->deadline, 0, 100 * 1000);
+        /* Keep processing events */
+        job->timedout = true;
+    }
+    else
+    {
+        job->harvesting = false;
+    }
+}
+
+/* Reaps the child of a job and produces the final result of the run */
+static MuTestResult*
+cloader_job_finish(CJob* job)
+{
+    CTokenFork* token = job->token;
+    MuTestResult* summary = job->summary;
+    struct rusage usage;
+    struct stat output;
+    int status = 0;
+    bool parked = false;
+    bool reaped = false;
+
+    if (use_batch && summary && !job->timedout && !job->cancelled)
+    {
+        parked = cloader_job_park(job);
+    }
+
+    if (job->cpu >= 0)
+    {
+        /* A batch worker may go on to run anything */
+        if (parked)
+            benchmark_pin(token->child, -1);
+        benchmark_cpu_release(job->cpu);
+        job->cpu = -1;
+    }
+
+    /* Wait for up to 500 ms for the child to finish exiting */
+    if (!parked)
+    {
+        if (job->zygote)
+            reaped = !zygote_wait(job->zygote, token->child, &status, &usage, 500);
+        else
+            reaped = !wait_child(token->child, &status, &usage, 500);
+    }
+        
+    if (!summary)
+    {
+        summary = xcalloc(1, sizeof(MuTestResult));
+        // Killed before it could finish
+        if (job->cancelled)
+        {
+            summary->expected = token->expected;
+            summary->status = MU_STATUS_SKIPPED;
+            summary->reason = strdup("Test cancelled");
+            summary->stage = MU_STAGE_UNKNOWN;
+            summary->line = 0;
+        }
+        // Timed out waiting for response
+        else if (job->status == UIPC_TIMEOUT)
+        {
+            char* reason = format("Test timed out after %li milliseconds", job->timeout);
+            
+            summary->expected = token->expected;
+            summary->status = MU_STATUS_TIMEOUT;
+            summary->reason = reason;
+            summary->stage = MU_STAGE_UNKNOWN;
+            summary->line = 0;
+        }
+        // Couldn't get message or an error occurred, try to figure out what happend
+        else if (WIFSIGNALED(status))
+        {
+            summary->expected = token->expected;
+            summary->status = MU_STATUS_CRASH;
+            summary->stage = MU_STAGE_UNKNOWN;
+            summary->line = 0;
+            
+            if (WTERMSIG(status))
+                summary->reason = signal_description(WTERMSIG(status));
+        }
+        else
+        {
+            summary->status = MU_STATUS_FAILURE;
+            summary->stage = MU_STAGE_UNKNOWN;
+            summary->line = 0;
+            summary->reason = strdup("Unexpected termination");
+        }
+    }
+    else
+    {
+        summary->expected = token->expected;
+        /* If we timed out, change the test result to reflect this */
+        if (job->timedout)
+        {
+            summary->status = MU_STATUS_TIMEOUT;
+            if (summary->reason)
+                uipc_msg_free_member(summary, (void*) summary->reason);
+            summary->reason = format("Test timed out after %li milliseconds", job->timeout);
+        }
+    }
+
+    /* A child which ran nothing but this test is measured best from
+       outside, and this also covers children which never reported.
+       A batch worker has run other tests, so trust its own figures */
+    if (reaped && have_child_usage && !use_batch)
+    {
+        if (!summary->usage)
+        {
+            summary->usage = xcalloc(1, sizeof(MuTestUsage));
+            summary->usage->read_bytes = -1;
+            summary->usage->write_bytes = -1;
+        }
+
+        usage_from_rusage(summary->usage, &usage);
+    }
+
+    /* Attachments survive the test crashing or timing out */
+    summary->attachments = token->attachments;
+    token->attachments = NULL;
+
+    /* Output is only looked at if there is a reason to */
+    if (token->output >= 0 &&
+        (show_output ||
+         (summary->status != MU_STATUS_SKIPPED && summary->status != summary->expected)) &&
+        !fstat(token->output, &output) && output.st_size > 0)
+    {
+        attach_append(&summary->attachments, MU_ATTACHMENT_OUTPUT, token->output);
+        token->output = -1;
+    }
+
+    /* Tear down ipc handle and close connection */
+    if (!parked)
+    {
+        uipc_detach(token->ipc_handle);
+        close(job->socket);
+    }
+
+    /* Free token */
+    ctoken_free_fork(token);
+
+    job->token = NULL;
+    job->summary = NULL;
+
+    return summary;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/* Adds a running job to the supervisor */
+static void
+cloader_job_watch(CJob* job)
+{
+    struct epoll_event event;
+
+    if (supervisor_broken)
+    {
+        return;
+    }
+
+    if (supervisor < 0 && (supervisor = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    {
+        supervisor_broken = true;
+        return;
+    }
+
+    job->watch_socket.job = job;
+    job->watch_socket.kind = WATCH_SOCKET;
+    event.events = EPOLLIN;
+    event.data.ptr = &job->watch_socket;
+
+    if (epoll_ctl(supervisor, EPOLL_CTL_ADD, job->socket, &event) < 0)
+    {
+        /* Go back to polling the sockets of all jobs */
+        close(supervisor);
+        supervisor = -1;
+        supervisor_broken = true;
+        return;
+    }
+
+    /* Watching the exit of the child lets us notice it even if
+       something it left behind still holds its socket open */
+    if ((job->pidfd = pid_open(job->token->child)) >= 0)
+    {
+        job->watch_exit.job = job;
+        job->watch_exit.kind = WATCH_EXIT;
+        event.events = EPOLLIN;
+        event.data.ptr = &job->watch_exit;
+
+        if (epoll_ctl(supervisor, EPOLL_CTL_ADD, job->pidfd, &event) < 0)
+        {
+            close(job->pidfd);
+            job->pidfd = -1;
+        }
+    }
+
+    if (job->token->ring)
+    {
+        job->watch_ring.job = job;
+        job->watch_ring.kind = WATCH_RING;
+        event.events = EPOLLIN;
+        event.data.ptr = &job->watch_ring;
+
+        /* The socket still wakes us for the result, and the
+           ring is drained then, so events are only held up */
+        epoll_ctl(supervisor, EPOLL_CTL_ADD, job->token->ring->eventfd, &event);
+    }
+}
+
+/* Removes a job from the supervisor */
+static void
+cloader_job_unwatch(CJob* job)
+{
+    if (supervisor >= 0)
+    {
+        epoll_ctl(supervisor, EPOLL_CTL_DEL, job->socket, NULL);
+
+        if (job->pidfd >= 0)
+            epoll_ctl(supervisor, EPOLL_CTL_DEL, job->pidfd, NULL);
+
+        if (job->token->ring)
+            epoll_ctl(supervisor, EPOLL_CTL_DEL, job->token->ring->eventfd, NULL);
+    }
+
+    if (job->pidfd >= 0)
+    {
+        close(job->pidfd);
+        job->pidfd = -1;
+    }
+}
+
+/* Waits for events from the supervisor and flags the jobs they are for */
+static void
+cloader_poll_supervisor(unsigned int count, int wait)
+{
+    /* Each job watches at most its socket, its exit and its ring */
+    struct epoll_event* events = xcalloc(count * 3, sizeof(*events));
+    CWatch* watch;
+    int ready;
+    int i;
+
+    ready = epoll_wait(supervisor, events, count * 3, wait);
+
+    for (i = 0; i < ready; i++)
+    {
+        watch = (CWatch*) events[i].data.ptr;
+
+        switch (watch->kind)
+        {
+        case WATCH_SOCKET:
+            watch->job->readable = true;
+            break;
+        case WATCH_EXIT:
+            watch->job->exited = true;
+            break;
+        case WATCH_RING:
+            watch->job->ring_ready = true;
+            break;
+        }
+    }
+
+    free(events);
+}
+#else
+static void
+cloader_job_watch(CJob* job)
+{
+}
+
+static void
+cloader_job_unwatch(CJob* job)
+{
+}
+#endif
+
+/* Finishes a run of a background job and either starts
+   its next iteration or queues it for cloader_dispatch_wait */
+static void
+cloader_job_complete(CJob* job)
+{
+    MuTestResult* result = cloader_job_finish(job);
+
+    if (result->status != MU_STATUS_SKIPPED &&
+        result->status == result->expected &&
+        !job->cancelled &&
+        ++job->iteration < job->iterations)
+    {
+        cloader_free_result(NULL, result);
+
+        if (cloader_job_spawn(job))
+        {
+            job->next = running_jobs;
+            running_jobs = job;
+            cloader_job_watch(job);
+            return;
+        }
+
+        result = spawn_failure();
+    }
+
+    job->summary = result;
+    job->next = finished_jobs;
+    finished_jobs = job;
+}
+
+/* Polls the sockets and rings of all running jobs and flags the ready ones */
+static void
+cloader_poll_sockets(unsigned int count, int wait)
+{
+    /* Each job has a socket and maybe a ring, whose slot is otherwise ignored */
+    struct pollfd* fds = xcalloc(count * 2, sizeof(*fds));
+    unsigned int i;
+    CJob* job;
 
-    uipc_time_current_offset(&deadline, 0, timeout * 1000);
+    for (i = 0, job = running_jobs; job; i++, job = job->next)
+    {
+        fds[i * 2].fd = job->socket;
+        fds[i * 2].events = POLLIN;
+        fds[i * 2 + 1].fd = job->token->ring ? job->token->ring->eventfd : -1;
+        fds[i * 2 + 1].events = POLLIN;
+    }
 
-process:
-    while (!done)
-    {    
-        uipc_result = uipc_recv(ipc, &message, &deadline);
-        
-        if (uipc_result == UIPC_SUCCESS)
-        {
-            switch (uipc_msg_get_type(message))
-            {
-            case MSG_TYPE_RESULT:
-                summary = uipc_msg_get_payload(message, &testresult_info);
-                done = true;
-                break;
-            case MSG_TYPE_EVENT:
-            {
-                MuLogEvent* event = uipc_msg_get_payload(message, &logevent_info);
-                cb(event, cb_data);
-                uipc_msg_free_payload(event, &logevent_info);
-                uipc_msg_free(message);
-                message = NULL;
-                break;
-            } 
-            case MSG_TYPE_EXPECT:
-            {
-                ExpectMsg* msg = uipc_msg_get_payload(message, &expect_info);
-                token->expected = msg->expect_status;
-                uipc_msg_free_payload(msg, &expect_info);
-                uipc_msg_free(message);
-                message = NULL;
-                break;
-            }
-            case MSG_TYPE_TIMEOUT:
-            {
-                TimeoutMsg* msg = uipc_msg_get_payload(message, &timeout_info);
-                timeout = msg->timeout;
-                uipc_time_current_offset(&deadline, 0, timeout * 1000);
-                uipc_msg_free_payload(msg, &timeout_info);
-                uipc_msg_free(message);
-                message = NULL;
-                break;
-            }
-            case MSG_TYPE_ITERATIONS:
-            {
-                IterationsMsg* msg = uipc_msg_get_payload(message, &iterations_info);
-                *iterations = msg->count;
-                uipc_msg_free_payload(msg, &iterations_info);
-                uipc_msg_free(message);
-                message = NULL;
-                break;
-            }
-            }
-        }
-        else
+    if (poll(fds, count * 2, wait) > 0)
+    {
+        for (i = 0, job = running_jobs; job; i++, job = job->next)
         {
-            done = true;
+            if (fds[i * 2].revents)
+                job->readable = true;
+            if (fds[i * 2 + 1].revents)
+                job->ring_ready = true;
         }
     }
-     
-    /* If the test timed out */
-    if (uipc_result == UIPC_TIMEOUT && !timedout)
+
+    free(fds);
+}
+
+/* Returns whether a socket has anything to read right now */
+static bool
+socket_ready(int socket)
+{
+    struct pollfd fd;
+
+    fd.fd = socket;
+    fd.events = POLLIN;
+    fd.revents = 0;
+
+    return poll(&fd, 1, 0) > 0;
+}
+
+/* Waits until the deadline of a running job passes or any
+   of their children have something to say or exit, and handles it */
+static void
+cloader_poll_jobs(void)
+{
+    unsigned int count = 0;
+    int wait = -1;
+    long ms;
+    uipc_time now, diff;
+    uipc_message* message = NULL;
+    uipc_status status;
+    CJob* job, **link;
+    CJob* complete = NULL;
+
+    uipc_time_current(&now);
+
+    for (job = running_jobs; job; job = job->next)
     {
-        /* Poke the child process to give it a chance to send us results */
-        kill(token->child, SIGTERM);
-        /* Put another 10th of a second on the clock */
-        uipc_time_current_offset(&deadline, 0, 100 * 1000);
-        /* Go back into the event processing loop */
-        timedout = true;
-        done = false;
-        goto process;
+        count++;
+
+        uipc_time_difference(&now, &job->deadline, &diff);
+        ms = diff.seconds * 1000 + (diff.microseconds + 999) / 1000;
+
+        if (ms < 0)
+            ms = 0;
+        if (wait < 0 || ms < wait)
+            wait = (int) ms;
     }
 
-    /* Wait for up to 500 ms for the child to finish exiting */
-    wait_child(token->child, &status, 500);
-        
-    if (!summary)
+#ifdef HAVE_SYS_EPOLL_H
+    if (supervisor >= 0)
+        cloader_poll_supervisor(count, wait);
+    else
+#endif
+        cloader_poll_sockets(count, wait);
+
+    for (link = &running_jobs; (job = *link);)
     {
-        summary = xcalloc(1, sizeof(MuTestResult));
-        // Timed out waiting for response
-        if (uipc_result == UIPC_TIMEOUT)
+        if (job->ring_ready)
         {
-            char* reason = format("Test timed out after %li milliseconds", timeout);
-            
-            summary->expected = token->expected;
-            summary->status = MU_STATUS_TIMEOUT;
-            summary->reason = reason;
-            summary->stage = MU_STAGE_UNKNOWN;
-            summary->line = 0;
+            ring_acknowledge(job->token->ring);
+            cloader_job_drain(job, false);
+            job->ring_ready = false;
         }
-        // Couldn't get message or an error occurred, try to figure out what happend
-        else if (WIFSIGNALED(status))
+
+        if (job->readable || (job->exited && socket_ready(job->socket)))
         {
-            summary->expected = token->expected;
-            summary->status = MU_STATUS_CRASH;
-            summary->stage = MU_STAGE_UNKNOWN;
-            summary->line = 0;
-            
-            if (WTERMSIG(status))
-                summary->reason = signal_description(WTERMSIG(status));
+            /* One read may bring in many messages, and once it has
+               the socket will not say there are more */
+            do
+            {
+                message = NULL;
+                status = uipc_recv(job->token->ipc_handle, &message, &job->deadline);
+                cloader_job_process(job, status, message);
+            } while (status == UIPC_SUCCESS && job->harvesting &&
+                     uipc_pending(job->token->ipc_handle));
+        }
+        else if (job->exited)
+        {
+            /* The child is gone and said all it had to say, even
+               if something it left behind holds its socket open */
+            cloader_job_process(job, UIPC_EOF, NULL);
+        }
+        else if (uipc_time_is_past(&job->deadline))
+        {
+            cloader_job_process(job, UIPC_TIMEOUT, NULL);
+        }
+
+        job->readable = false;
+
+        if (job->harvesting)
+        {
+            link = &job->next;
         }
         else
         {
-            summary->status = MU_STATUS_FAILURE;
-            summary->stage = MU_STAGE_UNKNOWN;
-            summary->line = 0;
-            summary->reason = strdup("Unexpected termination");
+            cloader_job_unwatch(job);
+            *link = job->next;
+            job->next = complete;
+            complete = job;
         }
     }
-    else
+
+    /* Reap finished children only after the scan, since this
+       may fork their next iterations onto the running list */
+    while ((job = complete))
     {
-        summary->expected = token->expected;
-        /* If we timed out, change the test result to reflect this */
-        if (timedout)
-        {
-            summary->status = MU_STATUS_TIMEOUT;
-            if (summary->reason)
-                free((void*) summary->reason);
-            summary->reason = format("Test timed out after %li milliseconds", timeout);
-        }
+        complete = job->next;
+        cloader_job_complete(job);
     }
-    
-    if (message)
-        uipc_msg_free(message);
-    
-    return summary;
 }
 
-static MuTestResult*
-cloader_run_fork(MuTest* test, MuLogCallback cb, void* data, MuLogLevel max_level,
-                 unsigned int* iterations)
+/* Starts a test running under the supervisor */
+static CJob*
+cloader_job_start(MuTest* test, MuLogCallback cb, void* data, MuLogLevel max_level)
 {
-    int sockets[2];
-    pid_t pid;
-    CTokenFork* token = ctoken_new_fork(test);
+    CJob* job = xcalloc(1, sizeof(CJob));
 
-    current_token = &token->base;
-    
-    socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
-    
-    /* We must force a flush of all open output streams or the child
-     * will end up flushing non-empty buffers on exit, resulting in
-     * bizarre duplicate output
-     */
+    job->test = test;
+    job->cb = cb;
+    job->data = data;
+    job->max_level = max_level;
+    job->iterations = default_iterations;
 
-    fflush(NULL);
-    
-    if (!(pid = fork()))
+    if (!cloader_job_spawn(job))
     {
-        /* Child */
-        
-        uipc_handle* ipc;
-                
-        /* Set up ipc handle, close unneeded socket end */
-        ipc = uipc_attach(sockets[1]);
-        close(sockets[0]);
-        
-        /* Set up token */
-        token->ipc_handle = ipc;
-        token->max_log_level = max_level;
-        token->child = getpid();
-        
-        /* Run test procedure */
-        cloader_run_child(test, token);
+        free(job);
+        return NULL;
+    }
 
-        /* Tear down ipc handle and close connection */
-        uipc_detach(ipc);
-        close(sockets[1]);
+    job->next = running_jobs;
+    running_jobs = job;
+
+    cloader_job_watch(job);
+
+    return job;
+}
 
-        /* Exit (although it's unlikely we'll get here) */
-        exit(0);
+/* Removes a job from the finished list if it is there */
+static bool
+cloader_job_take(CJob* job)
+{
+    CJob** link;
+
+    for (link = &finished_jobs; *link; link = &(*link)->next)
+    {
+        if (*link == job)
+        {
+            *link = job->next;
+            return true;
+        }
     }
-    else
+
+    return false;
+}
+
+bool
+cloader_dispatch_start(MuLoader* _self, MuTest* test, MuLogCallback cb, void* data, MuLogLevel max_level)
+{
+    /* Debug mode runs tests in-process, one at a time */
+    if (is_debug)
     {
-        /* Parent */
-        
-        uipc_handle* ipc;
-        MuTestResult* result;
+        return false;
+    }
 
-        /* Set up ipc handle, close unneeded socket end */
-        ipc = uipc_attach(sockets[0]);
-        close(sockets[1]);
-        
-        /* Set up token */
-        token->ipc_handle = ipc;
-        token->child = pid;
+    return cloader_job_start(test, cb, data, max_level) != NULL;
+}
 
-        /* Harvest events/result from child */
-        result = cloader_run_parent(test, token, cb, data, iterations);
+MuTestResult*
+cloader_dispatch_wait(MuLoader* _self, void** data)
+{
+    CJob* job = NULL;
+    MuTestResult* result = NULL;
 
-        /* Tear down ipc handle and close connection */
-        uipc_detach(ipc);
-        close(sockets[0]);
+    while (!finished_jobs)
+    {
+        if (!running_jobs)
+        {
+            return NULL;
+        }
 
-        /* Free token */
-        ctoken_free_fork(token);
+        cloader_poll_jobs();
+    }
 
-        return result;
+    job = finished_jobs;
+    finished_jobs = job->next;
+
+    *data = job->data;
+    result = job->summary;
+
+    free(job);
+
+    return result;
+}
+
+void
+cloader_dispatch_cancel(MuLoader* _self)
+{
+    CJob* job;
+
+    /* The supervisor notices the children exit and finishes
+       each job as usual, as skipped if it had no result yet */
+    for (job = running_jobs; job; job = job->next)
+    {
+        if (!job->cancelled)
+        {
+            job->cancelled = true;
+            kill(job->token->child, SIGKILL);
+        }
     }
 }
 
@@ -980,6 +3070,7 @@ cloader_run_thunk_inproc(MuThunk thunk)
 void
 cloader_free_result(MuLoader* _self, MuTestResult* result)
 {
+    attach_free(result->attachments);
     uipc_msg_free_payload(result, &testresult_info);
 }
 
@@ -1085,23 +3176,36 @@ cloader_dispatch(MuLoader* _self, MuTest* test, MuLogCallback cb, void* data, Mu
     unsigned int iterations = default_iterations;
     unsigned int i;
     MuTestResult* result = NULL;
+    CJob* job = NULL;
 
-    for (i = 0; i < iterations; i++)
+    if (!is_debug)
     {
-        if (result)
+        if (!(job = cloader_job_start(test, cb, data, max_level)))
         {
-            cloader_free_result(_self, result);
+            return spawn_failure();
         }
 
-        if (is_debug)
+        /* Iterations are taken care of as the job completes */
+        while (!cloader_job_take(job))
         {
-            result = cloader_debug(test, cb, data, max_level, &iterations);
+            cloader_poll_jobs();
         }
-        else
+
+        result = job->summary;
+        free(job);
+
+        return result;
+    }
+
+    for (i = 0; i < iterations; i++)
+    {
+        if (result)
         {
-            result = cloader_run_fork(test, cb, data, max_level, &iterations);
+            cloader_free_result(_self, result);
         }
 
+        result = cloader_debug(test, cb, data, max_level, &iterations);
+
         if (result->status == MU_STATUS_SKIPPED || result->status != result->expected)
             break;
     }
@@ -1139,6 +3243,9 @@ cloader_destruct(MuLoader* _self, MuLibrary* _library, MuError** err)
     CLibrary* library = (CLibrary*) _library;
     MuTestResult* result = NULL;
 
+    cloader_worker_stop(_library);
+    zygote_stop(_library);
+
     if (library->library_destruct)
     {
         result = cloader_run_thunk_inproc(library->library_destruct->run);
@@ -1185,6 +3292,118 @@ iterations_get(MuLoader* self)
     return (int) default_iterations;
 }
 
+static
+void
+stress_set(MuLoader* self, int count)
+{
+    default_stress = count > 0 ? count : 0;
+}
+
+static
+int
+stress_get(MuLoader* self)
+{
+    return (int) default_stress;
+}
+
+static
+void
+batch_set(MuLoader* self, bool set)
+{
+    use_batch = set;
+}
+
+static
+bool
+batch_get(MuLoader* self)
+{
+    return use_batch;
+}
+
+static
+void
+zygote_set(MuLoader* self, bool set)
+{
+    use_zygote = set;
+}
+
+static
+bool
+zygote_get(MuLoader* self)
+{
+    return use_zygote;
+}
+
+static
+void
+perf_set(MuLoader* self, bool set)
+{
+    use_perf = set;
+}
+
+static
+bool
+perf_get(MuLoader* self)
+{
+    return use_perf;
+}
+
+static
+void
+ring_set(MuLoader* self, bool set)
+{
+    use_ring = set;
+}
+
+static
+bool
+ring_get(MuLoader* self)
+{
+    return use_ring;
+}
+
+static
+void
+capture_set(MuLoader* self, bool set)
+{
+    use_capture = set;
+}
+
+static
+bool
+capture_get(MuLoader* self)
+{
+    return use_capture;
+}
+
+static
+void
+show_output_set(MuLoader* self, bool set)
+{
+    show_output = set;
+}
+
+static
+bool
+show_output_get(MuLoader* self)
+{
+    return show_output;
+}
+
+static
+void
+benchmark_precision_set(MuLoader* self, double precision)
+{
+    benchmark_precision = precision;
+}
+
+static
+double
+benchmark_precision_get(MuLoader* self)
+{
+    return benchmark_precision;
+}
+
 static
 void
 debug_set(MuLoader* self, bool set)
@@ -1209,7 +3428,39 @@ MuOption cloader_options[] =
     MU_OPTION("iterations", MU_TYPE_INTEGER, iterations_get, iterations_set,
               "The number of times each test is run (unless specified by the test)"),
 
+    MU_OPTION("stress", MU_TYPE_INTEGER, stress_get, stress_set,
+              "If above 1, also run each test as this many copies at once on "
+              "threads of its own (unless specified by the test)"),
+
     MU_OPTION("debug", MU_TYPE_BOOLEAN, debug_get, debug_set,
               "Whether to run in debug mode (avoid forking)"),
+
+    MU_OPTION("zygote", MU_TYPE_BOOLEAN, zygote_get, zygote_set,
+              "Whether to run library setup once and fork each test "
+              "from the resulting process"),
+
+    MU_OPTION("batch", MU_TYPE_BOOLEAN, batch_get, batch_set,
+              "Whether to run tests one after another in the same process "
+              "until one ends early or is marked unsafe"),
+
+    MU_OPTION("ring", MU_TYPE_BOOLEAN, ring_get, ring_set,
+              "Whether children send log events through a ring buffer in "
+              "shared memory rather than the socket, where the system allows"),
+
+    MU_OPTION("capture", MU_TYPE_BOOLEAN, capture_get, capture_set,
+              "Whether the standard output and error of each test go into a "
+              "file of their own rather than the terminal"),
+
+    MU_OPTION("show_output", MU_TYPE_BOOLEAN, show_output_get, show_output_set,
+              "Whether output is captured and attached to the results of "
+              "tests which pass, and not only those which fail"),
+
+    MU_OPTION("perf_counters", MU_TYPE_BOOLEAN, perf_get, perf_set,
+              "Whether to count CPU cycles, instructions, cache misses, "
+              "branch misses and task clock during the test stage"),
+
+    MU_OPTION("benchmark_precision", MU_TYPE_FLOAT, benchmark_precision_get, benchmark_precision_set,
+              "If not 0, pin benchmarks to CPUs of their own and take samples until the "
+              "95% confidence interval is within this percentage of the mean"),
     MU_OPTION_END
 };
@@ -30,6 +30,10 @@
 
 MuTestResult* cloader_dispatch(MuLoader* _self, MuTest* test, MuLogCallback cb, void* data,
                                MuLogLevel max_level);
+bool cloader_dispatch_start(MuLoader* _self, MuTest* test, MuLogCallback cb, void* data,
+                            MuLogLevel max_level);
+MuTestResult* cloader_dispatch_wait(MuLoader* _self, void** data);
+void cloader_dispatch_cancel(MuLoader* _self);
 void cloader_free_result(MuLoader* _self, MuTestResult* result);
 void cloader_construct(MuLoader* _self, MuLibrary* _library, MuError** err);
 void cloader_destruct(MuLoader* _self, MuLibrary* _library, MuError** err);
@@ -36,6 +36,10 @@
 #include <moonunit/private/interface-private.h>
 #include <moonunit/loader.h>
 
+#include "perf.h"
+#include "metric.h"
+#include "ring.h"
+
 typedef struct
 {
     MuInterfaceToken base;
@@ -44,8 +48,44 @@ typedef struct
     MuLogLevel max_log_level;
     MuTest* current_test;
     uipc_handle* ipc_handle;
+    /* Shared memory events are sent through instead, if any */
+    CRing* ring;
+    /* When the oldest message still queued for the parent was queued */
+    double queued_since;
     pid_t child;
     pthread_mutex_t lock;
+    /* Set if running as a batch worker */
+    bool batch;
+    /* Set if the current test may not share its process */
+    bool unsafe;
+    /* Set once the current test got through every stage, so that
+       nothing it set up is left behind in the process */
+    bool finished;
+    /* Thread and point to return to for the next test */
+    pthread_t self;
+    sigjmp_buf jmpbuf;
+    /* Resource usage of the process when the current test began */
+    MuTestUsage baseline;
+    /* Set if performance counters are open for the test stage */
+    bool counting;
+    CPerf perf;
+    /* Timings of the current test, if it is a benchmark which finished */
+    bool benchmarked;
+    MuTestBenchmark benchmark;
+    /* Fit of the last complexity assertion in the current test, if any */
+    bool fitted;
+    MuTestComplexity complexity;
+    /* Copies of the current test to run at once after it runs alone */
+    unsigned int stress;
+    /* Set once the copies are started */
+    bool stressing;
+    MuTestStress stress_result;
+    /* Metrics recorded by the current test */
+    CMetric* metrics;
+    /* Attachments received from the child, in the parent */
+    MuTestAttachment* attachments;
+    /* File the child writes its output into, in the parent, or -1 */
+    int output;
 } CTokenFork;
 
 typedef struct
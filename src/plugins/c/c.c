@@ -48,6 +48,9 @@ MuLoader mu_cloader =
     .free_result = cloader_free_result,
     .construct = cloader_construct,
     .destruct = cloader_destruct,
+    .dispatch_start = cloader_dispatch_start,
+    .dispatch_wait = cloader_dispatch_wait,
+    .dispatch_cancel = cloader_dispatch_cancel,
     .options = cloader_options
 };
 
@@ -59,7 +62,7 @@ get_cloader()
 
 static MuPlugin plugin =
 {
-    .version = MU_PLUGIN_API_1,
+    .version = MU_PLUGIN_API_2,
     .type = MU_PLUGIN_LOADER,
     .name = "c",
     .author = "Brian Koropoff",
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#    include <config.h>
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <moonunit/private/util.h>
+
+#include "metric.h"
+
+/* Latencies are bucketed by their highest bits: values below
+   METRIC_SUB_BUCKETS each get a bucket, and every power of two above
+   is split into METRIC_SUB_BUCKETS buckets, so a bucket is never
+   wider than 1/32 of the values in it */
+#define METRIC_SUB_BITS 5
+#define METRIC_SUB_BUCKETS (1 << METRIC_SUB_BITS)
+#define METRIC_BUCKETS ((64 - METRIC_SUB_BITS + 1) * METRIC_SUB_BUCKETS)
+
+struct CMetric
+{
+    char* name;
+    MuMetricType type;
+    unsigned long long count;
+    double value;
+    double min;
+    double max;
+    double sum;
+    /* Histogram of a latency, allocated on first use */
+    unsigned long long* buckets;
+    struct CMetric* next;
+};
+
+static
+unsigned int
+bucket_index(unsigned long long value)
+{
+    unsigned int shift;
+
+    if (value < METRIC_SUB_BUCKETS)
+        return (unsigned int) value;
+
+    shift = 63 - __builtin_clzll(value) - METRIC_SUB_BITS;
+
+    return shift * METRIC_SUB_BUCKETS + (unsigned int) (value >> shift);
+}
+
+static
+unsigned long long
+bucket_upper(unsigned int index)
+{
+    unsigned int shift;
+
+    if (index < 2 * METRIC_SUB_BUCKETS)
+        return index;
+
+    shift = index / METRIC_SUB_BUCKETS - 1;
+
+    /* The last bucket runs to the largest value */
+    return (((unsigned long long) (index % METRIC_SUB_BUCKETS + METRIC_SUB_BUCKETS + 1)) << shift) - 1;
+}
+
+static
+CMetric*
+metric_find(CMetric** metrics, MuMetricType type, const char* name)
+{
+    CMetric** link;
+
+    for (link = metrics; *link; link = &(*link)->next)
+    {
+        if ((*link)->type == type && !strcmp((*link)->name, name))
+            return *link;
+    }
+
+    *link = xcalloc(1, sizeof(CMetric));
+    (*link)->name = safe_strdup(name);
+    (*link)->type = type;
+
+    return *link;
+}
+
+void
+metric_record(CMetric** metrics, MuMetricType type, const char* name, double value)
+{
+    CMetric* metric = metric_find(metrics, type, name);
+
+    switch (type)
+    {
+    case MU_METRIC_TYPE_COUNTER:
+        metric->value += value;
+        break;
+    case MU_METRIC_TYPE_LATENCY:
+        if (value < 0)
+            value = 0;
+        if (!metric->buckets)
+            metric->buckets = xcalloc(METRIC_BUCKETS, sizeof(*metric->buckets));
+        /* Values past the top of the range all land in the last bucket */
+        metric->buckets[value < 18446744073709551615.0 ?
+                        bucket_index((unsigned long long) value) :
+                        METRIC_BUCKETS - 1]++;
+        /* Fall through */
+    case MU_METRIC_TYPE_GAUGE:
+        metric->value = value;
+        if (!metric->count || value < metric->min)
+            metric->min = value;
+        if (!metric->count || value > metric->max)
+            metric->max = value;
+        metric->sum += value;
+        break;
+    }
+
+    metric->count++;
+}
+
+/* Reports a percentile as the top of the bucket it falls in, which is
+   never further from the true value than the width of the bucket */
+static
+double
+metric_percentile(CMetric* metric, double fraction)
+{
+    unsigned long long rank = (unsigned long long) (fraction * metric->count);
+    unsigned long long seen = 0;
+    unsigned int i;
+    double upper;
+
+    if (rank < fraction * metric->count)
+        rank++;
+    if (rank == 0)
+        rank = 1;
+
+    for (i = 0; i < METRIC_BUCKETS; i++)
+    {
+        seen += metric->buckets[i];
+
+        if (seen >= rank)
+            break;
+    }
+
+    upper = (double) bucket_upper(i < METRIC_BUCKETS ? i : METRIC_BUCKETS - 1);
+
+    if (upper > metric->max)
+        return metric->max;
+    else if (upper < metric->min)
+        return metric->min;
+    else
+        return upper;
+}
+
+MuTestMetric*
+metric_summarize(CMetric* metrics)
+{
+    MuTestMetric* summary = NULL;
+    MuTestMetric** link = &summary;
+    CMetric* metric;
+
+    for (metric = metrics; metric; metric = metric->next)
+    {
+        MuTestMetric* entry = xcalloc(1, sizeof(MuTestMetric));
+
+        entry->name = metric->name;
+        entry->type = metric->type;
+        entry->count = metric->count;
+        entry->value = metric->type == MU_METRIC_TYPE_LATENCY ? 0 : metric->value;
+
+        if (metric->type != MU_METRIC_TYPE_COUNTER)
+        {
+            entry->min = metric->min;
+            entry->max = metric->max;
+            entry->mean = metric->sum / metric->count;
+        }
+
+        if (metric->buckets)
+        {
+            unsigned int i;
+
+            entry->p50 = metric_percentile(metric, 0.50);
+            entry->p90 = metric_percentile(metric, 0.90);
+            entry->p99 = metric_percentile(metric, 0.99);
+            entry->p999 = metric_percentile(metric, 0.999);
+
+            for (i = 0; i < METRIC_BUCKETS; i++)
+            {
+                if (metric->buckets[i])
+                    entry->bucket_count++;
+            }
+
+            entry->buckets = xcalloc(entry->bucket_count, sizeof(MuMetricBucket));
+            entry->bucket_count = 0;
+
+            for (i = 0; i < METRIC_BUCKETS; i++)
+            {
+                if (metric->buckets[i])
+                {
+                    entry->buckets[entry->bucket_count].upper = bucket_upper(i);
+                    entry->buckets[entry->bucket_count].count = metric->buckets[i];
+                    entry->bucket_count++;
+                }
+            }
+        }
+
+        *link = entry;
+        link = &entry->next;
+    }
+
+    return summary;
+}
+
+void
+metric_free_summary(MuTestMetric* summary)
+{
+    while (summary)
+    {
+        MuTestMetric* next = summary->next;
+
+        free(summary->buckets);
+        free(summary);
+        summary = next;
+    }
+}
+
+void
+metric_clear(CMetric** metrics)
+{
+    while (*metrics)
+    {
+        CMetric* metric = *metrics;
+
+        *metrics = metric->next;
+        free(metric->name);
+        free(metric->buckets);
+        free(metric);
+    }
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#    include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#ifdef HAVE_SYS_SYSCALL_H
+#    include <sys/syscall.h>
+#endif
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#    include <linux/perf_event.h>
+#endif
+
+#include "perf.h"
+
+#if defined(HAVE_LINUX_PERF_EVENT_H) && defined(SYS_perf_event_open)
+
+#ifdef PERF_FLAG_FD_CLOEXEC
+#    define PERF_FD_FLAGS PERF_FLAG_FD_CLOEXEC
+#else
+#    define PERF_FD_FLAGS 0
+#endif
+
+static const struct
+{
+    unsigned int type;
+    unsigned long long config;
+} events[PERF_EVENT_COUNT] =
+{
+    /* In the same order as the fields of MuTestCounters */
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS}
+};
+
+void
+perf_open(CPerf* perf)
+{
+    struct perf_event_attr attr;
+    unsigned int i;
+
+    for (i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        /* Unprivileged users may only count their own code, but
+           software events are only ever seen in the kernel */
+        attr.exclude_kernel = events[i].type == PERF_TYPE_HARDWARE;
+        attr.exclude_hv = 1;
+        /* Counters share the PMU, so scale by the time each one ran */
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        /* Without a PMU, as in many virtual machines, only the
+           software events open and the rest are reported missing */
+        perf->fd[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FD_FLAGS);
+    }
+}
+
+static void
+perf_control(CPerf* perf, unsigned long request)
+{
+    unsigned int i;
+
+    for (i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        if (perf->fd[i] >= 0)
+            ioctl(perf->fd[i], request, 0);
+    }
+}
+
+void
+perf_reset(CPerf* perf)
+{
+    perf_control(perf, PERF_EVENT_IOC_DISABLE);
+    perf_control(perf, PERF_EVENT_IOC_RESET);
+}
+
+void
+perf_start(CPerf* perf)
+{
+    perf_control(perf, PERF_EVENT_IOC_ENABLE);
+}
+
+void
+perf_stop(CPerf* perf)
+{
+    perf_control(perf, PERF_EVENT_IOC_DISABLE);
+}
+
+bool
+perf_read(CPerf* perf, MuTestCounters* counters)
+{
+    long long* value = &counters->cycles;
+    /* Value, time enabled, time running */
+    unsigned long long data[3];
+    bool any = false;
+    unsigned int i;
+
+    for (i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        value[i] = -1;
+
+        if (perf->fd[i] < 0 || read(perf->fd[i], data, sizeof(data)) != sizeof(data))
+            continue;
+
+        if (data[2] && data[2] < data[1])
+            value[i] = (long long) ((double) data[0] * data[1] / data[2]);
+        else
+            value[i] = (long long) data[0];
+
+        any = true;
+    }
+
+    return any;
+}
+
+void
+perf_close(CPerf* perf)
+{
+    unsigned int i;
+
+    for (i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        if (perf->fd[i] >= 0)
+            close(perf->fd[i]);
+        perf->fd[i] = -1;
+    }
+}
+
+#else
+
+void
+perf_open(CPerf* perf)
+{
+    unsigned int i;
+
+    for (i = 0; i < PERF_EVENT_COUNT; i++)
+        perf->fd[i] = -1;
+}
+
+void
+perf_reset(CPerf* perf)
+{
+}
+
+void
+perf_start(CPerf* perf)
+{
+}
+
+void
+perf_stop(CPerf* perf)
+{
+}
+
+bool
+perf_read(CPerf* perf, MuTestCounters* counters)
+{
+    return false;
+}
+
+void
+perf_close(CPerf* perf)
+{
+}
+
+#endif
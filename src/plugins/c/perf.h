@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __MU_PERF_H__
+#define __MU_PERF_H__
+
+#include <stdbool.h>
+#include <moonunit/test.h>
+
+#define PERF_EVENT_COUNT 8
+
+/* Performance counters for the calling thread */
+typedef struct CPerf
+{
+    int fd[PERF_EVENT_COUNT];
+} CPerf;
+
+/* Opens whichever counters the system allows, all stopped */
+void perf_open(CPerf* perf);
+/* Stops the counters and sets them back to zero */
+void perf_reset(CPerf* perf);
+/* Starts or resumes counting */
+void perf_start(CPerf* perf);
+/* Stops counting, keeping the values so far */
+void perf_stop(CPerf* perf);
+/* Reads the counters, returning false if none could be opened */
+bool perf_read(CPerf* perf, MuTestCounters* counters);
+void perf_close(CPerf* perf);
+
+#endif
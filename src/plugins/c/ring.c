@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#    include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <moonunit/private/util.h>
+
+#include "ring.h"
+
+#ifdef HAVE_RING
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+/* Room for messages, which must be a multiple of 8 */
+#define RING_SIZE (256 * 1024)
+/* Space before the messages for the positions of both sides */
+#define RING_HEADER 4096
+/* Messages larger than this go some other way */
+#define RING_MAX_RECORD (RING_SIZE / 4)
+/* Length of the marker telling the reader to go back to the start */
+#define RING_WRAP 0xFFFFFFFFU
+/* Time to wait for the reader to make room, in milliseconds */
+#define RING_WAIT_MS 1
+
+#define RING_ALIGN(n) (((n) + 7) & ~7UL)
+
+typedef struct CRingRecord
+{
+    unsigned int length;
+    unsigned int type;
+    char payload[];
+} CRingRecord;
+
+/* Positions are counts of bytes ever written or read, kept on separate
+   cache lines since each is only advanced by one side */
+struct CRingShared
+{
+    unsigned long head;
+    char pad[64 - sizeof(unsigned long)];
+    unsigned long tail;
+    /* Set by the reader when it found the ring empty and wants waking */
+    int waiting;
+};
+
+static
+CRing*
+ring_map(int memfd, int eventfd)
+{
+    CRing* ring;
+    void* base = mmap(NULL, RING_HEADER + RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    ring = xmalloc(sizeof(CRing));
+    ring->memfd = memfd;
+    ring->eventfd = eventfd;
+    ring->shared = base;
+    ring->data = (char*) base + RING_HEADER;
+    ring->peer = -1;
+
+    return ring;
+}
+
+CRing*
+ring_new(void)
+{
+    CRing* ring = NULL;
+    int memfd = -1;
+    int eventfd_ = -1;
+
+    if ((memfd = memfd_create("moonunit-ring", MFD_CLOEXEC)) < 0 ||
+        ftruncate(memfd, RING_HEADER + RING_SIZE) < 0 ||
+        (eventfd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0 ||
+        !(ring = ring_map(memfd, eventfd_)))
+    {
+        if (memfd >= 0)
+            close(memfd);
+        if (eventfd_ >= 0)
+            close(eventfd_);
+        return NULL;
+    }
+
+    /* The first message wakes the reader */
+    ring->shared->waiting = 1;
+
+    return ring;
+}
+
+CRing*
+ring_attach(int memfd, int eventfd)
+{
+    return ring_map(memfd, eventfd);
+}
+
+void
+ring_free(CRing* ring)
+{
+    munmap(ring->shared, RING_HEADER + RING_SIZE);
+    close(ring->memfd);
+    close(ring->eventfd);
+    free(ring);
+}
+
+static
+void
+ring_kick(CRing* ring)
+{
+    uint64_t one = 1;
+
+    (void) write(ring->eventfd, &one, sizeof(one));
+}
+
+/* Wakes the reader if it is waiting for something to be written */
+static
+void
+ring_notify(CRing* ring)
+{
+    if (__atomic_exchange_n(&ring->shared->waiting, 0, __ATOMIC_SEQ_CST))
+        ring_kick(ring);
+}
+
+/* Gives the reader a moment to make room, returning false if it has gone */
+static
+bool
+ring_wait(CRing* ring)
+{
+    struct pollfd fd;
+
+    ring_kick(ring);
+
+    if (ring->peer < 0)
+    {
+        usleep(RING_WAIT_MS * 1000);
+        return true;
+    }
+
+    fd.fd = ring->peer;
+    fd.events = 0;
+    fd.revents = 0;
+
+    return !(poll(&fd, 1, RING_WAIT_MS) > 0 && (fd.revents & (POLLHUP | POLLERR)));
+}
+
+bool
+ring_write(CRing* ring, unsigned int type, const void* payload, uipc_typeinfo* info)
+{
+    struct CRingShared* shared = ring->shared;
+    unsigned long head = shared->head;
+    unsigned long tail, pos, room, contiguous, length, needed;
+    CRingRecord* record;
+    bool detour = false;
+
+    for (;;)
+    {
+        tail = __atomic_load_n(&shared->tail, __ATOMIC_ACQUIRE);
+        pos = head % RING_SIZE;
+        room = RING_SIZE - (head - tail);
+        contiguous = RING_SIZE - pos < room ? RING_SIZE - pos : room;
+        record = (CRingRecord*) (ring->data + pos);
+
+        /* Marshal straight into the free space; if it does not fit, this
+           only tells us how much is needed and nobody reads what it wrote */
+        length = detour ? 0 :
+            uipc_marshal_payload(record->payload,
+                                 contiguous > sizeof(CRingRecord) ? contiguous - sizeof(CRingRecord) : 0,
+                                 payload, info);
+        needed = sizeof(CRingRecord) + RING_ALIGN(length);
+
+        if (needed > RING_MAX_RECORD)
+        {
+            /* Leave a record saying where the message belongs instead */
+            detour = true;
+        }
+        else if (needed <= contiguous)
+        {
+            record->length = (unsigned int) length;
+            record->type = detour ? RING_DETOUR : type;
+            __atomic_store_n(&shared->head, head + needed, __ATOMIC_SEQ_CST);
+            ring_notify(ring);
+            return !detour;
+        }
+        else if (RING_SIZE - pos < needed && room >= RING_SIZE - pos)
+        {
+            /* The end of the ring is free but too small, so skip it */
+            record->length = RING_WRAP;
+            head += RING_SIZE - pos;
+            __atomic_store_n(&shared->head, head, __ATOMIC_RELEASE);
+        }
+        else if (!ring_wait(ring))
+        {
+            return true;
+        }
+    }
+}
+
+bool
+ring_peek(CRing* ring, unsigned int* type, const void** payload)
+{
+    struct CRingShared* shared = ring->shared;
+    unsigned long tail, head;
+    CRingRecord* record;
+
+    for (;;)
+    {
+        tail = shared->tail;
+        head = __atomic_load_n(&shared->head, __ATOMIC_ACQUIRE);
+
+        if (tail == head)
+        {
+            /* Ask to be woken, then look again in case the writer
+               added something before it could see the request */
+            __atomic_store_n(&shared->waiting, 1, __ATOMIC_SEQ_CST);
+
+            if (__atomic_load_n(&shared->head, __ATOMIC_SEQ_CST) == tail)
+                return false;
+
+            continue;
+        }
+
+        record = (CRingRecord*) (ring->data + tail % RING_SIZE);
+
+        if (record->length == RING_WRAP)
+        {
+            __atomic_store_n(&shared->tail, tail + RING_SIZE - tail % RING_SIZE, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        *type = record->type;
+        *payload = record->payload;
+        return true;
+    }
+}
+
+void
+ring_release(CRing* ring)
+{
+    struct CRingShared* shared = ring->shared;
+    unsigned long tail = shared->tail;
+    CRingRecord* record = (CRingRecord*) (ring->data + tail % RING_SIZE);
+
+    __atomic_store_n(&shared->tail, tail + sizeof(CRingRecord) + RING_ALIGN(record->length),
+                     __ATOMIC_RELEASE);
+}
+
+void
+ring_acknowledge(CRing* ring)
+{
+    uint64_t count;
+
+    (void) read(ring->eventfd, &count, sizeof(count));
+}
+
+#else
+
+CRing*
+ring_new(void)
+{
+    return NULL;
+}
+
+CRing*
+ring_attach(int memfd, int eventfd)
+{
+    return NULL;
+}
+
+void
+ring_free(CRing* ring)
+{
+}
+
+bool
+ring_write(CRing* ring, unsigned int type, const void* payload, uipc_typeinfo* info)
+{
+    return false;
+}
+
+bool
+ring_peek(CRing* ring, unsigned int* type, const void** payload)
+{
+    return false;
+}
+
+void
+ring_release(CRing* ring)
+{
+}
+
+void
+ring_acknowledge(CRing* ring)
+{
+}
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2007-2008, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MU_RING_H__
+#define __MU_RING_H__
+
+#include <stdbool.h>
+#include <uipc/marshal.h>
+
+#if defined(HAVE_MEMFD_CREATE) && defined(HAVE_SYS_EVENTFD_H) && defined(HAVE_SYS_MMAN_H)
+#    define HAVE_RING
+#endif
+
+struct CRingShared;
+
+/* A ring buffer in memory shared between a test child, which
+   writes messages into it, and the parent, which reads them */
+typedef struct CRing
+{
+    /* Shared memory and the descriptor it was mapped from */
+    int memfd;
+    struct CRingShared* shared;
+    char* data;
+    /* Readable in the parent when the child has written something */
+    int eventfd;
+    /* Socket to the other side, watched for hangups by a writer waiting for room */
+    int peer;
+} CRing;
+
+/* Creates a ring, or returns NULL if the system does not allow it */
+CRing* ring_new(void);
+/* Maps a ring from descriptors passed from the process which created it */
+CRing* ring_attach(int memfd, int eventfd);
+void ring_free(CRing* ring);
+
+/* Type of the record left in the ring in place of a message too large for it */
+#define RING_DETOUR 0xFFFFFFFFU
+
+/* Writes a message into the ring, waiting for room if it is full.  Returns
+   false if the message is too large for the ring, after writing a
+   RING_DETOUR record in its place, so the caller should send it some other
+   way.  The reader must not pass on anything after the detour record until
+   that message arrives.  Messages are dropped if the peer hangs up while
+   waiting */
+bool ring_write(CRing* ring, unsigned int type, const void* payload, uipc_typeinfo* info);
+/* Finds the next message in the ring, returning false if it is empty */
+bool ring_peek(CRing* ring, unsigned int* type, const void** payload);
+/* Frees the space of the message returned by ring_peek */
+void ring_release(CRing* ring);
+/* Resets the event descriptor once the reader has woken up for it */
+void ring_acknowledge(CRing* ring);
+
+#endif
@@ -54,6 +54,7 @@ typedef struct
         ANSI_TRUE
     } ansi;
     bool details;
+    bool usage;
     MuLogLevel loglevel;
     unsigned int num_tests;
     unsigned int num_suites;
@@ -63,6 +64,8 @@ typedef struct
     unsigned int num_xpass;
     unsigned int num_xfail;
     unsigned int num_skip;
+    unsigned int num_regressed;
+    unsigned int num_improved;
     unsigned int num_lib_abort;
     unsigned int position;
 } ConsoleLogger;
@@ -80,6 +83,8 @@ enter(MuLogger* _self)
     self->num_xpass = 0;
     self->num_xfail = 0;
     self->num_skip = 0;
+    self->num_regressed = 0;
+    self->num_improved = 0;
     self->num_lib_abort = 0;
 
     if (self->ansi == ANSI_AUTO)
@@ -115,6 +120,12 @@ leave(MuLogger* _self)
         if (self->num_skip)
             fprintf(self->out, "  \e[33m\e[1mSkipped\e[22m\e[0m tests:     \e[1m%6u\e[0m\n",
                     self->num_skip);
+        if (self->num_regressed)
+            fprintf(self->out, "  \e[31m\e[1mRegressed\e[22m\e[0m tests:   \e[1m%6u\e[0m\n",
+                    self->num_regressed);
+        if (self->num_improved)
+            fprintf(self->out, "  \e[32m\e[1mImproved\e[22m\e[0m tests:    \e[1m%6u\e[0m\n",
+                    self->num_improved);
         if (self->num_lib_abort)
             fprintf(self->out, "  \e[31m\e[1mAborted\e[22m\e[0m libraries: \e[1m%6u\e[0m\n\n",
                     self->num_lib_abort);
@@ -134,6 +145,12 @@ leave(MuLogger* _self)
         if (self->num_skip)
             fprintf(self->out, "  Skipped tests:     %6u\n",
                     self->num_skip);
+        if (self->num_regressed)
+            fprintf(self->out, "  Regressed tests:   %6u\n",
+                    self->num_regressed);
+        if (self->num_improved)
+            fprintf(self->out, "  Improved tests:    %6u\n",
+                    self->num_improved);
         if (self->num_lib_abort)
             fprintf(self->out, "  Aborted libraries: %6u\n\n",
                     self->num_lib_abort);
@@ -318,7 +335,22 @@ test_leave(MuLogger* _self, MuTest* test, MuTestResult* summary)
         switch (summary->status)
         {
         case MU_STATUS_SUCCESS:
-            result_str = "PASS ";
+            if (summary->comparison && summary->comparison->verdict == MU_VERDICT_REGRESSED)
+            {
+                result_str = "REGRESSED";
+                result_code = 31;
+                self->num_regressed++;
+                break;
+            }
+            else if (summary->comparison && summary->comparison->verdict == MU_VERDICT_IMPROVED)
+            {
+                result_str = "IMPROVED";
+                self->num_improved++;
+            }
+            else
+            {
+                result_str = "PASS ";
+            }
             self->num_pass++;
             break;
 		case MU_STATUS_FAILURE:
@@ -443,6 +475,152 @@ test_leave(MuLogger* _self, MuTest* test, MuTestResult* summary)
             }
         }
 	}
+
+    if (summary->benchmark)
+    {
+        MuTestBenchmark* benchmark = summary->benchmark;
+
+        fprintf(out, "      %.2f ns/op +/- %.1f%% (median %.2f, p99 %.2f) over %u samples of %lu calls\n",
+                benchmark->mean,
+                benchmark->mean > 0 ? (benchmark->ci_high - benchmark->mean) * 100 / benchmark->mean : 0.0,
+                benchmark->median, benchmark->p99, benchmark->samples, benchmark->iterations);
+        fprintf(out, "      load %.2f, %lu preemptions%s%s\n",
+                benchmark->load, benchmark->preemptions,
+                benchmark->frequency_scaling ? ", frequency scaling" : "",
+                benchmark->converged ? ", converged" : "");
+    }
+
+    if (summary->comparison &&
+        (summary->comparison->benchmark || summary->comparison->verdict != MU_VERDICT_UNCHANGED))
+    {
+        MuTestComparison* comparison = summary->comparison;
+        double scale = comparison->benchmark ? 1 : 1000000;
+
+        fprintf(out, "      %.2f %s vs %.2f in baseline (%+.1f%%, ",
+                comparison->median / scale, comparison->benchmark ? "ns/op" : "ms",
+                comparison->baseline_median / scale, comparison->change);
+
+        if (comparison->p_value >= 0)
+            fprintf(out, "p = %.3g; ", comparison->p_value);
+
+        fprintf(out, "%u vs %u samples)\n", comparison->samples, comparison->baseline_samples);
+    }
+
+    if (summary->complexity)
+    {
+        static const char* const terms[] = { "", " + %.4g * log n", " + %.4g * n", " + %.4g * n log n", " + %.4g * n^2" };
+        MuTestComplexity* complexity = summary->complexity;
+
+        fprintf(out, "      %s (bound %s): %.2f",
+                mu_complexity_to_string(complexity->fit), mu_complexity_to_string(complexity->bound),
+                complexity->constant);
+        fprintf(out, terms[complexity->fit], complexity->coefficient);
+        fprintf(out, " ns/call, %.1f%% error, %.1f%% noise over %u sizes%s\n",
+                complexity->error * 100, complexity->noise * 100, complexity->sizes,
+                complexity->inconclusive ? ", inconclusive" : "");
+    }
+
+    if (summary->stress)
+    {
+        MuTestStress* stress = summary->stress;
+
+        if (stress->completed < stress->copies)
+        {
+            fprintf(out, "      %u of %u copies at once finished before one failed\n", stress->completed, stress->copies);
+        }
+        else
+        {
+            fprintf(out, "      %u copies at once: %.1f/s, alone: %.1f/s, scaling %.2fx over %u runs each\n",
+                    stress->copies, stress->throughput, stress->single_throughput, stress->scaling,
+                    stress->rounds);
+        }
+    }
+
+    if (summary->metrics)
+    {
+        MuTestMetric* metric;
+
+        for (metric = summary->metrics; metric; metric = metric->next)
+        {
+            switch (metric->type)
+            {
+            case MU_METRIC_TYPE_COUNTER:
+                fprintf(out, "      %s: %.6g\n", metric->name, metric->value);
+                break;
+            case MU_METRIC_TYPE_GAUGE:
+                fprintf(out, "      %s: %.6g (min %.6g, max %.6g, mean %.6g)\n",
+                        metric->name, metric->value, metric->min, metric->max, metric->mean);
+                break;
+            case MU_METRIC_TYPE_LATENCY:
+                fprintf(out, "      %s: p50 %.0f ns, p90 %.0f, p99 %.0f, p99.9 %.0f, max %.0f over %llu\n",
+                        metric->name, metric->p50, metric->p90, metric->p99, metric->p999,
+                        metric->max, metric->count);
+                break;
+            }
+        }
+    }
+
+    if (summary->attachments)
+    {
+        MuTestAttachment* attachment;
+
+        char* text, *line;
+        size_t length;
+
+        for (attachment = summary->attachments; attachment; attachment = attachment->next)
+        {
+            if (!strcmp(attachment->name, MU_ATTACHMENT_OUTPUT) && (text = mu_attachment_read(attachment)))
+            {
+                for (line = text; *line; line += length + (line[length] == '\n'))
+                {
+                    length = strcspn(line, "\n");
+                    fprintf(out, "      (output) %.*s\n", (int) length, line);
+                }
+                free(text);
+            }
+            else
+            {
+                fprintf(out, "      (attachment) %s: %llu bytes\n", attachment->name, attachment->size);
+            }
+        }
+    }
+
+    if (self->usage && summary->usage)
+    {
+        MuTestUsage* usage = summary->usage;
+
+        fprintf(out, "      cpu %.3f ms user, %.3f ms system; peak rss %lu KB;"
+                " faults %lu minor, %lu major; switches %lu voluntary, %lu involuntary",
+                usage->user_usec / 1000.0, usage->system_usec / 1000.0, usage->max_rss,
+                usage->minor_faults, usage->major_faults,
+                usage->voluntary_switches, usage->involuntary_switches);
+        if (usage->read_bytes >= 0)
+        {
+            fprintf(out, "; io %lld bytes read, %lld written",
+                    usage->read_bytes, usage->write_bytes);
+        }
+        fprintf(out, "\n");
+    }
+
+    if (summary->counters)
+    {
+        MuTestCounters* counters = summary->counters;
+
+        fprintf(out, "      task clock %.3f ms; %lld page faults, %lld context switches, %lld migrations",
+                counters->task_clock / 1000000.0, counters->page_faults,
+                counters->context_switches, counters->cpu_migrations);
+        if (counters->cycles >= 0 && counters->instructions >= 0)
+        {
+            fprintf(out, "\n      %lld cycles, %lld instructions (%.2f per cycle)",
+                    counters->cycles, counters->instructions,
+                    counters->cycles ? (double) counters->instructions / counters->cycles : 0.0);
+        }
+        if (counters->cache_misses >= 0)
+            fprintf(out, ", %lld cache misses", counters->cache_misses);
+        if (counters->branch_misses >= 0)
+            fprintf(out, ", %lld branch misses", counters->branch_misses);
+        fprintf(out, "\n");
+    }
 }
 
 static
@@ -545,6 +723,18 @@ set_details(ConsoleLogger* self, bool details)
     self->details = details;
 }
 
+static bool
+get_usage(ConsoleLogger* self)
+{
+    return self->usage;
+}
+
+static void
+set_usage(ConsoleLogger* self, bool usage)
+{
+    self->usage = usage;
+}
+
 static const char*
 get_loglevel(ConsoleLogger* self)
 {
@@ -623,6 +813,9 @@ static MuOption consolelogger_options[] =
     MU_OPTION("details", MU_TYPE_BOOLEAN, get_details, set_details,
               "Whether result details should be output for failed "
               "tests even if the failure is expected"),
+    MU_OPTION("usage", MU_TYPE_BOOLEAN, get_usage, set_usage,
+              "Whether to print the CPU time, memory, page faults, context "
+              "switches and I/O of each test"),
     MU_OPTION("loglevel", MU_TYPE_STRING, get_loglevel, set_loglevel,
               "Maximum level of logged events which will be printed "
               "(none, warning, info, verbose, trace)"),
@@ -668,7 +861,7 @@ create_consolelogger()
 
 static MuPlugin plugin =
 {
-    .version = MU_PLUGIN_API_1,
+    .version = MU_PLUGIN_API_2,
     .type = MU_PLUGIN_LOGGER,
     .name = "console",
     .author = "Brian Koropoff",
@@ -56,6 +56,8 @@ typedef struct
     FILE* out;
     MuTest* current_test;
     char* title;
+    /* Directory attachments are saved in, if any */
+    char* attachments;
     MuLogLevel loglevel;
     bool pretty;
     bool need_nl;
@@ -127,10 +129,10 @@ escape(JsonLogger* self, char const* str)
         else switch (*str)
         {
         case '"':
-            output(self, "\"");
+            output(self, "\\\"");
             break;
         case '\\':
-            output(self, "\\");
+            output(self, "\\\\");
             break;
         default:
             outputc(self, *str);
@@ -222,9 +224,9 @@ string(JsonLogger* self, char const* value)
 }
 
 static void
-integer(JsonLogger* self, int value)
+integer(JsonLogger* self, long long value)
 {
-    print(self, "%d", value);
+    print(self, "%lld", value);
 }
 
 static void
@@ -236,13 +238,29 @@ key_string(JsonLogger* self, char const* key, char const* value)
 }
 
 static void
-key_integer(JsonLogger* self, char const* key, int value)
+key_integer(JsonLogger* self, char const* key, long long value)
 {
     key_begin(self, key);
     integer(self, value);
     key_end(self);
 }
 
+static void
+key_boolean(JsonLogger* self, char const* key, bool value)
+{
+    key_begin(self, key);
+    print(self, value ? "true" : "false");
+    key_end(self);
+}
+
+static void
+key_double(JsonLogger* self, char const* key, double value)
+{
+    key_begin(self, key);
+    print(self, "%.3f", value);
+    key_end(self);
+}
+
 static void
 key_array_begin(JsonLogger* self, char const* key)
 {
@@ -467,6 +485,224 @@ static void test_leave(MuLogger* _self,
 
     key_object_end(self);
 
+    if (summary->usage)
+    {
+        MuTestUsage* usage = summary->usage;
+
+        key_object_begin(self, "usage");
+        key_integer(self, "user_usec", usage->user_usec);
+        key_integer(self, "system_usec", usage->system_usec);
+        key_integer(self, "max_rss_kb", usage->max_rss);
+        key_integer(self, "minor_faults", usage->minor_faults);
+        key_integer(self, "major_faults", usage->major_faults);
+        key_integer(self, "voluntary_switches", usage->voluntary_switches);
+        key_integer(self, "involuntary_switches", usage->involuntary_switches);
+        if (usage->read_bytes >= 0)
+        {
+            key_integer(self, "read_bytes", usage->read_bytes);
+            key_integer(self, "write_bytes", usage->write_bytes);
+        }
+        key_object_end(self);
+    }
+
+    if (summary->counters)
+    {
+        static const char* const names[] =
+        {
+            "cycles", "instructions", "cache_misses", "branch_misses",
+            "task_clock_nsec", "page_faults", "context_switches", "cpu_migrations"
+        };
+        long long* value = &summary->counters->cycles;
+        unsigned int i;
+
+        key_object_begin(self, "counters");
+        for (i = 0; i < sizeof(names) / sizeof(*names); i++)
+        {
+            if (value[i] >= 0)
+            {
+                key_integer(self, names[i], value[i]);
+            }
+        }
+        key_object_end(self);
+    }
+
+    if (summary->benchmark)
+    {
+        MuTestBenchmark* benchmark = summary->benchmark;
+
+        key_object_begin(self, "benchmark");
+        key_integer(self, "iterations", benchmark->iterations);
+        key_integer(self, "samples", benchmark->samples);
+        key_double(self, "mean_ns", benchmark->mean);
+        key_double(self, "median_ns", benchmark->median);
+        key_double(self, "p99_ns", benchmark->p99);
+        key_double(self, "stddev_ns", benchmark->stddev);
+        key_double(self, "ci_low_ns", benchmark->ci_low);
+        key_double(self, "ci_high_ns", benchmark->ci_high);
+        key_boolean(self, "converged", benchmark->converged);
+        if (benchmark->cpu >= 0)
+        {
+            key_integer(self, "cpu", benchmark->cpu);
+        }
+        key_boolean(self, "frequency_scaling", benchmark->frequency_scaling);
+        key_double(self, "load", benchmark->load);
+        key_integer(self, "preemptions", benchmark->preemptions);
+        key_object_end(self);
+    }
+
+    if (summary->comparison)
+    {
+        MuTestComparison* comparison = summary->comparison;
+
+        key_object_begin(self, "baseline");
+        key_string(self, "verdict", mu_test_verdict_to_string(comparison->verdict));
+        key_string(self, "unit", comparison->benchmark ? "call" : "test");
+        key_double(self, "baseline_median_ns", comparison->baseline_median);
+        key_double(self, "median_ns", comparison->median);
+        key_double(self, "change_percent", comparison->change);
+        key_begin(self, "p_value");
+        if (comparison->p_value >= 0)
+            print(self, "%.4g", comparison->p_value);
+        else
+            print(self, "null");
+        key_end(self);
+        key_integer(self, "baseline_samples", comparison->baseline_samples);
+        key_integer(self, "samples", comparison->samples);
+        key_object_end(self);
+    }
+
+    if (summary->stress)
+    {
+        MuTestStress* stress = summary->stress;
+
+        key_object_begin(self, "stress");
+        key_integer(self, "copies", stress->copies);
+        key_integer(self, "completed", stress->completed);
+        key_integer(self, "rounds", stress->rounds);
+        if (stress->completed == stress->copies)
+        {
+            key_double(self, "single_ns", stress->single_nsec);
+            key_double(self, "stress_ns", stress->stress_nsec);
+            key_double(self, "single_throughput", stress->single_throughput);
+            key_double(self, "throughput", stress->throughput);
+            key_double(self, "scaling", stress->scaling);
+        }
+        key_object_end(self);
+    }
+
+    if (summary->complexity)
+    {
+        MuTestComplexity* complexity = summary->complexity;
+        unsigned int i;
+
+        key_object_begin(self, "complexity");
+        key_string(self, "bound", mu_complexity_to_string(complexity->bound));
+        key_string(self, "fit", mu_complexity_to_string(complexity->fit));
+        key_double(self, "constant_ns", complexity->constant);
+        key_begin(self, "coefficient_ns");
+        print(self, "%.6g", complexity->coefficient);
+        key_end(self);
+        key_double(self, "error", complexity->error);
+        key_double(self, "noise", complexity->noise);
+        key_boolean(self, "exceeded", complexity->exceeded);
+        key_boolean(self, "inconclusive", complexity->inconclusive);
+        key_array_begin(self, "samples");
+        for (i = 0; i < complexity->sizes; i++)
+        {
+            elem_object_begin(self);
+            key_integer(self, "size", complexity->size[i]);
+            key_double(self, "time_ns", complexity->time[i]);
+            elem_object_end(self);
+        }
+        key_array_end(self);
+        key_object_end(self);
+    }
+
+    if (summary->metrics)
+    {
+        MuTestMetric* metric;
+
+        key_array_begin(self, "metrics");
+        for (metric = summary->metrics; metric; metric = metric->next)
+        {
+            elem_object_begin(self);
+            key_string(self, "name", metric->name);
+            key_string(self, "type", mu_metric_type_to_string(metric->type));
+            key_integer(self, "count", metric->count);
+            switch (metric->type)
+            {
+            case MU_METRIC_TYPE_COUNTER:
+                key_double(self, "value", metric->value);
+                break;
+            case MU_METRIC_TYPE_GAUGE:
+                key_double(self, "value", metric->value);
+                key_double(self, "min", metric->min);
+                key_double(self, "max", metric->max);
+                key_double(self, "mean", metric->mean);
+                break;
+            case MU_METRIC_TYPE_LATENCY:
+            {
+                unsigned int i;
+
+                key_double(self, "min_ns", metric->min);
+                key_double(self, "max_ns", metric->max);
+                key_double(self, "mean_ns", metric->mean);
+                key_double(self, "p50_ns", metric->p50);
+                key_double(self, "p90_ns", metric->p90);
+                key_double(self, "p99_ns", metric->p99);
+                key_double(self, "p999_ns", metric->p999);
+                key_array_begin(self, "histogram");
+                for (i = 0; i < metric->bucket_count; i++)
+                {
+                    elem_object_begin(self);
+                    key_integer(self, "le_ns", metric->buckets[i].upper);
+                    key_integer(self, "count", metric->buckets[i].count);
+                    elem_object_end(self);
+                }
+                key_array_end(self);
+                break;
+            }
+            }
+            elem_object_end(self);
+        }
+        key_array_end(self);
+    }
+
+    if (summary->attachments)
+    {
+        MuTestAttachment* attachment;
+        char* text;
+
+        for (attachment = summary->attachments; attachment; attachment = attachment->next)
+        {
+            if (!strcmp(attachment->name, MU_ATTACHMENT_OUTPUT) && (text = mu_attachment_read(attachment)))
+            {
+                key_string(self, "output", text);
+                free(text);
+            }
+        }
+
+        key_array_begin(self, "attachments");
+        for (attachment = summary->attachments; attachment; attachment = attachment->next)
+        {
+            elem_object_begin(self);
+            key_string(self, "name", attachment->name);
+            key_integer(self, "size", attachment->size);
+            if (self->attachments)
+            {
+                char* path = mu_attachment_save(attachment, test, self->attachments);
+
+                if (path)
+                {
+                    key_string(self, "path", path);
+                    free(path);
+                }
+            }
+            elem_object_end(self);
+        }
+        key_array_end(self);
+    }
+
     if (summary->backtrace)
     {
         MuBacktrace* frame;
@@ -610,6 +846,20 @@ set_loglevel(JsonLogger* self, const char* level)
     }
 }
 
+static const char*
+get_attachments(JsonLogger* self)
+{
+    return self->attachments;
+}
+
+static void
+set_attachments(JsonLogger* self, const char* dir)
+{
+    if (self->attachments)
+        free(self->attachments);
+    self->attachments = strdup(dir);
+}
+
 static bool
 get_pretty(JsonLogger* self)
 {
@@ -631,6 +881,8 @@ destroy(MuLogger* _logger)
         fclose(logger->out);
     if (logger->file)
         free(logger->file);
+    if (logger->attachments)
+        free(logger->attachments);
 
     free(logger);
 }
@@ -647,6 +899,8 @@ static MuOption jsonlogger_options[] =
               "Maximum level of logged events which will be recorded"),
     MU_OPTION("pretty", MU_TYPE_BOOLEAN, get_pretty, set_pretty,
               "Output prettified JSON"),
+    MU_OPTION("attachments", MU_TYPE_STRING, get_attachments, set_attachments,
+              "Directory to which attachments will be saved"),
     MU_OPTION_END
 };
 
@@ -690,7 +944,7 @@ create_jsonlogger()
 
 static MuPlugin plugin =
 {
-    .version = MU_PLUGIN_API_1,
+    .version = MU_PLUGIN_API_2,
     .type = MU_PLUGIN_LOGGER,
     .name = "json",
     .author = "Brian Koropoff",
@@ -295,7 +295,7 @@ get_shloader()
 
 static MuPlugin plugin =
 {
-    .version = MU_PLUGIN_API_1,
+    .version = MU_PLUGIN_API_2,
     .type = MU_PLUGIN_LOADER,
     .name = "sh",
     .author = "Brian Koropoff",
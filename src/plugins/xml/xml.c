@@ -54,6 +54,8 @@ typedef struct
     MuTest* current_test;
     char* title;
     char* name;
+    /* Directory attachments are saved in, if any */
+    char* attachments;
     MuLogLevel loglevel;
 } XmlLogger;
 
@@ -298,6 +300,180 @@ static void test_leave(MuLogger* _self,
         }
 	}
 
+    if (summary->usage)
+    {
+        MuTestUsage* usage = summary->usage;
+
+        fprintf(out, INDENT_TEST INDENT "<usage user_usec=\"%lu\" system_usec=\"%lu\" max_rss_kb=\"%lu\"",
+                usage->user_usec, usage->system_usec, usage->max_rss);
+        fprintf(out, " minor_faults=\"%lu\" major_faults=\"%lu\"",
+                usage->minor_faults, usage->major_faults);
+        fprintf(out, " voluntary_switches=\"%lu\" involuntary_switches=\"%lu\"",
+                usage->voluntary_switches, usage->involuntary_switches);
+        if (usage->read_bytes >= 0)
+        {
+            fprintf(out, " read_bytes=\"%lld\" write_bytes=\"%lld\"",
+                    usage->read_bytes, usage->write_bytes);
+        }
+        output(out, "/>\n");
+    }
+
+    if (summary->counters)
+    {
+        static const char* const names[] =
+        {
+            "cycles", "instructions", "cache_misses", "branch_misses",
+            "task_clock_nsec", "page_faults", "context_switches", "cpu_migrations"
+        };
+        long long* value = &summary->counters->cycles;
+        unsigned int i;
+
+        fprintf(out, INDENT_TEST INDENT "<counters");
+        for (i = 0; i < sizeof(names) / sizeof(*names); i++)
+        {
+            if (value[i] >= 0)
+                fprintf(out, " %s=\"%lld\"", names[i], value[i]);
+        }
+        output(out, "/>\n");
+    }
+
+    if (summary->benchmark)
+    {
+        MuTestBenchmark* benchmark = summary->benchmark;
+
+        fprintf(out, INDENT_TEST INDENT "<benchmark iterations=\"%lu\" samples=\"%u\"",
+                benchmark->iterations, benchmark->samples);
+        fprintf(out, " mean_ns=\"%.3f\" median_ns=\"%.3f\" p99_ns=\"%.3f\" stddev_ns=\"%.3f\"",
+                benchmark->mean, benchmark->median, benchmark->p99, benchmark->stddev);
+        fprintf(out, " ci_low_ns=\"%.3f\" ci_high_ns=\"%.3f\" converged=\"%s\"",
+                benchmark->ci_low, benchmark->ci_high, benchmark->converged ? "yes" : "no");
+        if (benchmark->cpu >= 0)
+            fprintf(out, " cpu=\"%i\"", benchmark->cpu);
+        fprintf(out, " frequency_scaling=\"%s\" load=\"%.2f\" preemptions=\"%lu\"/>\n",
+                benchmark->frequency_scaling ? "yes" : "no", benchmark->load, benchmark->preemptions);
+    }
+
+    if (summary->comparison)
+    {
+        MuTestComparison* comparison = summary->comparison;
+
+        fprintf(out, INDENT_TEST INDENT "<baseline verdict=\"%s\" unit=\"%s\"",
+                mu_test_verdict_to_string(comparison->verdict), comparison->benchmark ? "call" : "test");
+        fprintf(out, " baseline_median_ns=\"%.3f\" median_ns=\"%.3f\" change_percent=\"%.2f\"",
+                comparison->baseline_median, comparison->median, comparison->change);
+        if (comparison->p_value >= 0)
+            fprintf(out, " p_value=\"%.4g\"", comparison->p_value);
+        fprintf(out, " baseline_samples=\"%u\" samples=\"%u\"/>\n",
+                comparison->baseline_samples, comparison->samples);
+    }
+
+    if (summary->stress)
+    {
+        MuTestStress* stress = summary->stress;
+
+        fprintf(out, INDENT_TEST INDENT "<stress copies=\"%u\" completed=\"%u\" rounds=\"%u\"",
+                stress->copies, stress->completed, stress->rounds);
+        if (stress->completed == stress->copies)
+        {
+            fprintf(out, " single_ns=\"%.3f\" stress_ns=\"%.3f\"", stress->single_nsec, stress->stress_nsec);
+            fprintf(out, " single_throughput=\"%.3f\" throughput=\"%.3f\" scaling=\"%.3f\"",
+                    stress->single_throughput, stress->throughput, stress->scaling);
+        }
+        output(out, "/>\n");
+    }
+
+    if (summary->complexity)
+    {
+        MuTestComplexity* complexity = summary->complexity;
+        unsigned int i;
+
+        fprintf(out, INDENT_TEST INDENT "<complexity bound=\"%s\" fit=\"%s\"",
+                mu_complexity_to_string(complexity->bound), mu_complexity_to_string(complexity->fit));
+        fprintf(out, " constant_ns=\"%.3f\" coefficient_ns=\"%.6g\" error=\"%.4f\" noise=\"%.4f\"",
+                complexity->constant, complexity->coefficient, complexity->error, complexity->noise);
+        fprintf(out, " exceeded=\"%s\" inconclusive=\"%s\">\n",
+                complexity->exceeded ? "yes" : "no", complexity->inconclusive ? "yes" : "no");
+        for (i = 0; i < complexity->sizes; i++)
+        {
+            fprintf(out, INDENT_TEST INDENT INDENT "<sample size=\"%lu\" time_ns=\"%.3f\"/>\n",
+                    complexity->size[i], complexity->time[i]);
+        }
+        fprintf(out, INDENT_TEST INDENT "</complexity>\n");
+    }
+
+    if (summary->metrics)
+    {
+        MuTestMetric* metric;
+
+        fprintf(out, INDENT_TEST INDENT "<metrics>\n");
+        for (metric = summary->metrics; metric; metric = metric->next)
+        {
+            xml_escape_wrap(out, INDENT_TEST INDENT INDENT "<metric name=\"", metric->name, "\"");
+            fprintf(out, " type=\"%s\" count=\"%llu\"", mu_metric_type_to_string(metric->type), metric->count);
+            switch (metric->type)
+            {
+            case MU_METRIC_TYPE_COUNTER:
+                fprintf(out, " value=\"%.6g\"/>\n", metric->value);
+                break;
+            case MU_METRIC_TYPE_GAUGE:
+                fprintf(out, " value=\"%.6g\" min=\"%.6g\" max=\"%.6g\" mean=\"%.6g\"/>\n",
+                        metric->value, metric->min, metric->max, metric->mean);
+                break;
+            case MU_METRIC_TYPE_LATENCY:
+            {
+                unsigned int i;
+
+                fprintf(out, " min_ns=\"%.0f\" max_ns=\"%.0f\" mean_ns=\"%.3f\"",
+                        metric->min, metric->max, metric->mean);
+                fprintf(out, " p50_ns=\"%.0f\" p90_ns=\"%.0f\" p99_ns=\"%.0f\" p999_ns=\"%.0f\">\n",
+                        metric->p50, metric->p90, metric->p99, metric->p999);
+                for (i = 0; i < metric->bucket_count; i++)
+                {
+                    fprintf(out, INDENT_TEST INDENT INDENT INDENT "<bucket le_ns=\"%llu\" count=\"%llu\"/>\n",
+                            metric->buckets[i].upper, metric->buckets[i].count);
+                }
+                fprintf(out, INDENT_TEST INDENT INDENT "</metric>\n");
+                break;
+            }
+            }
+        }
+        fprintf(out, INDENT_TEST INDENT "</metrics>\n");
+    }
+
+    if (summary->attachments)
+    {
+        MuTestAttachment* attachment;
+        char* text;
+
+        for (attachment = summary->attachments; attachment; attachment = attachment->next)
+        {
+            if (!strcmp(attachment->name, MU_ATTACHMENT_OUTPUT) && (text = mu_attachment_read(attachment)))
+            {
+                xml_escape_wrap(out, INDENT_TEST INDENT "<output>", text, "</output>\n");
+                free(text);
+            }
+        }
+
+        fprintf(out, INDENT_TEST INDENT "<attachments>\n");
+        for (attachment = summary->attachments; attachment; attachment = attachment->next)
+        {
+            xml_escape_wrap(out, INDENT_TEST INDENT INDENT "<attachment name=\"", attachment->name, "\"");
+            fprintf(out, " size=\"%llu\"", attachment->size);
+            if (self->attachments)
+            {
+                char* path = mu_attachment_save(attachment, test, self->attachments);
+
+                if (path)
+                {
+                    xml_escape_wrap(out, " path=\"", path, "\"");
+                    free(path);
+                }
+            }
+            output(out, "/>\n");
+        }
+        fprintf(out, INDENT_TEST INDENT "</attachments>\n");
+    }
+
     if (summary->backtrace)
     {
         MuBacktrace* frame;
@@ -399,6 +575,20 @@ set_title(XmlLogger* self, const char* title)
     self->title = strdup(title);
 }
 
+static const char*
+get_attachments(XmlLogger* self)
+{
+    return self->attachments;
+}
+
+static void
+set_attachments(XmlLogger* self, const char* dir)
+{
+    if (self->attachments)
+        free(self->attachments);
+    self->attachments = strdup(dir);
+}
+
 static const char*
 get_loglevel(XmlLogger* self)
 {
@@ -461,6 +651,8 @@ destroy(MuLogger* _logger)
         free(logger->name);
     if (logger->file)
         free(logger->file);
+    if (logger->attachments)
+        free(logger->attachments);
 
     free(logger);
 }
@@ -477,6 +669,8 @@ static MuOption xmllogger_options[] =
               "Value of the title attribute on the <moonunit> node"),
     MU_OPTION("loglevel", MU_TYPE_STRING, get_loglevel, set_loglevel,
               "Maximum level of logged events which will be recorded"),
+    MU_OPTION("attachments", MU_TYPE_STRING, get_attachments, set_attachments,
+              "Directory to which attachments will be saved"),
     MU_OPTION_END
 };
 
@@ -520,7 +714,7 @@ create_xmllogger()
 
 static MuPlugin plugin =
 {
-    .version = MU_PLUGIN_API_1,
+    .version = MU_PLUGIN_API_2,
     .type = MU_PLUGIN_LOGGER,
     .name = "xml",
     .author = "Brian Koropoff",
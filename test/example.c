@@ -34,6 +34,7 @@
 
 #include <moonunit/interface.h>
 
+#include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -49,6 +50,23 @@ MU_LIBRARY_CONSTRUCT()
     constructed = 42;
 }
 
+static int library_ready = 0;
+
+/*
+ * Library setup runs before each test, and library teardown
+ * after it.  Under the zygote loader option, setup runs once
+ * in a process which the test processes are forked from.
+ */
+MU_LIBRARY_SETUP()
+{
+    library_ready = 1;
+}
+
+MU_LIBRARY_TEARDOWN()
+{
+    library_ready = 0;
+}
+
 static int x = 0;
 static int y = 0;
 
@@ -113,6 +131,201 @@ MU_TEST(Arithmetic, bad2)
     MU_ASSERT(x > y);
 }
 
+MU_TEST(Library, ready)
+{
+    MU_ASSERT_EQUAL(MU_TYPE_INTEGER, library_ready, 1);
+}
+
+/*
+ * The following tests check that a process which runs several
+ * tests under the batch loader option is left clean between
+ * them.  Fixture setup asserts that teardown ran after the last
+ * test, even though that test ended early with a failed
+ * assertion.
+ */
+static int batch_fixture = 0;
+static int batch_polluted = 0;
+
+MU_FIXTURE_SETUP(Batch)
+{
+    MU_ASSERT_EQUAL(MU_TYPE_INTEGER, batch_fixture, 0);
+    batch_fixture = 1;
+}
+
+MU_FIXTURE_TEARDOWN(Batch)
+{
+    batch_fixture = 0;
+}
+
+MU_TEST(Batch, a_assertion)
+{
+    MU_EXPECT(MU_STATUS_ASSERTION);
+
+    MU_ASSERT(batch_fixture == 0);
+}
+
+MU_TEST(Batch, b_after_assertion)
+{
+    MU_ASSERT_EQUAL(MU_TYPE_INTEGER, library_ready, 1);
+}
+
+MU_TEST(Batch, c_unsafe)
+{
+    /* This test leaves behind state, so no test may follow it */
+    MU_UNSAFE();
+    batch_polluted = 1;
+}
+
+MU_TEST(Batch, d_after_unsafe)
+{
+    MU_ASSERT_EQUAL(MU_TYPE_INTEGER, batch_polluted, 0);
+    MU_ASSERT_EQUAL(MU_TYPE_INTEGER, library_ready, 1);
+}
+
+/*
+ * Benchmarks are run many times over and report the time
+ * each call took.  Fixture setup runs once around all calls.
+ */
+static char bench_text[64];
+
+MU_FIXTURE_SETUP(Benchmark)
+{
+    memset(bench_text, 'x', sizeof(bench_text) - 1);
+}
+
+MU_BENCHMARK(Benchmark, strlen)
+{
+    MU_ASSERT(strlen(bench_text) == sizeof(bench_text) - 1);
+}
+
+/*
+ * Latency histograms are sent as arrays of packed counts.
+ * These counts and bucket bounds take several bytes each.
+ */
+MU_TEST(Metric, histogram)
+{
+    int i;
+
+    for (i = 0; i < 200; i++)
+        MU_METRIC_LATENCY("wait", 1000);
+    for (i = 0; i < 70000; i++)
+        MU_METRIC_LATENCY("wait", 1000000);
+
+    MU_METRIC_LATENCY("wait", 10000000000.0);
+}
+
+/*
+ * The following tests check how the running time of a
+ * workload grows with the size of its input.
+ */
+static volatile unsigned long complexity_sink;
+
+static void
+sum_workload(unsigned long size, void* data)
+{
+    unsigned long i, sum = 0;
+
+    for (i = 0; i < size; i++)
+        sum += i * 7;
+
+    complexity_sink = sum;
+}
+
+static void
+pairs_workload(unsigned long size, void* data)
+{
+    unsigned long i, j, sum = 0;
+
+    for (i = 0; i < size; i++)
+        for (j = 0; j < size; j++)
+            sum += i ^ j;
+
+    complexity_sink = sum;
+}
+
+static const unsigned long sum_sizes[] = { 100, 1000, 10000, 100000 };
+static const unsigned long pairs_sizes[] = { 10, 30, 100, 300, 1000 };
+
+MU_TEST(Complexity, linear)
+{
+    /* Each size is timed for about a tenth of a second, longer when busy */
+    MU_TIMEOUT(20000);
+
+    MU_ASSERT_COMPLEXITY(MU_COMPLEXITY_LINEAR, sum_workload, NULL, sum_sizes, 4);
+}
+
+MU_TEST(Complexity, quadratic)
+{
+    MU_EXPECT(MU_STATUS_ASSERTION);
+    MU_TIMEOUT(20000);
+
+    MU_ASSERT_COMPLEXITY(MU_COMPLEXITY_CONSTANT, pairs_workload, NULL, pairs_sizes, 5);
+}
+
+/*
+ * This test is run by itself and then as several copies at
+ * once, each on its own thread, which contend for a lock.
+ */
+static pthread_mutex_t stress_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int stress_holders = 0;
+
+MU_TEST(Stress, lock)
+{
+    int i, holders;
+
+    MU_STRESS(4);
+
+    for (i = 0; i < 1000; i++)
+    {
+        pthread_mutex_lock(&stress_lock);
+        holders = ++stress_holders;
+        stress_holders--;
+        pthread_mutex_unlock(&stress_lock);
+
+        MU_ASSERT_EQUAL(MU_TYPE_INTEGER, holders, 1);
+    }
+}
+
+/*
+ * Files and buffers can be attached to a test result.  make
+ * test checks what the logger saves of these.
+ */
+MU_TEST(Attach, files)
+{
+    static const char note[] = "Attached from memory\n";
+    static const char piped[] = "Attached from a pipe\n";
+    int fd[2];
+
+    MU_ATTACH_BUFFER("note.txt", note, sizeof(note) - 1);
+
+    if (pipe(fd))
+        MU_FAILURE("pipe(): %s", strerror(errno));
+    if (write(fd[1], piped, sizeof(piped) - 1) < 0)
+        MU_FAILURE("write(): %s", strerror(errno));
+    close(fd[1]);
+
+    MU_ATTACH("piped.txt", fd[0]);
+    close(fd[0]);
+}
+
+/*
+ * Metrics are reported with the test result.  make test
+ * checks the values reported for this test.
+ */
+MU_TEST(Metric, record)
+{
+    int i;
+
+    MU_METRIC_COUNTER("items", 2);
+    MU_METRIC_COUNTER("items", 3);
+
+    MU_METRIC_GAUGE("depth", 4);
+    MU_METRIC_GAUGE("depth", 2);
+
+    for (i = 0; i < 3; i++)
+        MU_METRIC_LATENCY("step", 1000000);
+}
+
 /*
  * The following tests demonstrate various ways
  * to crash or otherwise fail
@@ -208,6 +421,18 @@ MU_TEST(Log, trace)
     MU_TRACE("This is trace output");
 }
 
+/*
+ * Many events logged at once are sent in batches, and make
+ * test checks that every one of them arrives.
+ */
+MU_TEST(Log, flood)
+{
+    int i;
+
+    for (i = 0; i < 1000; i++)
+        MU_TRACE("Event #%i", i);
+}
+
 MU_TEST(Log, resource)
 {
     MU_INFO("%s", MU_RESOURCE("info message"));
@@ -228,6 +453,47 @@ MU_TEST(Log, fail)
     MU_FAILURE("I told you so");
 }
 
+/*
+ * An event too large to go the usual way still arrives between
+ * the events logged before and after it.  Its level tells it
+ * apart when make test checks the order.
+ */
+MU_TEST(Log, ordered)
+{
+    static char message[100001];
+
+    memset(message, 'x', sizeof(message) - 1);
+
+    MU_VERBOSE("Before the large event");
+    MU_DEBUG("%s", message);
+    MU_VERBOSE("After the large event");
+    MU_VERBOSE("Last of all");
+}
+
+/*
+ * A result which does not fit in the runner's usual receive
+ * buffer still arrives whole.
+ */
+MU_TEST(Log, long_reason)
+{
+    static char reason[100001];
+
+    MU_EXPECT(MU_STATUS_FAILURE);
+
+    memset(reason, 'x', sizeof(reason) - 1);
+
+    MU_FAILURE("%s", reason);
+}
+
+/*
+ * What a test prints can be captured and reported with its
+ * result.  make test checks the output captured from this one.
+ */
+MU_TEST(Log, print)
+{
+    printf("Printed by a test\n");
+}
+
 /*
  * Some utility code to implement a thread barrier for an
  * upcoming test
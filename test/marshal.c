@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2007, Brian Koropoff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Moonunit project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BRIAN KOROPOFF ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL BRIAN KOROPOFF BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file marshal.c
+ * @brief Checks of the marshalling code the C loader generates
+ */
+
+/** \cond SKIP */
+
+#include <moonunit/interface.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "c-marshal.h"
+
+/*
+ * Results and events are marshalled into buffers by the code
+ * UIPC_GENERATE makes for them, but sent as iovecs and read in
+ * place by walking their member tables.  Both must agree on the
+ * bytes and on what the bytes turn back into.
+ */
+
+/* Marshals a payload by the member table, as it is sent, and
+   returns the bytes gathered into one buffer */
+static char*
+marshal_vector(const void* payload, uipc_typeinfo* type, unsigned long* length)
+{
+    struct iovec iov[16];
+    uipc_vector vector;
+    unsigned long size = 64;
+    char* flat;
+    int i;
+
+    for (;;)
+    {
+        vector.buffer = malloc(size);
+        vector.size = size;
+        vector.used = 0;
+        vector.iov = iov;
+        vector.count = 0;
+        vector.max = sizeof(iov) / sizeof(*iov);
+        vector.buffering = false;
+        vector.length = 0;
+
+        *length = uipc_marshal_payload_vector(&vector, payload, type);
+
+        if (vector.used <= vector.size)
+            break;
+
+        free(vector.buffer);
+        size = vector.used;
+    }
+
+    flat = malloc(*length);
+
+    for (i = 0, size = 0; i < vector.count; i++)
+    {
+        memcpy(flat + size, iov[i].iov_base, iov[i].iov_len);
+        size += iov[i].iov_len;
+    }
+
+    MU_ASSERT_EQUAL(MU_TYPE_INTEGER, size, *length);
+
+    free(vector.buffer);
+
+    return flat;
+}
+
+/* Marshals a payload with its generated code and checks that the
+   member table gives the same bytes, give or take the padding
+   which ends a vector.  Returns the bytes from each */
+static void
+marshal_both(const void* payload, uipc_typeinfo* type, char** generated, char** walked)
+{
+    unsigned long length = uipc_marshal_payload(NULL, 0, payload, type);
+    unsigned long vector_length;
+
+    *generated = malloc(length);
+    MU_ASSERT_EQUAL(MU_TYPE_INTEGER, uipc_marshal_payload(*generated, length, payload, type), length);
+
+    *walked = marshal_vector(payload, type, &vector_length);
+    MU_ASSERT_EQUAL(MU_TYPE_INTEGER, vector_length, length + UIPC_ALIGN_PAD(length));
+    MU_ASSERT(!memcmp(*generated, *walked, length));
+}
+
+static void
+check_backtrace(const MuBacktrace* expected, const MuBacktrace* actual)
+{
+    for (; expected; expected = expected->up, actual = actual->up)
+    {
+        MU_ASSERT(actual != NULL);
+        MU_ASSERT_EQUAL(MU_TYPE_INTEGER, actual->return_addr, expected->return_addr);
+        MU_ASSERT_EQUAL(MU_TYPE_INTEGER, actual->func_addr, expected->func_addr);
+
+        if (expected->file_name)
+            MU_ASSERT_EQUAL(MU_TYPE_STRING, actual->file_name, expected->file_name);
+        else
+            MU_ASSERT(actual->file_name == NULL);
+
+        if (expected->func_name)
+            MU_ASSERT_EQUAL(MU_TYPE_STRING, actual->func_name, expected->func_name);
+        else
+            MU_ASSERT(actual->func_name == NULL);
+    }
+
+    MU_ASSERT(actual == NULL);
+}
+
+static void
+check_metrics(const MuTestMetric* expected, const MuTestMetric* actual)
+{
+    unsigned int i;
+
+    for (; expected; expected = expected->next, actual = actual->next)
+    {
+        MU_ASSERT(actual != NULL);
+        MU_ASSERT_EQUAL(MU_TYPE_STRING, actual->name, expected->name);
+        MU_ASSERT_EQUAL(MU_TYPE_INTEGER, actual->type, expected->type);
+        MU_ASSERT_EQUAL(MU_TYPE_INTEGER, actual->count, expected->count);
+        MU_ASSERT_EQUAL(MU_TYPE_INTEGER, actual->bucket_count, expected->bucket_count);
+
+        for (i = 0; i < expected->bucket_count; i++)
+        {
+            MU_ASSERT_EQUAL(MU_TYPE_INTEGER, actual->buckets[i].upper, expected->buckets[i].upper);
+            MU_ASSERT_EQUAL(MU_TYPE_INTEGER, actual->buckets[i].count, expected->buckets[i].count);
+        }
+    }
+
+    MU_ASSERT(actual == NULL);
+}
+
+static void
+check_result(const MuTestResult* expected, const MuTestResult* actual)
+{
+    MU_ASSERT_EQUAL(MU_TYPE_INTEGER, actual->status, expected->status);
+    MU_ASSERT_EQUAL(MU_TYPE_INTEGER, actual->stage, expected->stage);
+    MU_ASSERT_EQUAL(MU_TYPE_STRING, actual->reason, expected->reason);
+    MU_ASSERT_EQUAL(MU_TYPE_STRING, actual->file, expected->file);
+    MU_ASSERT_EQUAL(MU_TYPE_INTEGER, actual->line, expected->line);
+    MU_ASSERT(!memcmp(actual->usage, expected->usage, sizeof(*expected->usage)));
+    MU_ASSERT(actual->counters == NULL);
+    MU_ASSERT(actual->benchmark == NULL);
+    check_backtrace(expected->backtrace, actual->backtrace);
+    check_metrics(expected->metrics, actual->metrics);
+    /* Attachments go as descriptors of their own, so the payload
+       only carries the pointer, which the receiver replaces */
+    MU_ASSERT_EQUAL(MU_TYPE_POINTER, actual->attachments, expected->attachments);
+}
+
+MU_TEST(Marshal, result)
+{
+    MuBacktrace frames[2];
+    MuTestUsage usage;
+    MuMetricBucket buckets[] = {{1007, 200}, {1015807, 70000}, {10200547327ULL, 1}};
+    MuTestMetric metrics[2];
+    MuTestAttachment attachment;
+    MuTestResult result;
+    MuTestResult* copy;
+    MuTestResult* inplace;
+    char* generated;
+    char* walked;
+
+    memset(frames, 0, sizeof(frames));
+    frames[0].return_addr = 0x1234;
+    frames[0].func_addr = 0x1200;
+    frames[0].file_name = "example.so";
+    frames[0].func_name = "__mu_f_test_Marshal_result";
+    frames[0].up = &frames[1];
+    frames[1].return_addr = 0x5678;
+    frames[1].file_name = "moonunit";
+
+    memset(&usage, 0, sizeof(usage));
+    usage.user_usec = 1500;
+    usage.max_rss = 2048;
+
+    memset(metrics, 0, sizeof(metrics));
+    metrics[0].name = "step";
+    metrics[0].type = MU_METRIC_TYPE_LATENCY;
+    metrics[0].count = 70201;
+    metrics[0].buckets = buckets;
+    metrics[0].bucket_count = sizeof(buckets) / sizeof(*buckets);
+    metrics[0].next = &metrics[1];
+    metrics[1].name = "items";
+    metrics[1].type = MU_METRIC_TYPE_COUNTER;
+    metrics[1].count = 2;
+    metrics[1].value = 5;
+
+    memset(&attachment, 0, sizeof(attachment));
+    attachment.name = "note.txt";
+    attachment.fd = -1;
+
+    memset(&result, 0, sizeof(result));
+    result.status = MU_STATUS_ASSERTION;
+    result.expected = MU_STATUS_SUCCESS;
+    result.stage = MU_STAGE_TEST;
+    result.reason = "Expression was false: x > y";
+    result.file = "marshal.c";
+    result.line = 42;
+    result.backtrace = frames;
+    result.usage = &usage;
+    result.metrics = metrics;
+    result.attachments = &attachment;
+
+    marshal_both(&result, &testresult_info, &generated, &walked);
+
+    uipc_unmarshal_payload((void**) &copy, generated, &testresult_info);
+    check_result(&result, copy);
+    uipc_free_object(copy, &testresult_info);
+
+    uipc_unmarshal_payload_inplace((void**) &inplace, walked, &testresult_info);
+    check_result(&result, inplace);
+    uipc_free_object_outside(inplace, &testresult_info, walked,
+                             walked + uipc_marshal_payload(NULL, 0, &result, &testresult_info));
+
+    free(generated);
+    free(walked);
+}
+
+MU_TEST(Marshal, event)
+{
+    MuLogEvent event;
+    MuLogEvent* copy;
+    MuLogEvent* inplace;
+    char* generated;
+    char* walked;
+    char message[1000];
+
+    /* Long enough to be sent from where it lies rather than copied */
+    memset(message, 'x', sizeof(message) - 1);
+    message[sizeof(message) - 1] = '\0';
+
+    memset(&event, 0, sizeof(event));
+    event.stage = MU_STAGE_TEST;
+    event.file = "marshal.c";
+    event.line = 7;
+    event.level = MU_LEVEL_WARNING;
+    event.message = message;
+
+    marshal_both(&event, &logevent_info, &generated, &walked);
+
+    uipc_unmarshal_payload((void**) &copy, generated, &logevent_info);
+    uipc_unmarshal_payload_inplace((void**) &inplace, walked, &logevent_info);
+
+    MU_ASSERT_EQUAL(MU_TYPE_STRING, copy->file, event.file);
+    MU_ASSERT_EQUAL(MU_TYPE_STRING, copy->message, event.message);
+    MU_ASSERT_EQUAL(MU_TYPE_INTEGER, copy->level, event.level);
+    MU_ASSERT_EQUAL(MU_TYPE_STRING, inplace->file, event.file);
+    MU_ASSERT_EQUAL(MU_TYPE_STRING, inplace->message, event.message);
+    MU_ASSERT_EQUAL(MU_TYPE_INTEGER, inplace->line, event.line);
+
+    uipc_free_object(copy, &logevent_info);
+    free(generated);
+    free(walked);
+}
+
+/** \endcond */